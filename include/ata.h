@@ -1,4 +1,8 @@
 #pragma once
 #include <stdint.h>
+#define ATA_MAX_SECTORS 256                     // per command
 int ata_read28(uint32_t lba, void *buf);        // returns 0 on success
 int ata_write28(uint32_t lba, const void *buf); // returns 0 on success
+int ata_read(uint32_t lba, unsigned count, void *buf);        // count sectors in one command
+int ata_write(uint32_t lba, unsigned count, const void *buf); // count sectors in one command
+int ata_flush(void);                            // FLUSH CACHE; returns 0 on success
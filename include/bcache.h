@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+
+/* Block buffer cache (src/kernel/bcache.c). A buffer holds size bytes of a
+ * device starting at sector lba, and (dev, lba, size) is its key. Writes
+ * stay in the cache, marked dirty, until the periodic flusher, an
+ * eviction or bcache_sync puts them on the disk. */
+
+#define BDEV_ATA 0             /* primary ATA disk */
+#define BCACHE_NBUF 256        /* one page each */
+#define BCACHE_FLUSH_MS 5000   /* write-back period */
+
+typedef struct buf
+{
+    int dev;
+    uint32_t lba;
+    uint32_t size;   /* 512 to 4096 */
+    int refs;        /* bread/bget holders */
+    int valid;       /* data matches the disk or a newer write */
+    int dirty;
+    int busy;        /* disk transfer in flight */
+    struct buf *hnext;
+    struct buf *lru_prev, *lru_next;
+    uint8_t *data;
+} buf_t;
+
+typedef struct
+{
+    uint64_t hits, misses;
+    uint64_t writebacks; /* buffers written to the disk */
+    uint64_t evictions;
+    uint32_t nbuf, ndirty;
+} bcache_stats_t;
+
+/* A held buffer with the block's contents, or 0 on a read error. */
+buf_t *bread(int dev, uint32_t lba, uint32_t size);
+/* A held buffer for a block the caller is about to overwrite whole. */
+buf_t *bget(int dev, uint32_t lba, uint32_t size);
+/* The held buffer if the block is cached, else 0; never reads. */
+buf_t *bpeek(int dev, uint32_t lba, uint32_t size);
+void bdirty(buf_t *b);
+void brelse(buf_t *b);
+/* Write a held buffer through now. */
+int bwrite(buf_t *b);
+
+/* Write every dirty buffer of dev, then flush the drive's own cache. */
+int bcache_sync(int dev);
+void bcache_init(void);
+/* Read count sectors straight from the device, around the cache, for
+ * bulk file data (src/fs/pcache.c) that would only push metadata out.
+ * Callers check bpeek first for blocks that may be dirty. */
+int bdev_read(int dev, uint32_t lba, uint32_t count, void *buf);
+void bcache_get_stats(bcache_stats_t *s);
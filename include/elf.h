@@ -51,6 +51,36 @@ typedef struct
 #define PT_GNU_STACK    0x6474e551
 #define PT_GNU_RELRO    0x6474e552
 
+typedef struct
+{
+    int64_t d_tag;
+    uint64_t d_val;
+} Elf64_Dyn;
+
+typedef struct
+{
+    uint32_t st_name;
+    unsigned char st_info;
+    unsigned char st_other;
+    uint16_t st_shndx;
+    uint64_t st_value;
+    uint64_t st_size;
+} Elf64_Sym;
+
+#define DT_NULL   0
+#define DT_HASH   4
+#define DT_STRTAB 5
+#define DT_SYMTAB 6
+
+/* Auxiliary vector entries placed above envp on the initial user stack */
+#define AT_NULL         0
+#define AT_PHDR         3
+#define AT_PHENT        4
+#define AT_PHNUM        5
+#define AT_PAGESZ       6
+#define AT_ENTRY        9
+#define AT_SYSINFO_EHDR 33
+
 int elf_load(const void *image, size_t size, uintptr_t *entry, uintptr_t *base, uintptr_t *end);
 
 typedef struct {
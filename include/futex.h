@@ -0,0 +1,15 @@
+#pragma once
+#include <stdint.h>
+#include "sched.h"
+#include "ktime.h"
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+#define FUTEX_PRIVATE_FLAG 128
+#define FUTEX_CLOCK_REALTIME 256
+#define FUTEX_CMD_MASK (~(FUTEX_PRIVATE_FLAG | FUTEX_CLOCK_REALTIME))
+
+int futex_wait(int *uaddr, int val, uint64_t timeout_ticks);
+int futex_wake(int *uaddr, int n);
+void futex_cancel(thread_t *t);
+long sys_futex(int *uaddr, int op, int val, const struct kernel_timespec *timeout, int *uaddr2, int val3);
@@ -0,0 +1,77 @@
+#pragma once
+#include <stdint.h>
+
+/* Shared submission/completion rings. io_uring_setup maps three pages into
+ * the calling process: a control block with the ring indices, the SQE array
+ * and the CQE array. User space fills SQEs and advances sq_tail; one
+ * io_uring_enter runs the queued operations in order and posts a CQE for
+ * each. Operations complete inline, so every submitted SQE has its CQE by
+ * the time enter returns. Opcode numbers follow Linux. */
+
+#define IORING_MAX_ENTRIES 64 /* SQEs per ring; the CQ has twice as many */
+#define IORING_USER_VADDR 0x7FFFFE00000ULL
+
+enum
+{
+    IORING_OP_NOP = 0,
+    IORING_OP_FSYNC = 3,
+    IORING_OP_OPENAT = 18, /* fd=dirfd, addr=path, op_flags=open flags, len=mode */
+    IORING_OP_CLOSE = 19,
+    IORING_OP_STATX = 21,  /* struct stat into off; addr=path, or fd if addr is 0 */
+    IORING_OP_READ = 22,   /* fd, addr, len, off (-1: current position) */
+    IORING_OP_WRITE = 23,
+};
+
+struct io_uring_sqe
+{
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t ioprio;
+    int32_t fd;
+    uint64_t off;
+    uint64_t addr;
+    uint32_t len;
+    uint32_t op_flags;
+    uint64_t user_data;
+    uint64_t pad[3];
+};
+
+struct io_uring_cqe
+{
+    uint64_t user_data;
+    int32_t res;
+    uint32_t flags;
+};
+
+/* Control block. The kernel writes sq_head and cq_tail, user space writes
+ * sq_tail and cq_head; both sides publish with release stores. */
+struct io_uring_ctl
+{
+    uint32_t sq_head, sq_tail, sq_mask, sq_entries;
+    uint32_t cq_head, cq_tail, cq_mask, cq_entries;
+    uint32_t cq_overflow; /* enter stopped early because the CQ was full */
+};
+
+struct io_uring_params
+{
+    uint32_t sq_entries; /* in: requested depth, rounded up to a power of two */
+    uint32_t cq_entries; /* out */
+    uint32_t flags;
+    uint32_t resv;
+    uint64_t ctl;  /* out: user address of struct io_uring_ctl */
+    uint64_t sqes; /* out: user address of the SQE array */
+    uint64_t cqes; /* out: user address of the CQE array */
+};
+
+struct process;
+struct file;
+
+long sys_io_uring_setup(unsigned entries, struct io_uring_params *p);
+long sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags);
+void io_uring_release(struct process *p);
+/* The last reference to an FD_IORING file is gone (file_put). */
+void io_uring_close(struct file *f);
+
+/* user-space wrappers (src/libc/syscalls.c) */
+int io_uring_setup(unsigned entries, struct io_uring_params *p);
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags);
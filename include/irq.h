@@ -4,3 +4,44 @@
 void irq_init(void);
 void irq_install_handler(int irq, void (*h)(void));
 void irq_ack(int irq);
+
+#define IRQ_LINES 16
+
+/* Per-line handler latency, in TSC cycles. */
+typedef struct
+{
+    uint64_t count;
+    uint64_t total_cycles;
+    uint64_t max_cycles;
+} irq_stat_t;
+
+const irq_stat_t *irq_get_stats(int irq);
+
+static inline uint64_t irq_rdtsc(void)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void irq_stat_add(irq_stat_t *s, uint64_t cycles)
+{
+    s->count++;
+    s->total_cycles += cycles;
+    if (cycles > s->max_cycles)
+        s->max_cycles = cycles;
+}
+
+/* Disable interrupts, returning the previous RFLAGS for irq_restore. */
+static inline uint64_t irq_save(void)
+{
+    uint64_t flags;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint64_t flags)
+{
+    if (flags & 0x200)
+        __asm__ volatile("sti" : : : "memory");
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+/* open() flags as the kernel sees them (Linux x86-64 values). The newlib
+ * libc translates its own O_* values in _open. */
+#define O_ACCMODE 0003
+#define O_RDONLY 0000
+#define O_WRONLY 0001
+#define O_RDWR 0002
+#define O_CREAT 0100
+#define O_EXCL 0200
+#define O_TRUNC 01000
+#define O_APPEND 02000
+#define O_NONBLOCK 04000
+#define O_DIRECTORY 0200000
+#define O_CLOEXEC 02000000 /* accepted; there is no exec-time fd closing yet */
+
+/* *at() calls: dirfd meaning "the cwd", and lookup flags */
+#define AT_FDCWD -100
+#define AT_SYMLINK_NOFOLLOW 0x100 /* accepted; there are no symlinks */
+#define AT_EMPTY_PATH 0x1000      /* "" names dirfd itself */
@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+
+#define HZ 100
+#define NSEC_PER_SEC 1000000000ULL
+#define TICK_NSEC (NSEC_PER_SEC / HZ)
+
+#define CLOCK_REALTIME 0
+#define CLOCK_MONOTONIC 1
+#define CLOCK_PROCESS_CPUTIME_ID 2
+#define CLOCK_THREAD_CPUTIME_ID 3
+#define CLOCK_MONOTONIC_RAW 4
+#define CLOCK_REALTIME_COARSE 5
+#define CLOCK_MONOTONIC_COARSE 6
+#define CLOCK_BOOTTIME 7
+
+/* Linux x86-64 layouts, shared by the syscalls and the vDSO */
+struct kernel_timespec {
+    int64_t tv_sec;
+    int64_t tv_nsec;
+};
+
+struct kernel_timeval {
+    int64_t tv_sec;
+    int64_t tv_usec;
+};
+
+void ktime_init(void);
+void ktime_tick(void);
+uint64_t ktime_get_ns(void);
+uint64_t ktime_cycles_to_ns(uint64_t cycles);
+
+long sys_clock_gettime(int clk, struct kernel_timespec *ts);
+long sys_gettimeofday(struct kernel_timeval *tv, void *tz);
+long sys_time(int64_t *t);
+long sys_nanosleep(const struct kernel_timespec *req, struct kernel_timespec *rem);
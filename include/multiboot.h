@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+
+/* The parts of the Multiboot (v1) boot information the kernel reads. The
+ * loader leaves the magic in eax and the info's address in ebx; _start
+ * (src/boot/multiboot64.asm) saves both here. */
+
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
+#define MULTIBOOT_INFO_MODS (1u << 3)
+
+typedef struct
+{
+    uint32_t flags;
+    uint32_t mem_lower, mem_upper;
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+} __attribute__((packed)) multiboot_info_t;
+
+typedef struct
+{
+    uint32_t mod_start, mod_end; /* [start, end) physical */
+    uint32_t string;
+    uint32_t reserved;
+} __attribute__((packed)) multiboot_module_t;
+
+extern uint32_t mb_magic, mb_info;
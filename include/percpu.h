@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+
+/* Per-CPU data, reached from syscall_entry64 through swapgs (IA32_KERNEL_GS_BASE).
+ * The entry code uses fixed offsets: keep them in sync with int80_64.asm. */
+typedef struct percpu
+{
+    struct percpu *self; /* 0 */
+    uint64_t kernel_rsp; /* 8: top of the running thread's kernel stack */
+    uint64_t user_rsp;   /* 16: user rsp, saved while switching stacks */
+} percpu_t;
+
+extern percpu_t cpu0;
+
+/* User segment selectors. SYSRET derives them from STAR, which fixes their
+ * order in the GDT: user data at index 3, user code at index 4. */
+#define KERNEL_CS 0x08
+#define KERNEL_DS 0x10
+#define USER_DS 0x1B
+#define USER_CS 0x23
+
+void syscall_init(void);
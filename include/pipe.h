@@ -0,0 +1,37 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "sched.h"
+#include "poll.h"
+#include "../src/fs/fs.h"
+
+#define PIPE_PAGES 16 /* ring capacity: 64 KiB */
+#define PIPE_SIZE (PIPE_PAGES * 4096)
+#define PIPE_BUF 4096 /* writes up to this size are never interleaved */
+#define PIPE_MAX 32
+
+#define SPLICE_F_MOVE 1
+#define SPLICE_F_NONBLOCK 2
+
+/* Anonymous pipe. The embedded node is what fd entries point at; head and
+ * tail are running byte counts, so head - tail bytes are buffered. */
+typedef struct pipe
+{
+    node_t node;
+    char *pages[PIPE_PAGES];
+    uint64_t head, tail;
+    int readers, writers;
+    waitq_t rwait, wwait;
+    poll_head_t poll;
+    int used;
+} pipe_t;
+
+long pipe_read(node_t *n, void *buf, unsigned long count, int fdflags);
+long pipe_write(node_t *n, const void *buf, unsigned long count, int fdflags);
+void pipe_unref(node_t *n, int flags);
+unsigned pipe_poll(node_t *n, int fdflags, poll_head_t **head);
+
+long sys_pipe(int *pipefd);
+long sys_pipe2(int *pipefd, int flags);
+long sys_splice(int fd_in, long *off_in, int fd_out, long *off_out, unsigned long len, unsigned flags);
+long sys_tee(int fd_in, int fd_out, unsigned long len, unsigned flags);
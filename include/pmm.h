@@ -5,3 +5,6 @@
 void pmm_init(void);
 void *pmm_alloc_page(void);
 void pmm_free_page(void *p);
+/* Keep [start, end) away from the allocator, such as a boot module GRUB
+ * placed after the kernel. Must come before the first allocation there. */
+void pmm_reserve(uintptr_t start, uintptr_t end);
@@ -0,0 +1,76 @@
+#pragma once
+#include <stdint.h>
+
+/* Readiness notification for poll and epoll. Event bits follow Linux. */
+#define POLLIN 0x001
+#define POLLPRI 0x002
+#define POLLOUT 0x004
+#define POLLERR 0x008
+#define POLLHUP 0x010
+#define POLLNVAL 0x020
+#define POLLFREE 0x4000 /* kernel only: the source is going away */
+
+#define EPOLLIN POLLIN
+#define EPOLLOUT POLLOUT
+#define EPOLLERR POLLERR
+#define EPOLLHUP POLLHUP
+#define EPOLLONESHOT (1u << 30)
+#define EPOLLET (1u << 31)
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+#define EPOLL_MAX 16       /* epoll instances system-wide */
+#define EPOLL_MAX_ITEMS 64 /* watched fds per instance */
+#define POLL_MAX 64        /* descriptors per poll call (kept on the kernel stack) */
+
+struct pollfd
+{
+    int fd;
+    short events;
+    short revents;
+};
+
+struct epoll_event
+{
+    uint32_t events;
+    uint64_t data;
+} __attribute__((packed));
+
+/* A waiter hooked onto a readiness source; fn runs, possibly from IRQ
+ * context, each time the source signals events. */
+typedef struct poll_entry
+{
+    struct poll_entry *next;
+    void (*fn)(struct poll_entry *pe, unsigned events);
+    void *owner;
+} poll_entry_t;
+
+/* Embedded in every object that can become ready (tty, pipe, epoll). */
+typedef struct poll_head
+{
+    poll_entry_t *first;
+} poll_head_t;
+
+struct node;
+
+void poll_add(poll_head_t *h, poll_entry_t *pe);
+void poll_remove(poll_head_t *h, poll_entry_t *pe);
+void poll_notify(poll_head_t *h, unsigned events);
+void poll_detach_all(poll_head_t *h);
+unsigned node_poll(struct node *n, int fdflags, poll_head_t **head);
+
+void epoll_unref(struct node *n);
+
+long sys_poll(struct pollfd *fds, unsigned long nfds, int timeout);
+long sys_epoll_create1(int flags);
+long sys_epoll_create(int size);
+long sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *ev);
+long sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+
+/* user-space wrappers (src/libc/syscalls.c) */
+int poll(struct pollfd *fds, unsigned long nfds, int timeout);
+int epoll_create1(int flags);
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *ev);
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
@@ -2,27 +2,66 @@
 #include <stddef.h>
 #include <stdint.h>
 #include "../src/fs/fs.h"
+#include "sched.h"
 
-typedef struct fd_entry {
-    int used;
+// Open file description: shared by dup'd fds and inherited by children,
+// so they share one offset and one set of status flags.
+typedef struct file {
+    int refs;        // fd table slots naming this file; 0 = free
     node_t *node;
-    size_t ofs;
+    size_t ofs;      // byte offset; for directories, the getdents64 position
     int flags;
-} fd_entry_t;
+    node_t *dir_pos; // directory child at ofs, so getdents64 resumes in O(1)
+    fs_ra_t ra;      // read-ahead state for disk files
+} file_t;
 
-#define PROC_FD_MAX 32
+#define FD_IORING 0x40000000 // fd names the process's io_uring instance
+
+#define FILE_MAX 1024        // open file descriptions system-wide
+#define FD_INLINE 32         // fds held in the process slot itself
+#define PROC_FD_MAX 512      // fds per process: the table grows to one page
+#define PROC_MAX 64          // process table slots
+#define PID_MAX 32768        // pids are recycled below this
+#define PID_HASH_SIZE 64     // power of two
+#define PROC_NAME_MAX 16
+
+enum
+{
+    PROC_UNUSED = -1,
+    PROC_RUNNING = 0,
+    PROC_ZOMBIE = 1,
+};
+
+#define WNOHANG 1
+
+struct thread;
+struct io_ring;
+struct strace_ring;
 
 typedef struct process {
     int pid;
     struct process *parent;
-    int state; // 0=running, 1=zombie
-    fd_entry_t fds[PROC_FD_MAX];
+    int state; // PROC_RUNNING or PROC_ZOMBIE; PROC_UNUSED for a free slot
+    int exit_code;
+    char name[PROC_NAME_MAX];
+    struct process *hash_next;   // pid hash chain
+    struct process *children;    // first child
+    struct process *sibling;     // next child of the same parent
+    waitq_t child_wait;          // threads blocked in wait4 on this process
+    waitq_t thread_wait;         // sys_exit waiting for the other threads to end
+    char exec_path[128];         // image proc_spawn's thread will exec
+    char *const *exec_argv;      // owned by the spawner until it reaps the child
+    char *const *exec_envp;
+    struct io_ring *uring;       // io_uring_setup instance, if any
+    struct strace_ring *trace;   // syscall trace ring while traced
+    file_t **fds;                // fd table: fd_inline, or a page once grown
+    int fd_cap;
+    uint64_t fd_bitmap[PROC_FD_MAX / 64]; // set bits are open fds
+    file_t *fd_inline[FD_INLINE];
     uint64_t pml4_phys;
     #define PROC_MAX_PAGES 256
     uint64_t alloc_pages[PROC_MAX_PAGES];
     int alloc_count;
-    uint64_t kernel_saved_rsp;
-    uint64_t kernel_saved_rip;
     uint64_t brk_start;  // base of heap region (virtual user addr)
     uint64_t brk_curr;   // current program break
     uint64_t image_hi;   // highest mapped byte (+1) of current image
@@ -30,17 +69,28 @@ typedef struct process {
 
 process_t *proc_current(void);
 void proc_init(void);
+file_t *file_alloc(node_t *n, int flags);
+void file_get(file_t *f);
+void file_put(file_t *f);
 int proc_alloc_fd(node_t *n);
-fd_entry_t *proc_get_fd(int fd);
+int proc_install_fd(process_t *p, int fd, file_t *f);
+int proc_close_fd(process_t *p, int fd);
+file_t *proc_get_fd(int fd);
+
+process_t *proc_alloc(process_t *parent, const char *name);
+process_t *proc_lookup(int pid);
+process_t *proc_slot(int i);
+void proc_exit(process_t *p, int code);
+void proc_release(process_t *p);
+long proc_spawn(const char *path, char *const argv[], char *const envp[]);
+long sys_wait4(int pid, int *status, int options, void *rusage);
+long sys_getpid(void);
+long sys_getppid(void);
 
 int proc_set_pml4(uint64_t phys);
 uint64_t proc_get_pml4(void);
 int proc_add_allocated_page(uint64_t phys);
 void proc_free_allocated_pages(void);
 
-process_t *proc_current(void);
-void proc_init(void);
-int proc_alloc_fd(node_t *n);
-fd_entry_t *proc_get_fd(int fd);
 uint64_t proc_get_brk(void);
 int proc_set_brk(uint64_t newbrk);
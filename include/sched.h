@@ -0,0 +1,90 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define THREAD_MAX 32
+#define KSTACK_SIZE 16384
+#define SCHED_SLICE_TICKS 2 /* user threads are preempted after this many ticks */
+
+enum
+{
+    THREAD_UNUSED = 0,
+    THREAD_RUNNABLE,
+    THREAD_BLOCKED,
+    THREAD_DEAD,
+};
+
+/* Register state saved by the int 0x80 and SYSCALL entries (lowest address first). */
+typedef struct trap_frame
+{
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    uint64_t rip, cs, rflags, rsp, ss;
+} trap_frame_t;
+
+struct process;
+struct thread;
+
+/* Threads sleeping on some condition (pipe data, poll readiness, ...). */
+typedef struct waitq
+{
+    struct thread *head;
+} waitq_t;
+
+typedef struct thread
+{
+    int tid;
+    int state;
+    const char *name;
+    uint64_t rsp;         /* saved kernel rsp while switched out */
+    uint8_t *kstack;      /* base of the kernel stack (0 for the boot thread) */
+    void (*entry)(void *);
+    void *arg;
+    struct thread *next;  /* run queue link */
+
+    struct process *proc;   /* owning process for user threads */
+    int is_clone;           /* created by clone(): exit ends only this thread */
+    int killed;             /* exit at the next return to user mode */
+    uint64_t kstack_top;    /* TSS.rsp0 while this thread is in user mode */
+    uint64_t fs_base;       /* TLS pointer (arch_prctl / CLONE_SETTLS) */
+    trap_frame_t *tf;       /* frame of the syscall in progress */
+    int *clear_tid;         /* CLONE_CHILD_CLEARTID / set_tid_address */
+    trap_frame_t uregs;     /* initial user registers of a clone child */
+
+    uint64_t futex_key;     /* futex wait queue membership */
+    struct thread *futex_next;
+    int futex_woken;
+
+    waitq_t *waitq;         /* wait queue this thread sleeps on */
+    struct thread *wait_next;
+    int sleep_intr;         /* in poll/epoll_wait: sched_kill wakes it */
+} thread_t;
+
+void sched_init(void);
+thread_t *thread_current(void);
+thread_t *kthread_create(void (*fn)(void *), void *arg, const char *name);
+void kthread_exit(void);
+void thread_activate(thread_t *t);
+void sched_kill(thread_t *t);
+void sched_kill_process(struct process *p);
+int sched_count_threads(struct process *p);
+
+void sched_yield(void);
+void sched_block(void);
+void sched_wakeup(thread_t *t);
+void sched_idle(void);
+void sched_tick(void);
+void sched_preempt(void);
+
+void waitq_sleep(waitq_t *q);
+void waitq_wake_all(waitq_t *q);
+
+/* Sleeping lock for kernel code that blocks while holding it (disk I/O). */
+typedef struct
+{
+    volatile int held;
+    waitq_t q;
+} kmutex_t;
+
+void kmutex_lock(kmutex_t *m);
+void kmutex_unlock(kmutex_t *m);
@@ -0,0 +1,46 @@
+#pragma once
+/* Minimal pthread-style threads for newlib user programs, built on
+ * clone()/futex()/arch_prctl(). Link src/libc/pthread.c. */
+#include <stddef.h>
+
+typedef struct snow_pthread *pthread_t;
+
+typedef struct
+{
+    size_t stacksize;
+} pthread_attr_t;
+
+typedef struct
+{
+    int state; /* 0 unlocked, 1 locked, 2 locked with waiters */
+} pthread_mutex_t;
+
+typedef struct
+{
+    int seq;
+} pthread_cond_t;
+
+#define PTHREAD_MUTEX_INITIALIZER {0}
+#define PTHREAD_COND_INITIALIZER {0}
+#define PTHREAD_STACK_DEFAULT (64 * 1024)
+
+int pthread_attr_init(pthread_attr_t *attr);
+int pthread_attr_setstacksize(pthread_attr_t *attr, size_t size);
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*fn)(void *), void *arg);
+int pthread_join(pthread_t thread, void **retval);
+void pthread_exit(void *retval) __attribute__((noreturn));
+pthread_t pthread_self(void);
+int pthread_equal(pthread_t a, pthread_t b);
+int pthread_yield(void);
+
+int pthread_mutex_init(pthread_mutex_t *m, const void *attr);
+int pthread_mutex_destroy(pthread_mutex_t *m);
+int pthread_mutex_lock(pthread_mutex_t *m);
+int pthread_mutex_trylock(pthread_mutex_t *m);
+int pthread_mutex_unlock(pthread_mutex_t *m);
+
+int pthread_cond_init(pthread_cond_t *c, const void *attr);
+int pthread_cond_destroy(pthread_cond_t *c);
+int pthread_cond_wait(pthread_cond_t *c, pthread_mutex_t *m);
+int pthread_cond_signal(pthread_cond_t *c);
+int pthread_cond_broadcast(pthread_cond_t *c);
@@ -0,0 +1,31 @@
+#pragma once
+#include "irq.h"
+#include <stdint.h>
+
+/* Bottom halves: IRQ handlers acknowledge the device, stash raw data and
+ * raise a softirq; the deferred part runs after EOI with interrupts enabled. */
+enum
+{
+    SOFTIRQ_TIMER = 0,
+    SOFTIRQ_KBD,
+    SOFTIRQ_MOUSE,
+    SOFTIRQ_MAX,
+};
+
+void softirq_register(int nr, void (*fn)(void));
+void softirq_raise(int nr);
+void softirq_run(void);
+const irq_stat_t *softirq_get_stats(int nr);
+
+/* Work queue: process-context deferred calls served by the kworker thread. */
+typedef struct work
+{
+    struct work *next;
+    void (*fn)(void *);
+    void *arg;
+    int pending;
+} work_t;
+
+void workqueue_init(void);
+void work_init(work_t *w, void (*fn)(void *), void *arg);
+int schedule_work(work_t *w);
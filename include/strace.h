@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+
+/* Per-process syscall tracing. A traced process records every syscall into
+ * its ring: number, arguments, result and the TSC at entry and exit. Slots
+ * are claimed with one atomic add, so threads of the process never lock
+ * each other out, and the oldest records are overwritten when the ring
+ * wraps. While no process is traced, dispatch tests one global counter. */
+
+#define STRACE_MAX 4     /* rings, so processes traced at once */
+#define STRACE_RING 256  /* records per ring; power of two */
+
+typedef struct strace_rec
+{
+    uint32_t seq;      /* ring position + 1 of the writer; 0 = never used */
+    uint16_t nr;
+    uint16_t tid;
+    long args[6];
+    long ret;
+    uint64_t t_enter;
+    uint64_t t_exit;   /* 0: did not return (exit, execve, or still running) */
+} strace_rec_t;
+
+typedef struct strace_ring
+{
+    int used;
+    uint32_t head;     /* records claimed so far */
+    strace_rec_t recs[STRACE_RING];
+} strace_ring_t;
+
+struct process;
+
+extern volatile int strace_active; /* processes with tracing on */
+
+strace_ring_t *strace_alloc(void);
+void strace_free(strace_ring_t *r);
+void strace_attach(struct process *p, strace_ring_t *r);
+void strace_detach(struct process *p);
+strace_rec_t *strace_enter(long nr, long a1, long a2, long a3, long a4, long a5, long a6);
+void strace_exit(strace_rec_t *rec, uint32_t seq, long ret);
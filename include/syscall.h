@@ -9,28 +9,146 @@ enum
     SYS_close = 3,
     SYS_stat = 4,
     SYS_fstat = 5,
+    SYS_poll = 7,
     SYS_lseek = 8,
     SYS_brk = 12,
+    SYS_pread64 = 17,
+    SYS_pwrite64 = 18,
+    SYS_readv = 19,
+    SYS_writev = 20,
     SYS_pipe = 22,
+    SYS_sched_yield = 24,
     SYS_dup = 32,
     SYS_dup2 = 33,
+    SYS_nanosleep = 35,
+    SYS_getpid = 39,
+    SYS_sendfile = 40,
+    SYS_clone = 56,
     SYS_fork = 57,
     SYS_execve = 59,
     SYS_exit = 60,
+    SYS_wait4 = 61,
+    SYS_fsync = 74,
+    SYS_fdatasync = 75,
+    SYS_gettimeofday = 96,
+    SYS_getppid = 110,
+    SYS_arch_prctl = 158,
+    SYS_sync = 162,
+    SYS_gettid = 186,
+    SYS_time = 201,
+    SYS_futex = 202,
+    SYS_epoll_create = 213,
+    SYS_getdents64 = 217,
+    SYS_set_tid_address = 218,
+    SYS_clock_gettime = 228,
+    SYS_exit_group = 231,
+    SYS_epoll_wait = 232,
+    SYS_epoll_ctl = 233,
+    SYS_openat = 257,
+    SYS_newfstatat = 262,
+    SYS_splice = 275,
+    SYS_tee = 276,
+    SYS_epoll_create1 = 291,
+    SYS_pipe2 = 293,
+    SYS_copy_file_range = 326,
+    SYS_statx = 332,
+    SYS_io_uring_setup = 425,
+    SYS_io_uring_enter = 426,
 };
 
+#define NR_SYSCALLS 464 /* size of the dispatch table */
+
+#ifndef SYSCALL_STATS
+#define SYSCALL_STATS 1
+#endif
+#define SYSCALL_HIST_BUCKETS 16
+#define SYSCALL_HIST_SHIFT 6 /* bucket 0: < 128 cycles, then one power of two each */
+
+/* Per-syscall profile: bucket i counts calls of [2^(i+SHIFT), 2^(i+SHIFT+1))
+ * cycles, with bucket 0 and the last bucket open-ended. */
+typedef struct
+{
+    uint64_t count;
+    uint64_t total_cycles;
+    uint64_t hist[SYSCALL_HIST_BUCKETS];
+} syscall_stat_t;
+
+const char *syscall_name(long nr);
+int syscall_nargs(long nr);
+const syscall_stat_t *syscall_get_stats(long nr);
+
+/* clone() flags (Linux values) */
+#define CLONE_VM 0x00000100
+#define CLONE_FS 0x00000200
+#define CLONE_FILES 0x00000400
+#define CLONE_SIGHAND 0x00000800
+#define CLONE_THREAD 0x00010000
+#define CLONE_SYSVSEM 0x00040000
+#define CLONE_SETTLS 0x00080000
+#define CLONE_PARENT_SETTID 0x00100000
+#define CLONE_CHILD_CLEARTID 0x00200000
+#define CLONE_CHILD_SETTID 0x01000000
+
+#define ARCH_SET_GS 0x1001
+#define ARCH_SET_FS 0x1002
+#define ARCH_GET_FS 0x1003
+#define ARCH_GET_GS 0x1004
+
+/* iovec for readv/writev (Linux layout) */
+struct kernel_iovec
+{
+    void *iov_base;
+    unsigned long iov_len;
+};
+#define IOV_MAX 1024
+
+/* getdents64 record (Linux layout); d_reclen is rounded up to 8 */
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off; /* position of the next entry */
+    uint16_t d_reclen;
+    uint8_t d_type;
+    char d_name[];
+};
+
+#define DT_FIFO 1
+#define DT_CHR 2
+#define DT_DIR 4
+#define DT_REG 8
+
 long sys_read(int fd, void *buf, unsigned long count);
 long sys_write(int fd, const void *buf, unsigned long count);
+long sys_pread64(int fd, void *buf, unsigned long count, long off);
+long sys_pwrite64(int fd, const void *buf, unsigned long count, long off);
+long sys_readv(int fd, const struct kernel_iovec *iov, int iovcnt);
+long sys_writev(int fd, const struct kernel_iovec *iov, int iovcnt);
+long sys_copy_file_range(int fd_in, long *off_in, int fd_out, long *off_out, unsigned long len, unsigned flags);
+long sys_sendfile(int out_fd, int in_fd, long *offset, unsigned long count);
 long sys_open(const char *path, int flags, int mode);
 long sys_close(int fd);
 long sys_stat(const char *path, void *ubuf);
 long sys_fstat(int fd, void *ubuf);
+long sys_openat(int dirfd, const char *path, int flags, int mode);
+long sys_newfstatat(int dirfd, const char *path, void *ubuf, int flags);
+long sys_statx(int dirfd, const char *path, int flags, unsigned mask, void *ubuf);
 long sys_lseek(int fd, long off, int whence);
-long sys_pipe(int *pipefd);
+long sys_fsync(int fd);
+long sys_fdatasync(int fd);
+long sys_sync(void);
+long sys_getdents64(int fd, void *dirp, unsigned long count);
 long sys_dup(int oldfd);
 long sys_dup2(int oldfd, int newfd);
 long sys_fork(void);
 long sys_execve(const char *path, char *const argv[], char *const envp[]);
 long sys_exit(int code);
 long sys_brk(void *addr);
+long sys_clone(unsigned long flags, uint64_t newsp, int *ptid, int *ctid, uint64_t tls);
+long sys_exit_thread(int code);
+long sys_exit_group(int code);
+long sys_arch_prctl(int code, uint64_t addr);
+long sys_set_tid_address(int *tidptr);
+long sys_gettid(void);
+long sys_sched_yield(void);
+void thread_check_killed(void);
 long syscall_dispatch(long num, long a1, long a2, long a3, long a4, long a5, long a6);
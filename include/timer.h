@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+#include "ktime.h"
+
+extern volatile uint64_t ticks; /* from irq_timer.c */
+
+typedef struct ktimer
+{
+    struct ktimer *next;
+    struct ktimer **pprev; /* NULL while not queued */
+    uint64_t expires;      /* absolute tick */
+    void (*fn)(void *arg);
+    void *arg;
+} ktimer_t;
+
+void timer_init(void);
+void timer_setup(ktimer_t *t, void (*fn)(void *), void *arg);
+void timer_add(ktimer_t *t, uint64_t expires);
+int timer_mod(ktimer_t *t, uint64_t expires);
+int timer_del(ktimer_t *t);
+void timer_run(void);
+
+static inline int timer_pending(const ktimer_t *t) { return t->pprev != 0; }
+static inline uint64_t timer_ms_to_ticks(uint64_t ms) { return (ms * HZ + 999) / 1000; }
+
+int timer_wait_event(int (*cond)(void *), void *arg, uint32_t timeout_ms);
+int timer_sleep_ticks(uint64_t n);
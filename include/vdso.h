@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+#include "ktime.h"
+
+/* Fixed user addresses: the data page sits directly below the image so the
+ * vDSO code can reach it with a RIP-relative reference (see linker_vdso.ld). */
+#define VDSO_DATA_VADDR 0x7FFFFFF2000ULL
+#define VDSO_TEXT_VADDR (VDSO_DATA_VADDR + 0x1000ULL)
+#define VDSO_MAX_PAGES 2
+
+#define VDSO_TSC_SHIFT 24
+
+struct vdso_data {
+    volatile uint32_t seq;  /* odd while the timer tick is updating */
+    uint32_t hz;
+    uint64_t tick_ns;
+    uint64_t mono_ns;       /* CLOCK_MONOTONIC at the last tick */
+    uint64_t wall_base;     /* CLOCK_REALTIME seconds when mono_ns was 0 */
+    uint64_t tsc_last;      /* TSC sampled at the last tick */
+    uint64_t tsc_per_tick;  /* 0 until calibrated */
+    uint64_t tsc_mult;      /* ns = (tsc delta * mult) >> VDSO_TSC_SHIFT */
+};
+
+static inline uint64_t vdso_rdtsc(void)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Lock-free reader used by both the vDSO and the syscall fallback.
+ * Returns -1 for clocks that need the kernel. */
+static inline int vdso_read_clock(const volatile struct vdso_data *vd, int clk, struct kernel_timespec *ts)
+{
+    uint32_t seq;
+    uint64_t ns, wall;
+    int coarse = (clk == CLOCK_REALTIME_COARSE || clk == CLOCK_MONOTONIC_COARSE);
+    if (clk != CLOCK_REALTIME && clk != CLOCK_MONOTONIC && clk != CLOCK_MONOTONIC_RAW &&
+        clk != CLOCK_BOOTTIME && !coarse)
+        return -1;
+    do
+    {
+        seq = vd->seq;
+        __asm__ volatile("" ::: "memory");
+        if (seq & 1)
+            continue;
+        ns = vd->mono_ns;
+        wall = vd->wall_base;
+        if (!coarse && vd->tsc_mult)
+        {
+            uint64_t d = vdso_rdtsc() - vd->tsc_last;
+            ns += d >= vd->tsc_per_tick ? vd->tick_ns : (d * vd->tsc_mult) >> VDSO_TSC_SHIFT;
+        }
+        __asm__ volatile("" ::: "memory");
+    } while ((seq & 1) || seq != vd->seq);
+    ts->tv_sec = (int64_t)(ns / NSEC_PER_SEC);
+    ts->tv_nsec = (int64_t)(ns % NSEC_PER_SEC);
+    if (clk == CLOCK_REALTIME || clk == CLOCK_REALTIME_COARSE)
+        ts->tv_sec += (int64_t)wall;
+    return 0;
+}
+
+void vdso_init(void);
+uint64_t vdso_map(uint64_t pml4_phys);
+struct vdso_data *vdso_data(void);
@@ -14,6 +14,9 @@ section .bss
 align 16
 stack_bottom: resb 32768
 stack_top:
+global mb_magic, mb_info
+mb_magic: resd 1            ; loader's eax, for src/kernel/kernel64.c
+mb_info: resd 1             ; multiboot_info_t address from ebx
 
 section .text
 bits 32
@@ -21,6 +24,7 @@ global _start
 extern kernel_main64
 _start:
     mov esp, stack_top
+    mov edx, eax                ; the zeroing below clobbers eax
     ; zero .bss
     extern __bss_start
     extern __bss_end
@@ -30,6 +34,8 @@ _start:
     shr ecx, 2
     xor eax, eax
     rep stosd
+    mov [mb_magic], edx
+    mov [mb_info], ebx
     lgdt [gdt_descriptor]
     ; Enable PAE
     mov eax, cr4
@@ -54,9 +60,10 @@ gdt:
     dq 0
     dq 0x00AF9A000000FFFF ; kernel code
     dq 0x00AF92000000FFFF ; kernel data
-    ; User segments: same as kernel but DPL=3 (access bytes 0xFA code, 0xF2 data), base=0
-    dq 0x00AFFA000000FFFF ; user code (DPL=3)
+    ; User segments: same as kernel but DPL=3 (access bytes 0xFA code, 0xF2 data), base=0.
+    ; Data before code: SYSRET loads SS from STAR[63:48]+8 and CS from +16.
     dq 0x00AFF2000000FFFF ; user data (DPL=3)
+    dq 0x00AFFA000000FFFF ; user code (DPL=3)
     ; TSS descriptor uses two GDT entries (128-bit). We'll place an empty
     ; placeholder here; it will be filled with the address/limit below.
     dq 0
@@ -96,7 +103,7 @@ long_mode_entry:
     ; creation following the AMD64 spec precisely.
     ; -----------------------------------------------------------------
     lea rax, [tss]
-    mov qword [tss + 0], rsp        ; tss.rsp0 = current kernel stack
+    mov qword [tss + 4], rsp        ; tss.rsp0 (after the 4 reserved bytes) = current kernel stack
     ; Descriptor layout (64-bit TSS available type=0x9):
     ;  Byte 0-1: limit (size-1)
     ;  Byte 2-3: base 15:0
@@ -146,6 +153,8 @@ long_mode_entry:
     jmp .halt
 
 ; 64-bit Task State Segment for hardware stack switching on ring change.
+; The scheduler updates rsp0 on every switch to a thread with its own stack.
+global tss
 align 16
 tss:
     ; Struct layout: reserve 104 bytes (enough for rsp0..2 and ISTs and I/O map)
@@ -1,5 +1,54 @@
 #include "syscall.h"
-long syscall_thunk(long num, long a1, long a2, long a3, long a4, long a5, long a6)
+#include "sched.h"
+#include "percpu.h"
+#include "../kernel/kprint.h"
+
+#define MSR_EFER 0xC0000080
+#define MSR_STAR 0xC0000081
+#define MSR_LSTAR 0xC0000082
+#define MSR_FMASK 0xC0000084
+#define MSR_KERNEL_GS_BASE 0xC0000102
+#define EFER_SCE 0x1
+
+/* TF, DF, IF, IOPL, NT and AC are cleared on SYSCALL, so the entry runs with
+ * interrupts off exactly like the int 0x80 interrupt gate. */
+#define SYSCALL_FMASK 0x47700
+
+extern void syscall_entry64(void);
+
+percpu_t cpu0;
+
+static inline uint64_t rdmsr(uint32_t msr)
 {
-    return syscall_dispatch(num, a1, a2, a3, a4, a5, a6);
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t v)
+{
+    __asm__ volatile("wrmsr" : : "c"(msr), "a"((uint32_t)v), "d"((uint32_t)(v >> 32)));
+}
+
+/* Program the SYSCALL/SYSRET MSRs. STAR[47:32] selects the kernel CS (SS is
+ * +8); STAR[63:48] + 16 and + 8 give the user CS and SS on SYSRET. */
+void syscall_init(void)
+{
+    cpu0.self = &cpu0;
+    wrmsr(MSR_KERNEL_GS_BASE, (uint64_t)(uintptr_t)&cpu0);
+    wrmsr(MSR_STAR, ((uint64_t)(USER_DS - 3 - 8) << 48) | ((uint64_t)KERNEL_CS << 32));
+    wrmsr(MSR_LSTAR, (uint64_t)(uintptr_t)syscall_entry64);
+    wrmsr(MSR_FMASK, SYSCALL_FMASK);
+    wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_SCE);
+    kprintf("[syscall] SYSCALL/SYSRET enabled\n");
+}
+
+/* Called by int80_entry64 and syscall_entry64 with the saved user registers. */
+void syscall_thunk(trap_frame_t *tf)
+{
+    thread_t *t = thread_current();
+    t->tf = tf;
+    tf->rax = (uint64_t)syscall_dispatch((long)tf->rax, (long)tf->rdi, (long)tf->rsi, (long)tf->rdx, (long)tf->r10,
+                                         (long)tf->r8, (long)tf->r9);
+    thread_check_killed();
 }
@@ -1,66 +1,122 @@
 BITS 64
 SECTION .text
 global int80_entry64
+global trap_return
+global syscall_entry64
 extern syscall_thunk
 
+; percpu_t offsets (include/percpu.h)
+PERCPU_KERNEL_RSP equ 8
+PERCPU_USER_RSP   equ 16
+USER_DS           equ 0x1B
+USER_CS           equ 0x23
+
+; int 0x80 system call entry (Linux x86-64 register convention):
+;   RAX=num, RDI=a1, RSI=a2, RDX=a3, R10=a4, R8=a5, R9=a6; result in RAX.
+; The CPU has already switched to this thread's kernel stack (TSS.rsp0) and
+; pushed SS, RSP, RFLAGS, CS, RIP. We push the general registers to form a
+; trap_frame_t (include/sched.h) and hand its address to syscall_thunk,
+; which stores the result in the frame's RAX slot.
 int80_entry64:
-    push r15
-    push r14
-    push r13
+    push rax
+    push rbx
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push rbp
+    push r8
+    push r9
+    push r10
+    push r11
     push r12
+    push r13
+    push r14
+    push r15
+    mov rdi, rsp
+    call syscall_thunk
+
+; Restore a trap_frame_t at RSP and return to user mode. Also the first
+; return to user space of a clone() child (see trap_return below).
+int80_exit:
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rbp
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rbx
+    pop rax
+    iretq
+
+; SYSCALL entry, same register convention as int 0x80. The CPU left the
+; return RIP in RCX and RFLAGS in R11, masked IF through FMASK and did not
+; switch stacks. swapgs exposes the per-CPU block just long enough to swap
+; RSP to the thread's kernel stack; nothing else in the kernel uses GS, so
+; it is switched straight back. The frame built here has the same layout as
+; the int 0x80 one, so clone(), preemption and trap_return work unchanged.
+syscall_entry64:
+    swapgs
+    mov [gs:PERCPU_USER_RSP], rsp
+    mov rsp, [gs:PERCPU_KERNEL_RSP]
+    push qword USER_DS
+    push qword [gs:PERCPU_USER_RSP]
+    swapgs
     push r11
-    push r10
-    push r9
-    push r8
-    push rbp
-    push rdi
-    push rsi
-    push rdx
+    push qword USER_CS
     push rcx
-    push rbx
     push rax
-
-    ; Linux int80 uses: eax=num, ebx, ecx, edx, esi, edi, ebp for args historically.
-    ; We standardize on: RAX=num, RBX=a1, RCX=a2, RDX=a3, RSI=a4, RDI=a5, R8=a6 for int80 path to map easily.
-    ; But our userland not defined yet; we will mirror 32-bit order for simplicity.
-    ; Retrieve saved values from stack (top after pushes is original RAX at [rsp])
-    mov rax, [rsp]
-    mov rbx, [rsp+8*13] ; saved rbx position? Simpler: we already saved in order, rebuild manually
-    ; Instead of complex extraction, just use saved registers directly by reloading before call.
-    ; We'll assume arguments were placed like 32-bit: RAX=num, RBX=a1, RCX=a2, RDX=a3, RSI=a4, RDI=a5, R8=a6.
-
-    ; Push a6..a1 then num for syscall_thunk(num,a1..a6)
-    ; Switch to kernel page table before handling syscall
-    extern vm_get_kernel_cr3
-    mov rcx, [rel vm_get_kernel_cr3]
-    ; vm_get_kernel_cr3 is a function; call it to get kernel cr3 into rax
-    call vm_get_kernel_cr3
-    mov rcx, rax
-    mov cr3, rcx
-    push r8      ; a6
-    push rdi     ; a5
-    push rsi     ; a4
-    push rdx     ; a3
-    push rcx     ; a2
-    push rbx     ; a1
-    push rax     ; num
+    push rbx
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push rbp
+    push r8
+    push r9
+    push r10
+    push r11
+    push r12
+    push r13
+    push r14
+    push r15
+    mov rdi, rsp
     call syscall_thunk
-    add rsp, 7*8
 
-    ; Return value now in RAX. Restore registers (reverse order of pushes excluding original RAX which we popped logically)
-    pop rax
-    pop rbx
-    pop rcx
-    pop rdx
-    pop rsi
-    pop rdi
-    pop rbp
-    pop r8
-    pop r9
-    pop r10
-    pop r11
-    pop r12
-    pop r13
-    pop r14
+    ; SYSRET cannot return to a non-canonical RIP without faulting in ring 0;
+    ; take the iretq path for anything outside the lower half.
+    mov rcx, [rsp + 15*8]
+    shr rcx, 47
+    jnz int80_exit
     pop r15
-    iretq
+    pop r14
+    pop r13
+    pop r12
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rbp
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rbx
+    pop rax
+    mov rcx, [rsp]          ; RIP
+    mov r11, [rsp + 16]     ; RFLAGS
+    mov rsp, [rsp + 24]     ; user RSP
+    o64 sysret
+
+; void trap_return(trap_frame_t *tf): resume user mode from a frame built
+; on the current kernel stack. Does not return.
+trap_return:
+    mov rsp, rdi
+    jmp int80_exit
@@ -2,6 +2,7 @@
 #include "../drivers/keyboard.h"
 #include "../kernel/kprint.h"
 #include "keymap.h"
+#include "softirq.h"
 #include <stdint.h>
 
 static inline uint8_t inb(uint16_t port)
@@ -11,6 +12,11 @@ static inline uint8_t inb(uint16_t port)
     return r;
 }
 
+/* Raw scancodes captured by the IRQ; translated in the softirq. */
+#define KBD_RAW_SIZE 64
+static uint8_t raw_buf[KBD_RAW_SIZE];
+static volatile uint32_t raw_head = 0, raw_tail = 0;
+
 static void kbd_irq(void)
 {
     while (1)
@@ -19,10 +25,32 @@ static void kbd_irq(void)
         if (!(status & 1))
             break;
         uint8_t sc = inb(0x60);
+        if (raw_head - raw_tail < KBD_RAW_SIZE)
+            raw_buf[raw_head++ % KBD_RAW_SIZE] = sc;
+    }
+    softirq_raise(SOFTIRQ_KBD);
+}
+
+static void kbd_softirq(void)
+{
+    while (1)
+    {
+        uint64_t flags = irq_save();
+        if (raw_tail == raw_head)
+        {
+            irq_restore(flags);
+            break;
+        }
+        uint8_t sc = raw_buf[raw_tail++ % KBD_RAW_SIZE];
+        irq_restore(flags);
         keymap_process_scancode(sc);
     }
     extern void kbd_drain_to_tty(void);
     kbd_drain_to_tty();
 }
 
-void irq_kbd_install(void) { irq_install_handler(1, kbd_irq); }
+void irq_kbd_install(void)
+{
+    softirq_register(SOFTIRQ_KBD, kbd_softirq);
+    irq_install_handler(1, kbd_irq);
+}
@@ -37,6 +37,7 @@ irq_stub_common:
     push r10
     push r11
     mov rdi, [rsp + 11*8] ; irq number (after pushes)
+    lea rsi, [rsp + 12*8] ; CPU interrupt frame (rip, cs, rflags, rsp, ss)
     call irq_common_dispatch
     pop r11
     pop r10
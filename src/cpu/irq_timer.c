@@ -1,8 +1,32 @@
 #include "irq.h"
+#include "ktime.h"
+#include "timer.h"
+#include "softirq.h"
+#include "sched.h"
 #include "../kernel/kprint.h"
 #include <stdint.h>
 
+#define PIT_BASE_HZ 1193182
+
+static inline void outb(uint16_t port, uint8_t val) { __asm__ __volatile__("outb %0,%1" ::"a"(val), "Nd"(port)); }
+
 volatile uint64_t ticks = 0;
-static void timer_irq(void) { ticks++; }
+static void timer_irq(void)
+{
+    ticks++;
+    ktime_tick();
+    sched_tick();
+    softirq_raise(SOFTIRQ_TIMER);
+}
 
-void irq_timer_install(void) { irq_install_handler(0, timer_irq); }
+void irq_timer_install(void)
+{
+    uint16_t div = (uint16_t)(PIT_BASE_HZ / HZ);
+    outb(0x43, 0x36); /* channel 0, lo/hi, mode 3 */
+    outb(0x40, (uint8_t)(div & 0xFF));
+    outb(0x40, (uint8_t)(div >> 8));
+    ktime_init();
+    timer_init();
+    softirq_register(SOFTIRQ_TIMER, timer_run);
+    irq_install_handler(0, timer_irq);
+}
@@ -1,109 +1,479 @@
 #include "proc.h"
+#include "sched.h"
+#include "irq.h"
+#include "pmm.h"
+#include "vm.h"
+#include "syscall.h"
+#include "io_uring.h"
+#include "strace.h"
+#include "pipe.h"
+#include "poll.h"
+#include "kerrno.h"
+#include "kfcntl.h"
 #include "../kernel/kprint.h"
+#include "../kernel/string.h"
 
-static process_t init_proc;
-static process_t *current = 0;
-static int next_pid = 1;
+/* Process table. Slots are static; live processes are chained into a pid
+ * hash so lookups do not scan the table, and pids come from a bitmap that
+ * hands out numbers in increasing order before wrapping, like Unix. A child
+ * that exits stays a zombie, holding its exit code and memory, until its
+ * parent collects it with wait4. */
 
-process_t *proc_current(void) { return current; }
+static process_t procs[PROC_MAX];
+static process_t *pid_hash[PID_HASH_SIZE];
+static uint64_t pid_map[PID_MAX / 64];
+static int last_pid = 0;
+static process_t *init_proc = 0;
 
-void proc_init(void)
+/* Open file descriptions come from a fixed pool with a free stack. */
+static file_t files[FILE_MAX];
+static file_t *file_free[FILE_MAX];
+static int file_nfree = 0;
+
+static inline process_t **pid_bucket(int pid) { return &pid_hash[pid & (PID_HASH_SIZE - 1)]; }
+
+static int pid_alloc(void)
 {
-    for (int i = 0; i < PROC_FD_MAX; i++)
+    int pid = last_pid;
+    for (int n = 0; n < PID_MAX; n++)
+    {
+        if (++pid >= PID_MAX)
+            pid = 1;
+        uint64_t bit = 1ULL << (pid & 63);
+        if (pid_map[pid >> 6] == ~0ULL)
+        {
+            /* skip the rest of a full word */
+            n += 63 - (pid & 63);
+            pid |= 63;
+            continue;
+        }
+        if (!(pid_map[pid >> 6] & bit))
+        {
+            pid_map[pid >> 6] |= bit;
+            last_pid = pid;
+            return pid;
+        }
+    }
+    return -1;
+}
+
+static void pid_free(int pid) { pid_map[pid >> 6] &= ~(1ULL << (pid & 63)); }
+
+/* Threads carry their process; kernel threads run on behalf of init. */
+process_t *proc_current(void)
+{
+    thread_t *t = thread_current();
+    if (t && t->proc)
+        return t->proc;
+    return init_proc;
+}
+
+process_t *proc_lookup(int pid)
+{
+    if (pid <= 0 || pid >= PID_MAX)
+        return 0;
+    for (process_t *p = *pid_bucket(pid); p; p = p->hash_next)
+        if (p->pid == pid)
+            return p;
+    return 0;
+}
+
+process_t *proc_slot(int i)
+{
+    if (i < 0 || i >= PROC_MAX || procs[i].state == PROC_UNUSED)
+        return 0;
+    return &procs[i];
+}
+
+/* New process with a copy of the parent's fd table and no address space yet. */
+process_t *proc_alloc(process_t *parent, const char *name)
+{
+    uint64_t flags = irq_save();
+    process_t *p = 0;
+    for (int i = 0; i < PROC_MAX; i++)
+    {
+        if (procs[i].state == PROC_UNUSED)
+        {
+            p = &procs[i];
+            break;
+        }
+    }
+    int pid = p ? pid_alloc() : -1;
+    if (pid < 0)
+    {
+        irq_restore(flags);
+        return 0;
+    }
+    kmemset(p, 0, sizeof(*p));
+    p->pid = pid;
+    p->fds = p->fd_inline;
+    p->fd_cap = FD_INLINE;
+    p->state = PROC_RUNNING;
+    if (name)
+        kstrncpy(p->name, name, PROC_NAME_MAX - 1);
+    if (parent)
     {
-        init_proc.fds[i].used = 0;
-        init_proc.fds[i].node = 0;
-        init_proc.fds[i].ofs = 0;
-        init_proc.fds[i].flags = 0;
+        /* the child shares the parent's open files, offsets included */
+        for (int fd = 0; fd < parent->fd_cap; fd++)
+        {
+            if (parent->fd_bitmap[fd / 64] & (1ULL << (fd % 64)))
+            {
+                file_get(parent->fds[fd]);
+                proc_install_fd(p, fd, parent->fds[fd]);
+            }
+        }
+        p->parent = parent;
+        p->sibling = parent->children;
+        parent->children = p;
     }
-    init_proc.pid = next_pid++;
-    init_proc.parent = 0;
-    init_proc.state = 0;
-    current = &init_proc;
-    init_proc.pml4_phys = 0;
-    init_proc.alloc_count = 0;
-    for (int i = 0; i < PROC_MAX_PAGES; i++)
-        init_proc.alloc_pages[i] = 0;
-    init_proc.kernel_saved_rsp = 0;
-    init_proc.kernel_saved_rip = 0;
-    init_proc.brk_start = 0;
-    init_proc.brk_curr = 0;
-    init_proc.image_hi = 0;
+    process_t **b = pid_bucket(pid);
+    p->hash_next = *b;
+    *b = p;
+    irq_restore(flags);
+    return p;
+}
+
+void proc_init(void)
+{
+    for (int i = 0; i < PROC_MAX; i++)
+        procs[i].state = PROC_UNUSED;
+    for (int i = 0; i < FILE_MAX; i++)
+        file_free[file_nfree++] = &files[FILE_MAX - 1 - i];
+    init_proc = proc_alloc(0, "init");
+    /* console stdio until something better is installed */
     for (int i = 0; i < 3; i++)
-        current->fds[i].used = 1;
-    kprintf("[proc] init pid=%d created\n", init_proc.pid);
+        proc_install_fd(init_proc, i, file_alloc(0, O_RDWR));
+    if (thread_current())
+        thread_current()->proc = init_proc;
+    kprintf("[proc] init pid=%d created\n", init_proc->pid);
+}
+
+/* Turn p into a zombie: its children go to init (zombies among them are
+ * released right away, since nobody is left to wait for them) and a parent
+ * blocked in wait4 is woken. Called once p's other threads are gone. */
+void proc_exit(process_t *p, int code)
+{
+    uint64_t flags = irq_save();
+    p->exit_code = code;
+    p->state = PROC_ZOMBIE;
+    strace_detach(p);
+    /* close now so pipe peers see EOF/EPIPE before the reap */
+    for (int fd = 0; fd < p->fd_cap; fd++)
+        proc_close_fd(p, fd);
+    if (p->fds != p->fd_inline)
+        pmm_free_page(p->fds);
+    p->fds = p->fd_inline;
+    p->fd_cap = FD_INLINE;
+    process_t *c = p->children;
+    p->children = 0;
+    while (c)
+    {
+        process_t *next = c->sibling;
+        if (c->state == PROC_ZOMBIE)
+        {
+            c->parent = 0;
+            proc_release(c);
+        }
+        else
+        {
+            c->parent = init_proc;
+            c->sibling = init_proc->children;
+            init_proc->children = c;
+        }
+        c = next;
+    }
+    if (p->parent)
+        waitq_wake_all(&p->parent->child_wait);
+    irq_restore(flags);
+}
+
+/* Free everything a zombie still holds and return its slot and pid. */
+void proc_release(process_t *p)
+{
+    uint64_t flags = irq_save();
+    io_uring_release(p);
+    for (int i = 0; i < p->alloc_count; i++)
+        pmm_free_page((void *)p->alloc_pages[i]);
+    p->alloc_count = 0;
+    p->pml4_phys = 0;
+    if (p->parent)
+    {
+        process_t **pp = &p->parent->children;
+        while (*pp && *pp != p)
+            pp = &(*pp)->sibling;
+        if (*pp)
+            *pp = p->sibling;
+    }
+    process_t **b = pid_bucket(p->pid);
+    while (*b && *b != p)
+        b = &(*b)->hash_next;
+    if (*b)
+        *b = p->hash_next;
+    pid_free(p->pid);
+    p->state = PROC_UNUSED;
+    irq_restore(flags);
+}
+
+static void spawn_entry(void *arg)
+{
+    process_t *p = (process_t *)arg;
+    sys_execve(p->exec_path, p->exec_argv, p->exec_envp);
+    /* only reached when the image could not be loaded */
+    sys_exit(127);
+}
+
+/* Start path in a new child of the current process on its own kernel
+ * thread. argv/envp are read when the child execs, so they must stay valid
+ * until the caller has waited for it. Returns the child's pid. */
+long proc_spawn(const char *path, char *const argv[], char *const envp[])
+{
+    process_t *parent = proc_current();
+    const char *base = path;
+    for (const char *s = path; *s; s++)
+        if (*s == '/')
+            base = s + 1;
+    process_t *p = proc_alloc(parent, base);
+    if (!p)
+        return -1;
+    kstrncpy(p->exec_path, path, sizeof(p->exec_path) - 1);
+    p->exec_argv = argv;
+    p->exec_envp = envp;
+    thread_t *t = kthread_create(spawn_entry, p, p->name);
+    if (!t)
+    {
+        p->state = PROC_ZOMBIE;
+        proc_release(p);
+        return -1;
+    }
+    t->proc = p;
+    return p->pid;
+}
+
+/* wait4(pid|-1, status, WNOHANG?, rusage): reap one zombie child. rusage
+ * is not filled in. Any number of the process's threads may wait at once;
+ * each child's exit wakes them all to look again. Returns -ECHILD when
+ * there is no such child, -EINTR if the caller is killed while waiting. */
+long sys_wait4(int pid, int *status, int options, void *rusage)
+{
+    (void)rusage;
+    process_t *self = proc_current();
+    if (!self)
+        return -ECHILD;
+    uint64_t flags = irq_save();
+    for (;;)
+    {
+        int have = 0;
+        for (process_t *c = self->children; c; c = c->sibling)
+        {
+            if (pid > 0 && c->pid != pid)
+                continue;
+            have = 1;
+            if (c->state != PROC_ZOMBIE)
+                continue;
+            int cpid = c->pid;
+            if (status)
+                *status = (c->exit_code & 0xff) << 8;
+            proc_release(c);
+            irq_restore(flags);
+            return cpid;
+        }
+        if (!have || (options & WNOHANG) || thread_current()->killed)
+        {
+            irq_restore(flags);
+            return !have ? -ECHILD : (options & WNOHANG) ? 0 : -EINTR;
+        }
+        waitq_sleep(&self->child_wait);
+    }
+}
+
+long sys_getpid(void)
+{
+    process_t *p = proc_current();
+    return p ? p->pid : -1;
+}
+
+long sys_getppid(void)
+{
+    process_t *p = proc_current();
+    return (p && p->parent) ? p->parent->pid : 0;
 }
 
 int proc_set_pml4(uint64_t phys)
 {
-    if (!current)
+    process_t *cur = proc_current();
+    if (!cur)
         return -1;
-    current->pml4_phys = phys;
+    cur->pml4_phys = phys;
     return 0;
 }
 
 uint64_t proc_get_pml4(void)
 {
-    if (!current)
+    process_t *cur = proc_current();
+    if (!cur)
         return 0;
-    return current->pml4_phys;
+    return cur->pml4_phys;
 }
 
 int proc_add_allocated_page(uint64_t phys)
 {
-    if (!current)
+    process_t *cur = proc_current();
+    if (!cur)
         return -1;
-    if (current->alloc_count >= PROC_MAX_PAGES)
+    if (cur->alloc_count >= PROC_MAX_PAGES)
         return -1;
-    current->alloc_pages[current->alloc_count++] = phys;
+    cur->alloc_pages[cur->alloc_count++] = phys;
     return 0;
 }
 
 void proc_free_allocated_pages(void)
 {
-    if (!current)
+    process_t *cur = proc_current();
+    if (!cur)
         return;
-    current->alloc_count = 0;
+    cur->alloc_count = 0;
 }
 
-int proc_alloc_fd(node_t *n)
+file_t *file_alloc(node_t *n, int flags)
 {
-    if (!current)
-        return -1;
-    for (int i = 3; i < PROC_FD_MAX; i++)
+    uint64_t irq = irq_save();
+    file_t *f = file_nfree ? file_free[--file_nfree] : 0;
+    irq_restore(irq);
+    if (!f)
+        return 0;
+    f->refs = 1;
+    f->node = n;
+    if (n && n->type != NODE_PIPE && n->type != NODE_EPOLL)
+        fs_node_get(n);
+    f->ofs = 0;
+    f->flags = flags;
+    f->dir_pos = 0;
+    kmemset(&f->ra, 0, sizeof(f->ra));
+    return f;
+}
+
+void file_get(file_t *f) { f->refs++; }
+
+/* Drop a reference. The last one releases the pipe end, epoll instance or
+ * fs node behind the file. */
+void file_put(file_t *f)
+{
+    if (--f->refs > 0)
+        return;
+    node_t *n = f->node;
+    if (n && n->type == NODE_PIPE)
+        pipe_unref(n, f->flags);
+    else if (n && n->type == NODE_EPOLL)
+        epoll_unref(n);
+    else if (n)
+        fs_node_put(n);
+    else if (f->flags & FD_IORING)
+        io_uring_close(f);
+    f->node = 0;
+    uint64_t irq = irq_save();
+    file_free[file_nfree++] = f;
+    irq_restore(irq);
+}
+
+/* fd tables: the first FD_INLINE slots live in the process; the first fd
+ * past them moves the table to a page holding PROC_FD_MAX pointers. A
+ * bitmap of open fds gives the lowest free one with a few word scans. */
+
+static int fd_reserve(process_t *p, int fd)
+{
+    if (fd < p->fd_cap)
+        return 0;
+    if (fd >= PROC_FD_MAX)
+        return -EMFILE;
+    file_t **t = (file_t **)pmm_alloc_page();
+    if (!t)
+        return -ENOMEM;
+    kmemset(t, 0, PROC_FD_MAX * sizeof(file_t *));
+    kmemcpy(t, p->fds, (size_t)p->fd_cap * sizeof(file_t *));
+    p->fds = t;
+    p->fd_cap = PROC_FD_MAX;
+    return 0;
+}
+
+static inline int fd_is_open(process_t *p, int fd)
+{
+    return fd >= 0 && fd < p->fd_cap && (p->fd_bitmap[fd / 64] & (1ULL << (fd % 64)));
+}
+
+static int fd_lowest_free(process_t *p)
+{
+    for (int w = 0; w < PROC_FD_MAX / 64; w++)
+        if (~p->fd_bitmap[w])
+            return w * 64 + __builtin_ctzll(~p->fd_bitmap[w]);
+    return -EMFILE;
+}
+
+/* Install f at fd, or at the lowest free fd when fd < 0, closing whatever
+ * fd named before. Takes over the caller's reference to f, dropping it on
+ * failure. Returns the fd or a negative errno. */
+int proc_install_fd(process_t *p, int fd, file_t *f)
+{
+    if (!f)
+        return -ENFILE;
+    if (!p)
     {
-        if (!current->fds[i].used)
-        {
-            current->fds[i].used = 1;
-            current->fds[i].node = n;
-            current->fds[i].ofs = 0;
-            current->fds[i].flags = 0;
-            return i;
-        }
+        file_put(f);
+        return -EBADF;
     }
-    return -1;
+    if (fd < 0)
+        fd = fd_lowest_free(p);
+    int r = fd < 0 ? fd : fd_reserve(p, fd);
+    if (r < 0)
+    {
+        file_put(f);
+        return r;
+    }
+    file_t *old = fd_is_open(p, fd) ? p->fds[fd] : 0;
+    p->fds[fd] = f;
+    p->fd_bitmap[fd / 64] |= 1ULL << (fd % 64);
+    if (old)
+        file_put(old);
+    return fd;
 }
 
-fd_entry_t *proc_get_fd(int fd)
+int proc_close_fd(process_t *p, int fd)
 {
-    if (!current || fd < 0 || fd >= PROC_FD_MAX)
-        return 0;
-    if (!current->fds[fd].used)
+    if (!p || !fd_is_open(p, fd))
+        return -EBADF;
+    file_t *f = p->fds[fd];
+    p->fds[fd] = 0;
+    p->fd_bitmap[fd / 64] &= ~(1ULL << (fd % 64));
+    file_put(f);
+    return 0;
+}
+
+/* New open file for n at the lowest free fd. */
+int proc_alloc_fd(node_t *n)
+{
+    return proc_install_fd(proc_current(), -1, file_alloc(n, 0));
+}
+
+file_t *proc_get_fd(int fd)
+{
+    process_t *cur = proc_current();
+    if (!cur || !fd_is_open(cur, fd))
         return 0;
-    return &current->fds[fd];
+    return cur->fds[fd];
 }
 
 uint64_t proc_get_brk(void)
 {
-    if (!current)
+    process_t *cur = proc_current();
+    if (!cur)
         return 0;
-    return current->brk_curr;
+    return cur->brk_curr;
 }
 
 int proc_set_brk(uint64_t newbrk)
 {
-    if (!current)
+    process_t *cur = proc_current();
+    if (!cur)
         return -1;
-    current->brk_curr = newbrk;
+    cur->brk_curr = newbrk;
     return 0;
 }
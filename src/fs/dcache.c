@@ -0,0 +1,181 @@
+#include "fs.h"
+#include "../kernel/string.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/* Name lookup for both backends.
+ *
+ * Directory index: every node linked into a directory sits in one hash
+ * table keyed by (parent, name) and chained through node->hnext, so
+ * finding a child costs the same in a directory of ten entries or ten
+ * thousand. The index is complete: a miss there is a definite ENOENT.
+ *
+ * Path cache: recent fs_lookup results keyed by (start node, path),
+ * misses included, so a repeated lookup (a PATH search for a command,
+ * say) skips the walk entirely. A change to the namespace retires only
+ * the entries it can affect, each checked in O(1) when next looked up:
+ *  - a node leaving the index (unlink, rename) gets a new dgen, which
+ *    retires the entries that end at it or start from it, and the misses
+ *    recorded in it;
+ *  - a name entering the index bumps the miss generation of its
+ *    (directory, name) slot, which retires the misses on that name;
+ *  - renaming a directory that has entries, or mounting a volume, moves
+ *    whole subtrees, and retires everything.
+ * Paths with ".." are not cached: they rely on nodes no entry records. */
+
+#define DINDEX_BITS 14
+#define DCACHE_SLOTS 256 /* direct-mapped */
+#define DCACHE_PATH 64   /* longer paths are not cached */
+
+typedef struct
+{
+    node_t *base;
+    node_t *node;      /* 0: negative entry */
+    node_t *last;      /* node, or the directory a negative entry missed in */
+    uint32_t gen;
+    uint32_t base_gen; /* base->dgen and last->dgen when cached */
+    uint32_t last_gen;
+    uint32_t miss_slot; /* negative entry: its miss_gen slot and value */
+    uint32_t miss_gen;
+    uint32_t hash;
+    char path[DCACHE_PATH];
+} dcache_ent_t;
+
+static node_t *dindex[1u << DINDEX_BITS];
+static dcache_ent_t dcache[DCACHE_SLOTS];
+static uint32_t miss_gen[DCACHE_SLOTS]; /* per (directory, name) hash */
+static uint32_t dcache_gen = 1;
+static uint32_t next_gen = 1; /* dgen and miss_gen values, never reused */
+
+/* FNV-1a over the name, seeded with the directory */
+static uint32_t name_hash(const node_t *dir, const char *name, size_t len)
+{
+    uint32_t h = 2166136261u ^ (uint32_t)((uintptr_t)dir >> 4);
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    return h;
+}
+
+static node_t **bucket(const node_t *dir, const char *name, size_t len)
+{
+    return &dindex[name_hash(dir, name, len) & ((1u << DINDEX_BITS) - 1)];
+}
+
+/* Child of dir called name[0..len), which need not be NUL-terminated. */
+node_t *dindex_find(node_t *dir, const char *name, size_t len)
+{
+    if (len >= sizeof(dir->name))
+        return 0;
+    for (node_t *n = *bucket(dir, name, len); n; n = n->hnext)
+        if (n->parent == dir && kstrncmp(n->name, name, len) == 0 && n->name[len] == '\0')
+            return n;
+    return 0;
+}
+
+/* A value for dgen or miss_gen that no cached entry holds. */
+static uint32_t gen_next(void)
+{
+    if (++next_gen == 0)
+    {
+        dcache_invalidate(); /* wrapped: old values come round again */
+        next_gen = 1;
+    }
+    return next_gen;
+}
+
+/* Index n under its current parent and name. Cached misses on that name
+ * in that directory are retired. */
+void dindex_add(node_t *n)
+{
+    size_t len = kstrlen(n->name);
+    uint32_t h = name_hash(n->parent, n->name, len);
+    node_t **b = &dindex[h & ((1u << DINDEX_BITS) - 1)];
+    n->hnext = *b;
+    *b = n;
+    miss_gen[h % DCACHE_SLOTS] = gen_next();
+}
+
+/* Remove n; call before changing its parent or name. */
+void dindex_del(node_t *n)
+{
+    for (node_t **pp = bucket(n->parent, n->name, kstrlen(n->name)); *pp; pp = &(*pp)->hnext)
+    {
+        if (*pp == n)
+        {
+            *pp = n->hnext;
+            break;
+        }
+    }
+    n->hnext = 0;
+    if (n->child)
+        dcache_invalidate(); /* a directory with entries: paths run through it */
+    dcache_retire(n);
+}
+
+/* Retire cached paths that end at n, start from it or missed in it; a
+ * newly allocated node gets a fresh value too, so nothing cached about a
+ * node once at the same address matches it. */
+void dcache_retire(node_t *n)
+{
+    n->dgen = gen_next();
+}
+
+/* Returns 1 and sets *out (0 for a cached miss) if (base, path) is cached. */
+int dcache_get(node_t *base, const char *path, node_t **out)
+{
+    size_t len = kstrlen(path);
+    if (len >= DCACHE_PATH)
+        return 0;
+    uint32_t h = name_hash(base, path, len);
+    dcache_ent_t *e = &dcache[h % DCACHE_SLOTS];
+    if (e->gen != dcache_gen || e->base != base || e->hash != h || kstrcmp(e->path, path) != 0)
+        return 0;
+    if (e->base_gen != base->dgen || e->last_gen != e->last->dgen)
+        return 0;
+    if (!e->node && e->miss_gen != miss_gen[e->miss_slot])
+        return 0;
+    *out = e->node;
+    return 1;
+}
+
+static int has_dotdot(const char *path)
+{
+    for (const char *s = path; *s; s++)
+        if (s[0] == '.' && s[1] == '.' && (s == path || s[-1] == '/') && (!s[2] || s[2] == '/'))
+            return 1;
+    return 0;
+}
+
+/* Cache the result of walking path from base: n, or 0 with miss saying
+ * where the walk stopped. */
+void dcache_put(node_t *base, const char *path, node_t *n, const dcache_miss_t *miss)
+{
+    size_t len = kstrlen(path);
+    if (len >= DCACHE_PATH || (!n && !miss->dir) || has_dotdot(path))
+        return;
+    uint32_t h = name_hash(base, path, len);
+    dcache_ent_t *e = &dcache[h % DCACHE_SLOTS];
+    e->base = base;
+    e->node = n;
+    e->last = n ? n : miss->dir;
+    e->gen = dcache_gen;
+    e->base_gen = base->dgen;
+    e->last_gen = e->last->dgen;
+    if (!n)
+    {
+        e->miss_slot = name_hash(miss->dir, miss->name, miss->len) % DCACHE_SLOTS;
+        e->miss_gen = miss_gen[e->miss_slot];
+    }
+    e->hash = h;
+    kmemcpy(e->path, path, len + 1);
+}
+
+void dcache_invalidate(void)
+{
+    if (++dcache_gen == 0)
+    {
+        /* wrapped: old entries could look current again */
+        kmemset(dcache, 0, sizeof(dcache));
+        dcache_gen = 1;
+    }
+}
@@ -0,0 +1,14 @@
+#include "fs.h"
+
+/* devfs: character devices (node->data points at the driver's object) and
+ * directories to group them. Regular files have no place here. */
+
+static int devfs_create(node_t *dir, node_t *n)
+{
+    (void)dir;
+    return n->type == NODE_CHAR || n->type == NODE_DIR ? 0 : -1;
+}
+
+static const fs_inode_ops_t devfs_iops = {0, devfs_create, 0, 0};
+
+const fs_type_t devfs_type = {"devfs", 0, 0, &devfs_iops, 0};
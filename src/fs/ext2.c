@@ -0,0 +1,1111 @@
+#include "ext2.h"
+#include "../kernel/kprint.h"
+#include "../kernel/string.h"
+#include "bcache.h"
+#include "sched.h"
+#include "ktime.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/* ext2 revision 0 and 1 volumes on the primary ATA disk: 1, 2 and 4 KiB
+ * blocks, direct and single/double/triple indirect block maps, and the
+ * "filetype" directory format. The volume is found through an MBR Linux
+ * partition or else at 1 MiB, which keeps it clear of the boot sector and
+ * the env sector (src/kernel/env.c).
+ *
+ * Every change goes to the block cache (src/kernel/bcache.c), which
+ * writes it back later: data, then the maps and directory blocks that
+ * reach it, then the inode, with bitmaps, group
+ * descriptors and superblock counts updated as blocks and inodes are
+ * taken or given back. Hashed (dir_index) directories are read as plain
+ * ones and lose their index flag on the first change, as the format
+ * allows. */
+
+#define EXT2_MAGIC 0xEF53
+#define EXT2_PART_LBA 2048   /* no MBR partition: assume 1 MiB in */
+#define EXT2_MBR_TYPE 0x83
+#define EXT2_MAX_BLOCK 4096
+#define EXT2_GDT_MAX 8192    /* 256 groups */
+#define EXT2_RUN_MAX 16      /* blocks per ext2_read_blocks transfer */
+#define EXT2_NDIR 12
+#define EXT2_IND 12
+#define EXT2_DIND 13
+#define EXT2_TIND 14
+#define EXT2_INDEX_FL 0x1000 /* hashed directory */
+#define EXT2_S_IFMT 0170000
+#define EXT2_S_IFDIR 0040000
+#define EXT2_S_IFREG 0100000
+
+#define EXT2_INCOMPAT_FILETYPE 0x0002
+#define EXT2_RO_COMPAT_SPARSE_SUPER 0x0001
+#define EXT2_RO_COMPAT_LARGE_FILE 0x0002
+
+typedef struct
+{
+    uint32_t inodes_count;
+    uint32_t blocks_count;
+    uint32_t r_blocks_count;
+    uint32_t free_blocks_count;
+    uint32_t free_inodes_count;
+    uint32_t first_data_block;
+    uint32_t log_block_size;
+    uint32_t log_frag_size;
+    uint32_t blocks_per_group;
+    uint32_t frags_per_group;
+    uint32_t inodes_per_group;
+    uint32_t mtime, wtime;
+    uint16_t mnt_count, max_mnt_count;
+    uint16_t magic, state, errors, minor_rev_level;
+    uint32_t lastcheck, checkinterval, creator_os, rev_level;
+    uint16_t def_resuid, def_resgid;
+    /* revision 1 */
+    uint32_t first_ino;
+    uint16_t inode_size, block_group_nr;
+    uint32_t feature_compat, feature_incompat, feature_ro_compat;
+} ext2_super_t;
+
+typedef struct
+{
+    uint32_t block_bitmap;
+    uint32_t inode_bitmap;
+    uint32_t inode_table;
+    uint16_t free_blocks_count;
+    uint16_t free_inodes_count;
+    uint16_t used_dirs_count;
+    uint16_t pad;
+    uint32_t reserved[3];
+} ext2_gd_t;
+
+typedef struct
+{
+    uint16_t mode, uid;
+    uint32_t size;
+    uint32_t atime, ctime, mtime, dtime;
+    uint16_t gid, links_count;
+    uint32_t blocks; /* 512-byte units, map blocks included */
+    uint32_t flags;
+    uint32_t osd1;
+    uint32_t block[15];
+    uint32_t generation, file_acl;
+    uint32_t size_high; /* dir_acl for directories */
+    uint32_t faddr;
+    uint8_t osd2[12];
+} ext2_inode_t;
+
+typedef struct
+{
+    uint32_t inode;
+    uint16_t rec_len;
+    uint8_t name_len;
+    uint8_t file_type;
+    char name[];
+} ext2_dirent_t;
+
+static union
+{
+    ext2_super_t s;
+    uint8_t raw[1024];
+} super;
+#define sb (&super.s)
+
+static union
+{
+    ext2_gd_t g[EXT2_GDT_MAX / sizeof(ext2_gd_t)];
+    uint8_t raw[EXT2_GDT_MAX];
+} gdt;
+#define gd (gdt.g)
+
+static uint32_t part_lba;      /* first sector of the volume */
+static uint32_t bsize, spb;    /* block size, sectors per block */
+static uint32_t ptrs;          /* block numbers per map block */
+static uint32_t ngroups, inode_size, first_ino;
+static int has_ftype;
+
+/* Block buffers, one per use so the operations below can nest. They and
+ * the bitmaps are held across disk waits, which run other threads, so
+ * every exported call takes vol_lock (see the end of the file). */
+static kmutex_t vol_lock;
+static uint8_t dbuf[EXT2_MAX_BLOCK] __attribute__((aligned(8)));   /* file data */
+static uint8_t dirbuf[EXT2_MAX_BLOCK] __attribute__((aligned(8))); /* directory blocks */
+static uint8_t ibuf[EXT2_MAX_BLOCK] __attribute__((aligned(8)));   /* bmap walk */
+static uint8_t tbuf[EXT2_MAX_BLOCK] __attribute__((aligned(8)));   /* inode table */
+static uint8_t mbuf[EXT2_MAX_BLOCK] __attribute__((aligned(8)));   /* bitmaps */
+static uint8_t lvlbuf[3][EXT2_MAX_BLOCK] __attribute__((aligned(8))); /* truncate, per map level */
+static const uint8_t zeros[EXT2_MAX_BLOCK];
+
+/* All disk traffic goes through the buffer cache, one buffer per block;
+ * writes land there and reach the disk on write-back or sync. */
+static int disk_read(uint32_t lba, uint32_t len, void *buf)
+{
+    buf_t *b = bread(BDEV_ATA, lba, len);
+    if (!b)
+        return -1;
+    kmemcpy(buf, b->data, len);
+    brelse(b);
+    return 0;
+}
+
+static int disk_write(uint32_t lba, uint32_t len, const void *buf)
+{
+    buf_t *b = bget(BDEV_ATA, lba, len);
+    if (!b)
+        return -1;
+    kmemcpy(b->data, buf, len);
+    bdirty(b);
+    brelse(b);
+    return 0;
+}
+
+static int blk_read(uint32_t b, void *buf)
+{
+    return disk_read(part_lba + b * spb, bsize, buf);
+}
+
+static int blk_write(uint32_t b, const void *buf)
+{
+    return disk_write(part_lba + b * spb, bsize, buf);
+}
+
+static uint32_t now(void)
+{
+    return (uint32_t)sys_time(0);
+}
+
+/* The superblock lives at byte 1024 whatever the block size; with 1 KiB
+ * blocks that is block 1, the same cache buffer blk_read would use. */
+static void super_write(void)
+{
+    disk_write(part_lba + 2, sizeof(super.raw), super.raw);
+}
+
+static void gd_write(uint32_t g)
+{
+    uint32_t i = g * sizeof(ext2_gd_t) / bsize;
+    blk_write(sb->first_data_block + 1 + i, gdt.raw + i * bsize);
+}
+
+static int mount_volume(void)
+{
+    part_lba = EXT2_PART_LBA;
+    if (disk_read(0, 512, dbuf) == 0 && dbuf[510] == 0x55 && dbuf[511] == 0xAA)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            const uint8_t *pe = dbuf + 446 + 16 * i;
+            if (pe[4] == EXT2_MBR_TYPE)
+            {
+                part_lba = pe[8] | pe[9] << 8 | pe[10] << 16 | (uint32_t)pe[11] << 24;
+                break;
+            }
+        }
+    }
+    if (disk_read(part_lba + 2, sizeof(super.raw), super.raw) != 0)
+        return -1;
+    if (sb->magic != EXT2_MAGIC)
+    {
+        kprintf("[ext2] no filesystem at lba %u\n", part_lba);
+        return -1;
+    }
+    if (sb->log_block_size > 2 || !sb->blocks_per_group || !sb->inodes_per_group)
+        return -1;
+    bsize = 1024u << sb->log_block_size;
+    spb = bsize / 512;
+    ptrs = bsize / 4;
+    inode_size = 128;
+    first_ino = 11;
+    if (sb->rev_level > 0)
+    {
+        inode_size = sb->inode_size;
+        first_ino = sb->first_ino;
+        uint32_t ro = EXT2_RO_COMPAT_SPARSE_SUPER | EXT2_RO_COMPAT_LARGE_FILE;
+        if ((sb->feature_incompat & ~EXT2_INCOMPAT_FILETYPE) || (sb->feature_ro_compat & ~ro))
+        {
+            kprintf("[ext2] unsupported features incompat=%x ro_compat=%x\n", sb->feature_incompat,
+                    sb->feature_ro_compat);
+            return -1;
+        }
+    }
+    if (inode_size < sizeof(ext2_inode_t) || inode_size > bsize)
+        return -1;
+    has_ftype = (sb->feature_incompat & EXT2_INCOMPAT_FILETYPE) != 0;
+    ngroups = (sb->blocks_count - sb->first_data_block + sb->blocks_per_group - 1) / sb->blocks_per_group;
+    if (ngroups * sizeof(ext2_gd_t) > EXT2_GDT_MAX)
+    {
+        kprintf("[ext2] %u groups: too many\n", ngroups);
+        return -1;
+    }
+    for (uint32_t i = 0; i * bsize < ngroups * sizeof(ext2_gd_t); i++)
+        if (blk_read(sb->first_data_block + 1 + i, gdt.raw + i * bsize) != 0)
+            return -1;
+    kprintf("[ext2] lba %u: %u blocks of %u bytes, %u free, %u inodes\n", part_lba, sb->blocks_count, bsize,
+            sb->free_blocks_count, sb->inodes_count);
+    return 0;
+}
+
+/* ---- inodes ---- */
+
+static int inode_loc(uint32_t ino, uint32_t *blk, uint32_t *off)
+{
+    if (!ino || ino > sb->inodes_count)
+        return -1;
+    uint32_t g = (ino - 1) / sb->inodes_per_group;
+    uint32_t byte = (ino - 1) % sb->inodes_per_group * inode_size;
+    *blk = gd[g].inode_table + byte / bsize;
+    *off = byte % bsize;
+    return 0;
+}
+
+static int inode_read(uint32_t ino, ext2_inode_t *in)
+{
+    uint32_t blk, off;
+    if (inode_loc(ino, &blk, &off) < 0 || blk_read(blk, tbuf) < 0)
+        return -1;
+    kmemcpy(in, tbuf + off, sizeof(*in));
+    return 0;
+}
+
+/* Store in; a fresh inode also has the rest of its on-disk slot zeroed. */
+static int inode_write(uint32_t ino, const ext2_inode_t *in, int fresh)
+{
+    uint32_t blk, off;
+    if (inode_loc(ino, &blk, &off) < 0 || blk_read(blk, tbuf) < 0)
+        return -1;
+    if (fresh)
+        kmemset(tbuf + off, 0, inode_size);
+    kmemcpy(tbuf + off, in, sizeof(*in));
+    return blk_write(blk, tbuf);
+}
+
+static int is_dir(const ext2_inode_t *in)
+{
+    return (in->mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
+}
+
+static uint64_t isize(const ext2_inode_t *in)
+{
+    uint64_t s = in->size;
+    if (!is_dir(in))
+        s |= (uint64_t)in->size_high << 32;
+    return s;
+}
+
+static void set_isize(ext2_inode_t *in, uint64_t s)
+{
+    in->size = (uint32_t)s;
+    if (is_dir(in))
+        return;
+    in->size_high = (uint32_t)(s >> 32);
+    if (s > 0x7fffffffu && !(sb->feature_ro_compat & EXT2_RO_COMPAT_LARGE_FILE))
+    {
+        sb->feature_ro_compat |= EXT2_RO_COMPAT_LARGE_FILE;
+        super_write();
+    }
+}
+
+static uint32_t ino_group(uint32_t ino)
+{
+    return (ino - 1) / sb->inodes_per_group;
+}
+
+/* ---- allocation ---- */
+
+/* Take the first clear bit of the n-bit bitmap in block bm: its index, or
+ * -1 if all are set. */
+static int bit_take(uint32_t bm, uint32_t n)
+{
+    if (blk_read(bm, mbuf) < 0)
+        return -1;
+    for (uint32_t i = 0; i < n; i += 8)
+    {
+        if (mbuf[i / 8] == 0xff)
+            continue;
+        for (uint32_t j = i; j < i + 8 && j < n; j++)
+        {
+            if (!(mbuf[j / 8] & (1u << (j % 8))))
+            {
+                mbuf[j / 8] |= (uint8_t)(1u << (j % 8));
+                return blk_write(bm, mbuf) < 0 ? -1 : (int)j;
+            }
+        }
+    }
+    return -1;
+}
+
+static void bit_clear(uint32_t bm, uint32_t i)
+{
+    if (blk_read(bm, mbuf) < 0)
+        return;
+    mbuf[i / 8] &= (uint8_t)~(1u << (i % 8));
+    blk_write(bm, mbuf);
+}
+
+/* A free block, preferably in group g0; 0 when the volume is full. */
+static uint32_t block_alloc(uint32_t g0)
+{
+    for (uint32_t k = 0; k < ngroups; k++)
+    {
+        uint32_t g = (g0 + k) % ngroups;
+        if (!gd[g].free_blocks_count)
+            continue;
+        uint32_t start = sb->first_data_block + g * sb->blocks_per_group;
+        uint32_t n = sb->blocks_count - start;
+        if (n > sb->blocks_per_group)
+            n = sb->blocks_per_group;
+        int bit = bit_take(gd[g].block_bitmap, n);
+        if (bit < 0)
+            continue;
+        gd[g].free_blocks_count--;
+        sb->free_blocks_count--;
+        gd_write(g);
+        super_write();
+        return start + (uint32_t)bit;
+    }
+    return 0;
+}
+
+static void block_free(uint32_t b)
+{
+    if (b < sb->first_data_block || b >= sb->blocks_count)
+        return;
+    uint32_t g = (b - sb->first_data_block) / sb->blocks_per_group;
+    bit_clear(gd[g].block_bitmap, (b - sb->first_data_block) % sb->blocks_per_group);
+    gd[g].free_blocks_count++;
+    sb->free_blocks_count++;
+    gd_write(g);
+    super_write();
+}
+
+/* A free inode, preferably in the group of inode near; 0 when none is left. */
+static uint32_t inode_alloc(uint32_t near, int dir)
+{
+    uint32_t g0 = ino_group(near);
+    for (uint32_t k = 0; k < ngroups; k++)
+    {
+        uint32_t g = (g0 + k) % ngroups;
+        if (!gd[g].free_inodes_count)
+            continue;
+        int bit = bit_take(gd[g].inode_bitmap, sb->inodes_per_group);
+        if (bit < 0)
+            continue;
+        gd[g].free_inodes_count--;
+        if (dir)
+            gd[g].used_dirs_count++;
+        sb->free_inodes_count--;
+        gd_write(g);
+        super_write();
+        return g * sb->inodes_per_group + (uint32_t)bit + 1;
+    }
+    return 0;
+}
+
+static void inode_free(uint32_t ino, int dir)
+{
+    if (ino < first_ino || ino > sb->inodes_count)
+        return;
+    uint32_t g = ino_group(ino);
+    bit_clear(gd[g].inode_bitmap, (ino - 1) % sb->inodes_per_group);
+    gd[g].free_inodes_count++;
+    if (dir)
+        gd[g].used_dirs_count--;
+    sb->free_inodes_count++;
+    gd_write(g);
+    super_write();
+}
+
+/* ---- block maps ---- */
+
+/* The disk block holding logical block lbn of inode ino, or 0 for a hole.
+ * With create, a missing block and any map blocks leading to it are
+ * allocated (the map blocks zeroed) and *fresh is set for a new data
+ * block; in is updated and the caller writes it back. */
+static uint32_t bmap(uint32_t ino, ext2_inode_t *in, uint64_t lbn, int create, int *fresh)
+{
+    uint32_t g = ino_group(ino);
+    if (lbn < EXT2_NDIR)
+    {
+        if (!in->block[lbn] && create)
+        {
+            uint32_t b = block_alloc(g);
+            if (!b)
+                return 0;
+            in->block[lbn] = b;
+            in->blocks += spb;
+            *fresh = 1;
+        }
+        return in->block[lbn];
+    }
+    lbn -= EXT2_NDIR;
+    int level = 1;
+    uint64_t span = ptrs; /* data blocks under the top map block */
+    while (lbn >= span)
+    {
+        lbn -= span;
+        span *= ptrs;
+        if (++level > 3)
+            return 0;
+    }
+    uint32_t *slot = &in->block[EXT2_IND + level - 1];
+    if (!*slot)
+    {
+        if (!create)
+            return 0;
+        uint32_t b = block_alloc(g);
+        if (!b)
+            return 0;
+        blk_write(b, zeros);
+        *slot = b;
+        in->blocks += spb;
+    }
+    uint32_t b = *slot;
+    uint32_t *map = (uint32_t *)ibuf;
+    for (; level > 0; level--)
+    {
+        span /= ptrs;
+        uint32_t idx = (uint32_t)(lbn / span % ptrs);
+        if (blk_read(b, ibuf) < 0)
+            return 0;
+        uint32_t next = map[idx];
+        if (!next)
+        {
+            if (!create || !(next = block_alloc(g)))
+                return 0;
+            if (level > 1)
+                blk_write(next, zeros);
+            else
+                *fresh = 1;
+            map[idx] = next;
+            blk_write(b, ibuf);
+            in->blocks += spb;
+        }
+        b = next;
+    }
+    return b;
+}
+
+/* Free the blocks at logical index keep and beyond under map block b,
+ * level levels above the data and mapping from logical block first.
+ * Returns 1 if b ended up empty and was freed as well. */
+static int map_trim(ext2_inode_t *in, uint32_t b, int level, uint64_t first, uint64_t keep)
+{
+    uint64_t span = 1;
+    for (int l = 1; l < level; l++)
+        span *= ptrs;
+    uint32_t *map = (uint32_t *)lvlbuf[level - 1];
+    if (blk_read(b, map) < 0)
+        return 0;
+    int dirty = 0, used = 0;
+    for (uint32_t i = 0; i < ptrs; i++)
+    {
+        if (!map[i])
+            continue;
+        uint64_t s = first + i * span;
+        if (s + span <= keep)
+            used = 1;
+        else if (level == 1)
+        {
+            block_free(map[i]);
+            in->blocks -= spb;
+            map[i] = 0;
+            dirty = 1;
+        }
+        else if (map_trim(in, map[i], level - 1, s, keep))
+        {
+            map[i] = 0;
+            dirty = 1;
+        }
+        else
+            used = 1;
+    }
+    if (!used)
+    {
+        block_free(b);
+        in->blocks -= spb;
+        return 1;
+    }
+    if (dirty)
+        blk_write(b, map);
+    return 0;
+}
+
+/* Free every block of in from logical block keep on. */
+static void blocks_trim(ext2_inode_t *in, uint64_t keep)
+{
+    for (uint32_t i = keep < EXT2_NDIR ? (uint32_t)keep : EXT2_NDIR; i < EXT2_NDIR; i++)
+    {
+        if (in->block[i])
+        {
+            block_free(in->block[i]);
+            in->blocks -= spb;
+            in->block[i] = 0;
+        }
+    }
+    uint64_t first = EXT2_NDIR, span = ptrs;
+    for (int level = 1; level <= 3; level++, first += span, span *= ptrs)
+    {
+        uint32_t *slot = &in->block[EXT2_IND + level - 1];
+        if (*slot && first + span > keep && map_trim(in, *slot, level, first, keep))
+            *slot = 0;
+    }
+}
+
+/* ---- file data ---- */
+
+static uint64_t file_size(uint32_t ino)
+{
+    ext2_inode_t in;
+    return inode_read(ino, &in) < 0 ? 0 : isize(&in);
+}
+
+static int file_read(uint32_t ino, char *out, size_t len, uint64_t off)
+{
+    ext2_inode_t in;
+    if (inode_read(ino, &in) < 0)
+        return -1;
+    uint64_t size = isize(&in);
+    if (off >= size)
+        return 0;
+    if (len > size - off)
+        len = (size_t)(size - off);
+    size_t done = 0;
+    while (done < len)
+    {
+        size_t bo = (size_t)((off + done) % bsize);
+        size_t c = bsize - bo;
+        if (c > len - done)
+            c = len - done;
+        uint32_t b = bmap(ino, &in, (off + done) / bsize, 0, 0);
+        if (!b)
+            kmemset(out + done, 0, c);
+        else if (blk_read(b, dbuf) < 0)
+            break;
+        else
+            kmemcpy(out + done, dbuf + bo, c);
+        done += c;
+    }
+    return done ? (int)done : -1;
+}
+
+/* Write len bytes at off, allocating blocks as needed; a gap past the old
+ * end is left as a hole. Returns the count written, or -2 if the volume
+ * filled up before any byte was. */
+static int file_write(uint32_t ino, const char *data, size_t len, uint64_t off)
+{
+    ext2_inode_t in;
+    if (inode_read(ino, &in) < 0)
+        return -1;
+    size_t done = 0;
+    int err = 0;
+    while (done < len)
+    {
+        size_t bo = (size_t)((off + done) % bsize);
+        size_t c = bsize - bo;
+        if (c > len - done)
+            c = len - done;
+        int fresh = 0;
+        uint32_t b = bmap(ino, &in, (off + done) / bsize, 1, &fresh);
+        if (!b)
+        {
+            err = -2;
+            break;
+        }
+        if (c < bsize)
+        {
+            if (fresh)
+                kmemset(dbuf, 0, bsize);
+            else if (blk_read(b, dbuf) < 0)
+            {
+                err = -1;
+                break;
+            }
+        }
+        kmemcpy(dbuf + bo, data + done, c);
+        if (blk_write(b, dbuf) < 0)
+        {
+            err = -1;
+            break;
+        }
+        done += c;
+    }
+    if (off + done > isize(&in))
+        set_isize(&in, off + done);
+    in.mtime = in.ctime = now();
+    inode_write(ino, &in, 0);
+    return done ? (int)done : err;
+}
+
+/* Set the file's size. Shrinking frees the blocks past the new end and
+ * zeroes the tail of the last one; growing leaves a hole. */
+static int file_truncate(uint32_t ino, uint64_t size)
+{
+    ext2_inode_t in;
+    if (inode_read(ino, &in) < 0 || is_dir(&in))
+        return -1;
+    if (size < isize(&in))
+    {
+        blocks_trim(&in, (size + bsize - 1) / bsize);
+        uint32_t b = size % bsize ? bmap(ino, &in, size / bsize, 0, 0) : 0;
+        if (b && blk_read(b, dbuf) == 0)
+        {
+            kmemset(dbuf + size % bsize, 0, bsize - size % bsize);
+            blk_write(b, dbuf);
+        }
+    }
+    set_isize(&in, size);
+    in.mtime = in.ctime = now();
+    return inode_write(ino, &in, 0);
+}
+
+uint32_t ext2_block_size(void)
+{
+    return bsize;
+}
+
+/* The page cache calls these from the kworker too, filling read-ahead
+ * while a writer may be asleep in the driver, so they take vol_lock like
+ * every other entry point. */
+int ext2_map(uint32_t ino, uint64_t lbn, uint32_t n, uint32_t *out)
+{
+    ext2_inode_t in;
+    int r = -1;
+    kmutex_lock(&vol_lock);
+    if (inode_read(ino, &in) == 0)
+    {
+        for (uint32_t i = 0; i < n; i++)
+            out[i] = bmap(ino, &in, lbn + i, 0, 0);
+        r = 0;
+    }
+    kmutex_unlock(&vol_lock);
+    return r;
+}
+
+/* Runs of adjacent blocks go to the disk as one transfer through rabuf. */
+static uint8_t rabuf[EXT2_RUN_MAX * EXT2_MAX_BLOCK] __attribute__((aligned(8)));
+
+int ext2_read_blocks(const uint32_t *blocks, uint32_t n, char *const *dst)
+{
+    int err = 0;
+    kmutex_lock(&vol_lock);
+    for (uint32_t i = 0; i < n;)
+    {
+        if (!blocks[i])
+        {
+            kmemset(dst[i++], 0, bsize);
+            continue;
+        }
+        /* a cached copy may be newer than the disk */
+        buf_t *b = bpeek(BDEV_ATA, part_lba + blocks[i] * spb, bsize);
+        if (b)
+        {
+            kmemcpy(dst[i++], b->data, bsize);
+            brelse(b);
+            continue;
+        }
+        uint32_t run = 1;
+        while (i + run < n && run < EXT2_RUN_MAX && blocks[i + run] == blocks[i] + run)
+        {
+            b = bpeek(BDEV_ATA, part_lba + blocks[i + run] * spb, bsize);
+            if (b)
+            {
+                brelse(b);
+                break;
+            }
+            run++;
+        }
+        if (bdev_read(BDEV_ATA, part_lba + blocks[i] * spb, run * spb, rabuf) < 0)
+        {
+            err = -1;
+            break;
+        }
+        for (uint32_t j = 0; j < run; j++)
+            kmemcpy(dst[i + j], rabuf + j * bsize, bsize);
+        i += run;
+    }
+    kmutex_unlock(&vol_lock);
+    return err;
+}
+
+/* ---- directories ---- */
+
+static uint16_t rec_len(size_t name_len)
+{
+    return (uint16_t)((8 + name_len + 3) & ~3u);
+}
+
+static int entry_type(const ext2_dirent_t *de)
+{
+    if (has_ftype)
+        return de->file_type;
+    ext2_inode_t in;
+    if (inode_read(de->inode, &in) < 0)
+        return 0;
+    return is_dir(&in) ? EXT2_FT_DIR : (in.mode & EXT2_S_IFMT) == EXT2_S_IFREG ? EXT2_FT_REG : 0;
+}
+
+/* Visit each live entry of dir, a block at a time in dirbuf. fn returns
+ * nonzero to stop; its block number and offset are then left in *blk and
+ * *off, and the walk returns 1. */
+typedef int (*dir_visit_fn)(ext2_dirent_t *de, void *arg);
+static int dir_walk(uint32_t dir, ext2_inode_t *in, dir_visit_fn fn, void *arg, uint32_t *blk, uint32_t *off)
+{
+    if (inode_read(dir, in) < 0 || !is_dir(in))
+        return -1;
+    for (uint64_t lbn = 0; lbn < isize(in) / bsize; lbn++)
+    {
+        uint32_t b = bmap(dir, in, lbn, 0, 0);
+        if (!b || blk_read(b, dirbuf) < 0)
+            continue;
+        for (uint32_t o = 0; o + 8 <= bsize;)
+        {
+            ext2_dirent_t *de = (ext2_dirent_t *)(dirbuf + o);
+            if (de->rec_len < 8 || o + de->rec_len > bsize)
+                break; /* damaged block */
+            if (de->inode && fn(de, arg))
+            {
+                *blk = b;
+                *off = o;
+                return 1;
+            }
+            o += de->rec_len;
+        }
+    }
+    return 0;
+}
+
+typedef struct
+{
+    ext2_dirent_fn fn;
+    void *arg;
+} readdir_ctx_t;
+
+static int readdir_visit(ext2_dirent_t *de, void *arg)
+{
+    readdir_ctx_t *c = arg;
+    int type = entry_type(de);
+    uint64_t size = type == EXT2_FT_REG ? file_size(de->inode) : 0;
+    return c->fn(c->arg, de->inode, type, size, de->name, de->name_len);
+}
+
+static int dir_read(uint32_t dir, ext2_dirent_fn fn, void *arg)
+{
+    ext2_inode_t in;
+    uint32_t blk, off;
+    readdir_ctx_t c = {fn, arg};
+    return dir_walk(dir, &in, readdir_visit, &c, &blk, &off) < 0 ? -1 : 0;
+}
+
+static int name_visit(ext2_dirent_t *de, void *arg)
+{
+    const char *name = arg;
+    size_t len = kstrlen(name);
+    return de->name_len == len && kstrncmp(de->name, name, len) == 0;
+}
+
+/* The entry called name in dir, as (disk block, offset) with that block in
+ * dirbuf; 0 if there is none. */
+static int dir_find(uint32_t dir, ext2_inode_t *in, const char *name, uint32_t *blk, uint32_t *off)
+{
+    return dir_walk(dir, in, name_visit, (void *)name, blk, off) == 1;
+}
+
+/* The directory's contents changed: stamp it and drop any hash index,
+ * which no longer matches. */
+static void dir_touch(uint32_t dir, ext2_inode_t *in)
+{
+    in->flags &= ~EXT2_INDEX_FL;
+    in->mtime = in->ctime = now();
+    inode_write(dir, in, 0);
+}
+
+/* Link ino into dir as name: in the first gap big enough, or a new block
+ * at the end. */
+static int dir_add(uint32_t dir, const char *name, uint32_t ino, int type)
+{
+    size_t len = kstrlen(name);
+    if (!len || len > 255)
+        return -1;
+    uint16_t need = rec_len(len);
+    ext2_inode_t in;
+    if (inode_read(dir, &in) < 0 || !is_dir(&in))
+        return -1;
+    uint64_t nblocks = isize(&in) / bsize;
+    ext2_dirent_t *de = 0;
+    uint32_t b = 0;
+    for (uint64_t lbn = 0; lbn < nblocks && !de; lbn++)
+    {
+        b = bmap(dir, &in, lbn, 0, 0);
+        if (!b || blk_read(b, dirbuf) < 0)
+            continue;
+        for (uint32_t o = 0; o + 8 <= bsize;)
+        {
+            ext2_dirent_t *e = (ext2_dirent_t *)(dirbuf + o);
+            if (e->rec_len < 8 || o + e->rec_len > bsize)
+                break;
+            uint16_t used = e->inode ? rec_len(e->name_len) : 0;
+            if (e->rec_len >= used + need)
+            {
+                if (used)
+                {
+                    de = (ext2_dirent_t *)(dirbuf + o + used);
+                    de->rec_len = e->rec_len - used;
+                    e->rec_len = used;
+                }
+                else
+                    de = e;
+                break;
+            }
+            o += e->rec_len;
+        }
+    }
+    if (!de)
+    {
+        int fresh = 0;
+        b = bmap(dir, &in, nblocks, 1, &fresh);
+        if (!b)
+            return -2;
+        kmemset(dirbuf, 0, bsize);
+        de = (ext2_dirent_t *)dirbuf;
+        de->rec_len = (uint16_t)bsize;
+        set_isize(&in, (nblocks + 1) * bsize);
+    }
+    de->inode = ino;
+    de->name_len = (uint8_t)len;
+    de->file_type = has_ftype ? (uint8_t)type : 0;
+    kmemcpy(de->name, name, len);
+    if (blk_write(b, dirbuf) < 0)
+        return -1;
+    dir_touch(dir, &in);
+    return 0;
+}
+
+/* Unlink name from dir; returns its inode, or 0 if there was none. The
+ * entry merges into the one before it, or is blanked if it leads its block. */
+static uint32_t dir_remove(uint32_t dir, const char *name, int *type)
+{
+    ext2_inode_t in;
+    uint32_t b, off;
+    if (!dir_find(dir, &in, name, &b, &off))
+        return 0;
+    ext2_dirent_t *de = (ext2_dirent_t *)(dirbuf + off);
+    uint32_t ino = de->inode;
+    *type = entry_type(de);
+    ext2_dirent_t *prev = 0;
+    for (uint32_t o = 0; o < off;)
+    {
+        prev = (ext2_dirent_t *)(dirbuf + o);
+        o += prev->rec_len;
+    }
+    if (prev)
+        prev->rec_len += de->rec_len;
+    else
+        de->inode = 0;
+    if (blk_write(b, dirbuf) < 0)
+        return 0;
+    dir_touch(dir, &in);
+    return ino;
+}
+
+static uint32_t file_new(uint32_t dir, const char *name)
+{
+    uint32_t ino = inode_alloc(dir, 0);
+    if (!ino)
+        return 0;
+    ext2_inode_t in = {0};
+    in.mode = EXT2_S_IFREG | 0644;
+    in.links_count = 1;
+    in.atime = in.ctime = in.mtime = now();
+    if (inode_write(ino, &in, 1) < 0 || dir_add(dir, name, ino, EXT2_FT_REG) < 0)
+    {
+        inode_free(ino, 0);
+        return 0;
+    }
+    return ino;
+}
+
+static uint32_t dir_new(uint32_t dir, const char *name)
+{
+    ext2_inode_t parent;
+    if (inode_read(dir, &parent) < 0 || !is_dir(&parent))
+        return 0;
+    uint32_t ino = inode_alloc(dir, 1);
+    if (!ino)
+        return 0;
+    uint32_t b = block_alloc(ino_group(ino));
+    if (!b)
+    {
+        inode_free(ino, 1);
+        return 0;
+    }
+    kmemset(dirbuf, 0, bsize);
+    ext2_dirent_t *dot = (ext2_dirent_t *)dirbuf;
+    dot->inode = ino;
+    dot->rec_len = 12;
+    dot->name_len = 1;
+    dot->file_type = has_ftype ? EXT2_FT_DIR : 0;
+    dot->name[0] = '.';
+    ext2_dirent_t *dotdot = (ext2_dirent_t *)(dirbuf + 12);
+    dotdot->inode = dir;
+    dotdot->rec_len = (uint16_t)(bsize - 12);
+    dotdot->name_len = 2;
+    dotdot->file_type = dot->file_type;
+    dotdot->name[0] = dotdot->name[1] = '.';
+    ext2_inode_t in = {0};
+    in.mode = EXT2_S_IFDIR | 0755;
+    in.links_count = 2;
+    in.size = bsize;
+    in.blocks = spb;
+    in.block[0] = b;
+    in.atime = in.ctime = in.mtime = now();
+    if (blk_write(b, dirbuf) < 0 || inode_write(ino, &in, 1) < 0 || dir_add(dir, name, ino, EXT2_FT_DIR) < 0)
+    {
+        block_free(b);
+        inode_free(ino, 1);
+        return 0;
+    }
+    inode_read(dir, &parent);
+    parent.links_count++; /* the new ".." */
+    inode_write(dir, &parent, 0);
+    return ino;
+}
+
+/* Remove the entry; the inode itself goes at inode_put. A directory must
+ * already be empty. */
+static int entry_unlink(uint32_t dir, const char *name)
+{
+    int type;
+    uint32_t ino = dir_remove(dir, name, &type);
+    if (!ino)
+        return -1;
+    ext2_inode_t in;
+    if (inode_read(ino, &in) < 0)
+        return -1;
+    if (is_dir(&in))
+    {
+        in.links_count = 0; /* its entry and its "." */
+        ext2_inode_t parent;
+        if (inode_read(dir, &parent) == 0)
+        {
+            parent.links_count--;
+            inode_write(dir, &parent, 0);
+        }
+    }
+    else if (in.links_count)
+        in.links_count--;
+    in.ctime = now();
+    return inode_write(ino, &in, 0);
+}
+
+static int entry_rename(uint32_t dir, const char *oldn, const char *newn)
+{
+    ext2_inode_t in;
+    uint32_t b, off;
+    if (!dir_find(dir, &in, oldn, &b, &off))
+        return -1;
+    ext2_dirent_t *de = (ext2_dirent_t *)(dirbuf + off);
+    uint32_t ino = de->inode;
+    int type = entry_type(de);
+    /* new name first, so a full volume loses nothing */
+    int r = dir_add(dir, newn, ino, type);
+    if (r < 0)
+        return r;
+    return dir_remove(dir, oldn, &type) ? 0 : -1;
+}
+
+static void inode_put(uint32_t ino)
+{
+    ext2_inode_t in;
+    if (inode_read(ino, &in) < 0 || in.links_count)
+        return;
+    blocks_trim(&in, 0);
+    in.dtime = now();
+    inode_write(ino, &in, 0);
+    inode_free(ino, is_dir(&in));
+}
+
+/* ---- entry points: one caller in the driver at a time ---- */
+
+int ext2_mount(void)
+{
+    kmutex_lock(&vol_lock);
+    int r = mount_volume();
+    kmutex_unlock(&vol_lock);
+    return r;
+}
+
+int ext2_readdir(uint32_t dir, ext2_dirent_fn fn, void *arg)
+{
+    kmutex_lock(&vol_lock);
+    int r = dir_read(dir, fn, arg);
+    kmutex_unlock(&vol_lock);
+    return r;
+}
+
+uint32_t ext2_create(uint32_t dir, const char *name)
+{
+    kmutex_lock(&vol_lock);
+    uint32_t ino = file_new(dir, name);
+    kmutex_unlock(&vol_lock);
+    return ino;
+}
+
+uint32_t ext2_mkdir(uint32_t dir, const char *name)
+{
+    kmutex_lock(&vol_lock);
+    uint32_t ino = dir_new(dir, name);
+    kmutex_unlock(&vol_lock);
+    return ino;
+}
+
+int ext2_unlink(uint32_t dir, const char *name)
+{
+    kmutex_lock(&vol_lock);
+    int r = entry_unlink(dir, name);
+    kmutex_unlock(&vol_lock);
+    return r;
+}
+
+int ext2_rename(uint32_t dir, const char *oldn, const char *newn)
+{
+    kmutex_lock(&vol_lock);
+    int r = entry_rename(dir, oldn, newn);
+    kmutex_unlock(&vol_lock);
+    return r;
+}
+
+void ext2_iput(uint32_t ino)
+{
+    kmutex_lock(&vol_lock);
+    inode_put(ino);
+    kmutex_unlock(&vol_lock);
+}
+
+uint64_t ext2_size(uint32_t ino)
+{
+    kmutex_lock(&vol_lock);
+    uint64_t size = file_size(ino);
+    kmutex_unlock(&vol_lock);
+    return size;
+}
+
+int ext2_pread(uint32_t ino, char *out, size_t len, uint64_t off)
+{
+    kmutex_lock(&vol_lock);
+    int r = file_read(ino, out, len, off);
+    kmutex_unlock(&vol_lock);
+    return r;
+}
+
+int ext2_pwrite(uint32_t ino, const char *data, size_t len, uint64_t off)
+{
+    kmutex_lock(&vol_lock);
+    int r = file_write(ino, data, len, off);
+    kmutex_unlock(&vol_lock);
+    return r;
+}
+
+int ext2_truncate(uint32_t ino, uint64_t size)
+{
+    kmutex_lock(&vol_lock);
+    int r = file_truncate(ino, size);
+    kmutex_unlock(&vol_lock);
+    return r;
+}
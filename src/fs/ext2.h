@@ -0,0 +1,44 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* ext2 on the ATA disk (src/fs/ext2.c). Inodes are named by number; the
+ * node tree keeps the number in node->ino. Functions returning int give
+ * -1 on a bad argument or I/O error and -2 when the volume is full, as the
+ * rest of the fs layer does. Each call holds the volume's lock while it
+ * runs, so callers on different threads take turns. */
+
+#define EXT2_ROOT_INO 2
+
+/* directory entry file types */
+#define EXT2_FT_REG 1
+#define EXT2_FT_DIR 2
+
+int ext2_mount(void);
+
+/* Call fn for every entry of directory dir, "." and ".." included, with a
+ * regular file's size; a nonzero return from fn stops the walk. The
+ * volume is locked meanwhile, so fn must not call back into ext2. */
+typedef int (*ext2_dirent_fn)(void *arg, uint32_t ino, int type, uint64_t size, const char *name, size_t len);
+int ext2_readdir(uint32_t dir, ext2_dirent_fn fn, void *arg);
+
+/* New empty file or directory called name in dir: its inode, or 0. */
+uint32_t ext2_create(uint32_t dir, const char *name);
+uint32_t ext2_mkdir(uint32_t dir, const char *name);
+int ext2_unlink(uint32_t dir, const char *name);
+int ext2_rename(uint32_t dir, const char *oldn, const char *newn);
+/* The last in-memory user of ino is gone: free it if nothing links it. */
+void ext2_iput(uint32_t ino);
+
+uint64_t ext2_size(uint32_t ino);
+int ext2_pread(uint32_t ino, char *out, size_t len, uint64_t off);
+int ext2_pwrite(uint32_t ino, const char *data, size_t len, uint64_t off);
+int ext2_truncate(uint32_t ino, uint64_t size);
+
+/* Bulk reads for the page cache (src/fs/pcache.c): ext2_map gives the disk
+ * blocks behind n file blocks from lbn (0 for a hole), and
+ * ext2_read_blocks reads them, each to its own dst, merging adjacent
+ * blocks into one disk transfer. */
+uint32_t ext2_block_size(void);
+int ext2_map(uint32_t ino, uint64_t lbn, uint32_t n, uint32_t *out);
+int ext2_read_blocks(const uint32_t *blocks, uint32_t n, char *const *dst);
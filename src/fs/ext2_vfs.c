@@ -0,0 +1,131 @@
+#include "fs.h"
+#include "ext2.h"
+#include "bcache.h"
+#include <stdint.h>
+
+#define E2_PAGES_MAX 32 /* pages read in one transfer batch */
+
+/* The ext2 volume under the VFS. A directory's entries become nodes the
+ * first time it is looked inside; file data goes to src/fs/ext2.c, and
+ * reads come back through the page cache (src/fs/pcache.c), which writes
+ * and truncates keep in step. */
+
+static int e2_mount(fs_super_t *sb)
+{
+    if (ext2_mount() < 0)
+        return -1;
+    sb->root->ino = EXT2_ROOT_INO;
+    return 0;
+}
+
+static int e2_sync(fs_super_t *sb)
+{
+    (void)sb;
+    return bcache_sync(BDEV_ATA);
+}
+
+static void e2_release(node_t *n)
+{
+    if (n->ino)
+    {
+        pcache_drop(n);
+        ext2_iput(n->ino);
+    }
+}
+
+static int e2_fill(void *arg, uint32_t ino, int type, uint64_t size, const char *name, size_t len)
+{
+    node_t *dir = arg;
+    if ((len == 1 && name[0] == '.') || (len == 2 && name[0] == '.' && name[1] == '.'))
+        return 0;
+    if (type != EXT2_FT_REG && type != EXT2_FT_DIR)
+        return 0; /* a kind of file we lack */
+    node_t *n = fs_add_entry(dir, name, len, type == EXT2_FT_DIR ? NODE_DIR : NODE_FILE);
+    if (!n)
+        return len >= sizeof(dir->name) ? 0 : 1; /* no room for the name, or out of nodes */
+    n->ino = ino;
+    if (n->type == NODE_FILE)
+        n->size = (size_t)size;
+    return 0;
+}
+
+static void e2_load(node_t *dir)
+{
+    ext2_readdir(dir->ino, e2_fill, dir);
+}
+
+static int e2_create(node_t *dir, node_t *n)
+{
+    if (n->type == NODE_DIR)
+        n->ino = ext2_mkdir(dir->ino, n->name);
+    else if (n->type == NODE_FILE)
+        n->ino = ext2_create(dir->ino, n->name);
+    return n->ino ? 0 : -1;
+}
+
+static int e2_unlink(node_t *dir, node_t *n)
+{
+    return ext2_unlink(dir->ino, n->name) < 0 ? -1 : 0;
+}
+
+static int e2_rename(node_t *dir, node_t *n, const char *newn)
+{
+    return ext2_rename(dir->ino, n->name, newn) < 0 ? -1 : 0;
+}
+
+static int e2_pwrite(node_t *f, const char *data, size_t len, size_t off)
+{
+    if (!len)
+        return 0;
+    int r = ext2_pwrite(f->ino, data, len, off);
+    if (r > 0 && off + (size_t)r > f->size)
+        f->size = off + (size_t)r;
+    if (r > 0)
+        pcache_write(f, data, (size_t)r, off);
+    return r;
+}
+
+static int e2_truncate(node_t *f, size_t size)
+{
+    int r = ext2_truncate(f->ino, size);
+    if (r == 0)
+    {
+        pcache_truncate(f, size);
+        f->size = size;
+    }
+    return r;
+}
+
+/* Map every block behind the pages, then read the lot in one go so that
+ * blocks adjacent on the disk share a transfer. Blocks past the end of the
+ * file read as holes. */
+static int e2_readpages(node_t *f, const size_t *index, uint32_t count, char *const *dst)
+{
+    uint32_t blocks[E2_PAGES_MAX * (FS_BLOCK / 1024)];
+    char *bdst[E2_PAGES_MAX * (FS_BLOCK / 1024)];
+    uint32_t bs = ext2_block_size();
+    uint32_t per = FS_BLOCK / bs;
+    uint32_t nb = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (nb + per > sizeof(blocks) / sizeof(blocks[0]))
+        {
+            if (ext2_read_blocks(blocks, nb, bdst) < 0)
+                return -1;
+            nb = 0;
+        }
+        for (uint32_t j = 0; j < per; j++)
+            bdst[nb + j] = dst[i] + j * bs;
+        if (ext2_map(f->ino, (uint64_t)index[i] * per, per, blocks + nb) < 0)
+            for (uint32_t j = 0; j < per; j++)
+                blocks[nb + j] = 0;
+        nb += per;
+    }
+    return nb && ext2_read_blocks(blocks, nb, bdst) < 0 ? -1 : 0;
+}
+
+static const fs_super_ops_t e2_sops = {e2_sync, e2_release};
+static const fs_inode_ops_t e2_iops = {e2_load, e2_create, e2_unlink, e2_rename};
+static const fs_file_ops_t e2_fops = {pcache_read, e2_pwrite, e2_truncate, pcache_data_at, e2_readpages};
+
+const fs_type_t ext2fs_type = {"ext2", e2_mount, &e2_sops, &e2_iops, &e2_fops};
@@ -1,37 +1,202 @@
 #pragma once
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum
 {
     NODE_DIR,
     NODE_FILE,
-    NODE_CHAR
+    NODE_CHAR,
+    NODE_PIPE,
+    NODE_EPOLL
 } node_type_t;
 
+#define FS_BLOCK 4096
+#define FS_DIRECT 12                               /* blocks reached from the header */
+#define FS_PER_MAP (FS_BLOCK / 8)                  /* block pointers in a map block */
+#define FS_MAX_BLOCKS (FS_DIRECT + FS_PER_MAP + FS_PER_MAP * FS_PER_MAP) /* 1 GiB */
+#define FS_DATA_MAX 1024
+
+/* A regular file's contents (src/fs/fs_data.c): page-sized blocks, or a
+ * read-only image outside the fs. Reflinked files share one header; the
+ * first write through any of them gives it a private copy. */
+typedef struct fs_data
+{
+    int refs;
+    size_t nblocks;
+    const char *image;
+    char *direct[FS_DIRECT];
+    char **indirect;
+    char ***dindirect; /* maps of maps, past the indirect block */
+} fs_data_t;
+
 typedef struct node
 {
     char name[32];
     node_type_t type;
     struct node *parent;
     struct node *sibling;
+    struct node **psibling; /* the link that points here: &parent->child or
+                               &previous->sibling */
     struct node *child;
-    char *data;
+    char *data;        /* device or object behind CHAR, PIPE and EPOLL nodes;
+                          initramfs directory: its path in the archive */
     size_t size;
+    fs_data_t *fdata;  /* NODE_FILE contents; 0 while empty */
+    struct node *hnext; /* name index chain (dcache.c) */
+    uint32_t dgen;      /* changes as the node leaves the name index, which
+                           retires path cache entries that relied on it */
+    int nlink;         /* 1 while in a directory */
+    int refs;          /* open files and the cwd (fs_node_get) */
+    struct fs_super *sb;      /* filesystem the node belongs to */
+    struct fs_super *mounted; /* directory: volume mounted over it */
+    unsigned ino;      /* inode behind the node on ext2 or imgfs; initramfs
+                          directory: length of its path; 0 for other
+                          memory nodes */
+    int loaded;        /* directory: entries read in by inode ops load */
+    struct page *pages; /* ext2 file: cached pages (pcache.c) */
 } node_t;
 
+/* Read-ahead state of an open file (pcache.c); zero for a new one */
+typedef struct
+{
+    size_t next; /* page where the last read ended */
+    size_t win;  /* current window in pages; 0 while access looks random */
+    size_t end;  /* first page not yet asked for */
+} fs_ra_t;
+
+typedef struct
+{
+    size_t pages, hits, misses, readahead, evictions;
+} pcache_stats_t;
+
+/* VFS (src/fs/vfs.c). Every filesystem shares the one node tree; a
+ * filesystem type supplies the tables below, which the fs_* calls
+ * dispatch through node->sb. Entries a type does without may be 0. */
+typedef struct fs_super fs_super_t;
+
+typedef struct
+{
+    int (*sync)(fs_super_t *sb);
+    /* the last reference to an unlinked node is gone */
+    void (*release)(node_t *n);
+} fs_super_ops_t;
+
+/* Directory operations. The VFS allocates, names and links nodes; these
+ * give a new node its backing object or take it away. */
+typedef struct
+{
+    void (*load)(node_t *dir); /* first look inside: read entries in */
+    int (*create)(node_t *dir, node_t *n);
+    int (*unlink)(node_t *dir, node_t *n);
+    int (*rename)(node_t *dir, node_t *n, const char *newn);
+} fs_inode_ops_t;
+
+typedef struct
+{
+    int (*pread)(node_t *f, char *out, size_t len, size_t off, fs_ra_t *ra);
+    int (*pwrite)(node_t *f, const char *data, size_t len, size_t off);
+    int (*truncate)(node_t *f, size_t size);
+    const char *(*data_at)(node_t *f, size_t off, size_t *len);
+    /* For the page cache: fill count whole pages, dst[i] with page
+     * index[i] (ascending), zero past the end of the file. 0 or -1. */
+    int (*readpages)(node_t *f, const size_t *index, uint32_t count, char *const *dst);
+} fs_file_ops_t;
+
+typedef struct
+{
+    const char *name;
+    int (*mount)(fs_super_t *sb); /* sb->root is an empty directory */
+    const fs_super_ops_t *sops;
+    const fs_inode_ops_t *iops;
+    const fs_file_ops_t *fops;
+} fs_type_t;
+
+#define FS_MOUNT_MAX 8
+
+struct fs_super
+{
+    const fs_type_t *type;
+    node_t *root;
+    node_t *covered; /* directory the volume is mounted over; 0 for / */
+    char path[32];
+};
+
+extern const fs_type_t tmpfs_type, devfs_type, ext2fs_type, initramfs_type, imgfs_type;
+
 void fs_init(void);
 node_t *fs_root(void);
 node_t *fs_cwd(void);
 void fs_set_cwd(node_t *n);
 node_t *fs_mkdir(node_t *parent, const char *name);
 node_t *fs_lookup(node_t *parent, const char *path);
+node_t *fs_lookup_parent(node_t *parent, const char *path, const char **name);
 node_t *fs_create_file(node_t *parent, const char *name);
 node_t *fs_create_chardev(node_t *parent, const char *name, void *devptr);
 int fs_write(node_t *f, const char *data, size_t len, int append);
 int fs_read(node_t *f, char *out, size_t max);
+int fs_pread(node_t *f, char *out, size_t len, size_t off);
+int fs_pwrite(node_t *f, const char *data, size_t len, size_t off);
+/* fs_pread for an open file: sequential reads of a disk file start
+ * read-ahead through ra */
+int fs_pread_ra(node_t *f, char *out, size_t len, size_t off, fs_ra_t *ra);
 
 node_t *fs_find_child(node_t *parent, const char *name);
-node_t *fs_unlink(node_t *parent, const char *name);
+node_t *fs_first_child(node_t *dir);
+int fs_unlink(node_t *parent, const char *name);
+void fs_node_get(node_t *n);
+void fs_node_put(node_t *n);
 int fs_rename(node_t *parent, const char *oldn, const char *newn);
 node_t *fs_clone_file(node_t *parent, node_t *src, const char *newname);
-void fs_stats(size_t *out_nodes, size_t *out_arena_used, size_t *out_arena_total);
+int fs_reflink(node_t *dst, node_t *src);
+int fs_copy_file(node_t *dst, node_t *src);
+int fs_truncate(node_t *f, size_t size);
+int fs_attach(node_t *f, const char *image, size_t size);
+const char *fs_data_at(node_t *f, size_t off, size_t *len);
+size_t fs_data_blocks(void);
+void fs_stats(size_t *out_nodes, size_t *out_blocks);
+
+/* Mount a new volume of type over the directory at path. */
+int fs_mount(const char *path, const fs_type_t *type);
+/* Mount table entry i, or 0 past the end. */
+const fs_super_t *fs_mount_at(int i);
+/* Flush n's volume, or every volume for n == 0. */
+int fs_sync(node_t *n);
+
+/* For inode ops load: link an entry already on the volume into dir. */
+node_t *fs_add_entry(node_t *dir, const char *name, size_t len, node_type_t type);
+
+/* Memory file data (src/fs/fs_data.c), the file ops of tmpfs */
+extern const fs_file_ops_t fs_mem_file_ops;
+void fs_mem_release(node_t *n);
+
+/* The cpio archive initramfs_type serves (src/fs/initramfs.c). Set
+ * before fs_init, which then mounts it as the root in place of a tmpfs. */
+void initramfs_set(const char *base, size_t len);
+/* The compressed /bin image imgfs_type serves (src/fs/imgfs.c); fs_init
+ * mounts it over /bin. */
+void imgfs_set(const char *base, size_t len);
+
+/* Name lookup shared by every filesystem (src/fs/dcache.c) */
+typedef struct
+{
+    node_t *dir;      /* where a failed walk stopped: dir has no entry */
+    const char *name; /* name[0..len) */
+    size_t len;
+} dcache_miss_t;
+
+node_t *dindex_find(node_t *dir, const char *name, size_t len);
+void dindex_add(node_t *n);
+void dindex_del(node_t *n);
+void dcache_retire(node_t *n);
+int dcache_get(node_t *base, const char *path, node_t **out);
+void dcache_put(node_t *base, const char *path, node_t *n, const dcache_miss_t *miss);
+void dcache_invalidate(void);
+
+/* Page cache for file data read through readpages (src/fs/pcache.c) */
+int pcache_read(node_t *n, char *out, size_t len, size_t off, fs_ra_t *ra);
+const char *pcache_data_at(node_t *n, size_t off, size_t *len);
+void pcache_write(node_t *n, const char *data, size_t len, size_t off);
+void pcache_truncate(node_t *n, size_t size);
+void pcache_drop(node_t *n);
+void pcache_get_stats(pcache_stats_t *s);
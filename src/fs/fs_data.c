@@ -0,0 +1,328 @@
+#include "fs.h"
+#include "../kernel/string.h"
+#include "pmm.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/* File contents of memory filesystems (tmpfs). A file's bytes live in FS_BLOCK-sized
+ * blocks from the page allocator: the first FS_DIRECT through the data
+ * header itself, the next FS_PER_MAP through one indirect block and the
+ * rest through a double-indirect one. Growing a file only
+ * adds blocks, so an append never moves what is already written, and
+ * truncate and unlink hand blocks straight back to the allocator.
+ *
+ * Invariant: the bytes of the last block past f->size are zero, so growing
+ * a file (or a hole) never exposes stale data.
+ *
+ * The VFS reaches these through fs_mem_file_ops; fs_attach and the sharing
+ * in fs_reflink only work on memory files. */
+
+static fs_data_t datas[FS_DATA_MAX];
+static size_t blocks_used; /* data and indirect blocks, for fs_stats */
+
+static fs_data_t *data_alloc(void)
+{
+    for (int i = 0; i < FS_DATA_MAX; i++)
+    {
+        if (!datas[i].refs)
+        {
+            kmemset(&datas[i], 0, sizeof(datas[i]));
+            datas[i].refs = 1;
+            return &datas[i];
+        }
+    }
+    return 0;
+}
+
+static int is_mem(const node_t *f)
+{
+    return f->sb && f->sb->type->fops == &fs_mem_file_ops;
+}
+
+#define FS_DIND_FIRST (FS_DIRECT + FS_PER_MAP) /* first block behind dindirect */
+
+static char *block_get(const fs_data_t *d, size_t i)
+{
+    if (i >= d->nblocks)
+        return 0;
+    if (i < FS_DIRECT)
+        return d->direct[i];
+    if (i < FS_DIND_FIRST)
+        return d->indirect[i - FS_DIRECT];
+    i -= FS_DIND_FIRST;
+    return d->dindirect[i / FS_PER_MAP][i % FS_PER_MAP];
+}
+
+/* *map, allocated (zeroed) if it is not there yet; 0 when memory is out.
+ * A map made for a block that then could not be had stays for the next
+ * try, and blocks_trim frees it with the rest. */
+static void *map_get(void *map)
+{
+    void **m = map;
+    if (!*m && (*m = pmm_alloc_page()))
+        blocks_used++;
+    return *m;
+}
+
+/* Append one zeroed block. Returns 0, or -2 when memory is exhausted. */
+static int block_add(fs_data_t *d)
+{
+    size_t i = d->nblocks;
+    if (i >= FS_MAX_BLOCKS)
+        return -2;
+    char **slot;
+    if (i < FS_DIRECT)
+        slot = &d->direct[i];
+    else if (i < FS_DIND_FIRST)
+    {
+        if (!map_get(&d->indirect))
+            return -2;
+        slot = &d->indirect[i - FS_DIRECT];
+    }
+    else
+    {
+        size_t j = i - FS_DIND_FIRST;
+        if (!map_get(&d->dindirect) || !map_get(&d->dindirect[j / FS_PER_MAP]))
+            return -2;
+        slot = &d->dindirect[j / FS_PER_MAP][j % FS_PER_MAP];
+    }
+    char *b = pmm_alloc_page();
+    if (!b)
+        return -2;
+    *slot = b;
+    d->nblocks++;
+    blocks_used++;
+    return 0;
+}
+
+static void map_free(void *map)
+{
+    void **m = map;
+    pmm_free_page(*m);
+    *m = 0;
+    blocks_used--;
+}
+
+/* Free every block from index keep on, and the maps left with none. */
+static void blocks_trim(fs_data_t *d, size_t keep)
+{
+    while (d->nblocks > keep)
+    {
+        pmm_free_page(block_get(d, d->nblocks - 1));
+        d->nblocks--;
+        blocks_used--;
+    }
+    if (d->dindirect)
+    {
+        for (size_t k = 0; k < FS_PER_MAP; k++)
+            if (d->dindirect[k] && keep <= FS_DIND_FIRST + k * FS_PER_MAP)
+                map_free(&d->dindirect[k]);
+        if (keep <= FS_DIND_FIRST)
+            map_free(&d->dindirect);
+    }
+    if (keep <= FS_DIRECT && d->indirect)
+        map_free(&d->indirect);
+}
+
+/* Drop f's reference to its data; the last one frees the blocks. */
+static void data_put(node_t *f)
+{
+    fs_data_t *d = f->fdata;
+    f->fdata = 0;
+    if (d && --d->refs == 0)
+        blocks_trim(d, 0);
+}
+
+/* Copy up to len bytes at off out of d, which holds size bytes. */
+static size_t data_read(const fs_data_t *d, size_t size, char *out, size_t len, size_t off)
+{
+    if (off >= size)
+        return 0;
+    if (len > size - off)
+        len = size - off;
+    if (d->image)
+    {
+        kmemcpy(out, d->image + off, len);
+        return len;
+    }
+    for (size_t done = 0; done < len;)
+    {
+        size_t bo = (off + done) % FS_BLOCK;
+        size_t c = FS_BLOCK - bo;
+        if (c > len - done)
+            c = len - done;
+        kmemcpy(out + done, block_get(d, (off + done) / FS_BLOCK) + bo, c);
+        done += c;
+    }
+    return len;
+}
+
+/* Make f's data private, writable blocks: a fresh header if it has none,
+ * or a copy of its first f->size bytes if the data is shared or is a
+ * read-only image. Returns 0, or -2 when memory is exhausted. */
+static int data_own(node_t *f)
+{
+    fs_data_t *old = f->fdata;
+    if (old && old->refs == 1 && !old->image)
+        return 0;
+    fs_data_t *d = data_alloc();
+    if (!d)
+        return -2;
+    if (old)
+    {
+        for (size_t pos = 0; pos < f->size; pos += FS_BLOCK)
+        {
+            if (block_add(d) < 0)
+            {
+                blocks_trim(d, 0);
+                d->refs = 0;
+                return -2;
+            }
+            data_read(old, f->size, block_get(d, pos / FS_BLOCK), FS_BLOCK, pos);
+        }
+        data_put(f);
+    }
+    f->fdata = d;
+    return 0;
+}
+
+static int mem_pread(node_t *f, char *out, size_t len, size_t off, fs_ra_t *ra)
+{
+    (void)ra;
+    if (!f->fdata)
+        return 0;
+    return (int)data_read(f->fdata, f->size, out, len, off);
+}
+
+static int mem_pwrite(node_t *f, const char *data, size_t len, size_t off)
+{
+    size_t end = off + len;
+    if (end < off || end > FS_MAX_BLOCKS * FS_BLOCK)
+        return -2;
+    if (!len)
+        return 0;
+    if (data_own(f) < 0)
+        return -2;
+    fs_data_t *d = f->fdata;
+    while (d->nblocks * FS_BLOCK < end)
+        if (block_add(d) < 0)
+            return -2;
+    for (size_t done = 0; done < len;)
+    {
+        size_t bo = (off + done) % FS_BLOCK;
+        size_t c = FS_BLOCK - bo;
+        if (c > len - done)
+            c = len - done;
+        kmemcpy(block_get(d, (off + done) / FS_BLOCK) + bo, data + done, c);
+        done += c;
+    }
+    if (end > f->size)
+        f->size = end;
+    return (int)len;
+}
+
+/* Shrinking frees whole blocks past the new end. */
+static int mem_truncate(node_t *f, size_t size)
+{
+    if (size >= f->size)
+    {
+        if (size == f->size)
+            return 0;
+        if (data_own(f) < 0)
+            return -2;
+        fs_data_t *d = f->fdata;
+        while (d->nblocks * FS_BLOCK < size)
+            if (block_add(d) < 0)
+                return -2;
+        f->size = size;
+        return 0;
+    }
+    if (size == 0)
+    {
+        data_put(f);
+        f->size = 0;
+        return 0;
+    }
+    fs_data_t *d = f->fdata;
+    if (d->refs > 1 || d->image)
+    {
+        /* copy only what survives */
+        f->size = size;
+        return data_own(f);
+    }
+    blocks_trim(d, (size + FS_BLOCK - 1) / FS_BLOCK);
+    if (size % FS_BLOCK)
+    {
+        char *last = block_get(d, size / FS_BLOCK);
+        kmemset(last + size % FS_BLOCK, 0, FS_BLOCK - size % FS_BLOCK);
+    }
+    f->size = size;
+    return 0;
+}
+
+/* Back f with size bytes the fs does not own and never frees, such as a
+ * binary embedded in the kernel image. The first write copies them. */
+int fs_attach(node_t *f, const char *image, size_t size)
+{
+    if (!f || f->type != NODE_FILE || !is_mem(f))
+        return -1;
+    fs_data_t *d = data_alloc();
+    if (!d)
+        return -2;
+    data_put(f);
+    d->image = image;
+    f->fdata = d;
+    f->size = size;
+    return 0;
+}
+
+static const char *mem_data_at(node_t *f, size_t off, size_t *len)
+{
+    if (!f->fdata || off >= f->size)
+        return 0;
+    fs_data_t *d = f->fdata;
+    size_t n = f->size - off;
+    if (d->image)
+    {
+        *len = n;
+        return d->image + off;
+    }
+    size_t bo = off % FS_BLOCK;
+    *len = FS_BLOCK - bo < n ? FS_BLOCK - bo : n;
+    return block_get(d, off / FS_BLOCK) + bo;
+}
+
+/* Make dst a copy of src by sharing src's data: O(1) in time and space
+ * whatever the size. Either file copies on its first write. Only memory
+ * files can share; with any other on either side this fails, and callers
+ * copy the bytes (fs_copy_file) instead. */
+int fs_reflink(node_t *dst, node_t *src)
+{
+    if (!dst || !src || dst->type != NODE_FILE || src->type != NODE_FILE)
+        return -1;
+    if (dst == src)
+        return 0;
+    if (!is_mem(dst) || !is_mem(src))
+        return -1;
+    fs_data_t *d = src->fdata;
+    if (d)
+        d->refs++;
+    data_put(dst);
+    dst->fdata = d;
+    dst->size = src->size;
+    return 0;
+}
+
+const fs_file_ops_t fs_mem_file_ops = {mem_pread, mem_pwrite, mem_truncate, mem_data_at, 0};
+
+/* An unlinked memory file's blocks go back to the allocator. */
+void fs_mem_release(node_t *n)
+{
+    if (n->type == NODE_FILE)
+        mem_truncate(n, 0);
+}
+
+size_t fs_data_blocks(void)
+{
+    return blocks_used;
+}
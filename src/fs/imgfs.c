@@ -0,0 +1,215 @@
+#include "fs.h"
+#include "imgfs.h"
+#include "lz4.h"
+#include "../kernel/kprint.h"
+#include "../kernel/string.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/* imgfs: a read-only filesystem served from a compressed image (layout in
+ * imgfs.h) the boot loader leaves in memory. A directory's entries come
+ * in from the entry table the first time it is looked inside. File data
+ * is decompressed into the page cache, which serves it from then on like
+ * any disk file's, so a tool run twice is decompressed once. The image is
+ * checked whole at mount, so reads trust its tables. */
+
+#define NO_BLOCK 0xFFFFFFFFu
+
+static const uint8_t *image;
+static size_t image_len;
+static const imgfs_super_t *hdr;
+static const imgfs_inode_t *inodes;
+static const imgfs_dirent_t *dirents;
+static const imgfs_blk_t *blks;
+static const imgfs_frag_t *frags;
+static const char *names;
+
+/* The block decompressed last, by its offset in the image. Pages of one
+ * block are usually asked for together or one after another, so a block
+ * is decompressed once for all of them. Decompression never sleeps, so
+ * nothing else can use the buffer meanwhile. */
+static uint8_t blockbuf[IMGFS_BLOCK_MAX];
+static uint32_t buf_off = NO_BLOCK;
+
+static int table_ok(uint32_t off, uint32_t n, size_t size)
+{
+    return off % 4 == 0 && off <= image_len && n <= (image_len - off) / size;
+}
+
+static int check_image(void)
+{
+    if (image_len < sizeof(imgfs_super_t))
+        return -1;
+    hdr = (const imgfs_super_t *)image;
+    uint32_t bs = hdr->block_size;
+    if (kstrncmp(hdr->magic, IMGFS_MAGIC, 8) != 0 || bs < IMGFS_BLOCK_MIN || bs > IMGFS_BLOCK_MAX ||
+        (bs & (bs - 1)) || hdr->size > image_len || !hdr->ninodes)
+        return -1;
+    if (!table_ok(hdr->inode_off, hdr->ninodes, sizeof(imgfs_inode_t)) ||
+        !table_ok(hdr->dirent_off, hdr->ndirents, sizeof(imgfs_dirent_t)) ||
+        !table_ok(hdr->block_off, hdr->nblocks, sizeof(imgfs_blk_t)) ||
+        !table_ok(hdr->frag_off, hdr->nfrags, sizeof(imgfs_frag_t)) || hdr->names_off > image_len ||
+        hdr->names_len > image_len - hdr->names_off)
+        return -1;
+    inodes = (const imgfs_inode_t *)(image + hdr->inode_off);
+    dirents = (const imgfs_dirent_t *)(image + hdr->dirent_off);
+    blks = (const imgfs_blk_t *)(image + hdr->block_off);
+    frags = (const imgfs_frag_t *)(image + hdr->frag_off);
+    names = (const char *)image + hdr->names_off;
+    if (inodes[IMGFS_ROOT].type != IMGFS_DIR)
+        return -1;
+    for (uint32_t i = 0; i < hdr->ninodes; i++)
+    {
+        const imgfs_inode_t *in = &inodes[i];
+        if (in->type == IMGFS_DIR)
+        {
+            if (in->first > hdr->ndirents || in->size > hdr->ndirents - in->first)
+                return -1;
+            continue;
+        }
+        if (in->type != IMGFS_FILE)
+            return -1;
+        uint32_t full = in->size / bs, tail = in->size % bs;
+        if (in->first > hdr->nblocks || full > hdr->nblocks - in->first)
+            return -1;
+        if (tail && (in->frag >= hdr->nfrags || in->frag_off > frags[in->frag].usize ||
+                     tail > frags[in->frag].usize - in->frag_off))
+            return -1;
+    }
+    for (uint32_t i = 0; i < hdr->ndirents; i++)
+    {
+        const imgfs_dirent_t *d = &dirents[i];
+        if (d->ino >= hdr->ninodes || d->name > hdr->names_len || d->len > hdr->names_len - d->name)
+            return -1;
+    }
+    for (uint32_t i = 0; i < hdr->nfrags; i++)
+        if (frags[i].usize > bs)
+            return -1;
+    return 0;
+}
+
+/* The usize bytes of the block at off: straight from the image when it is
+ * stored raw, else decompressed into blockbuf. 0 if it is corrupt. */
+static const uint8_t *unpack(uint32_t off, uint32_t csize, uint32_t usize)
+{
+    uint32_t len = csize & ~IMGFS_RAW;
+    if (off > image_len || len > image_len - off)
+        return 0;
+    if (csize & IMGFS_RAW)
+        return len == usize ? image + off : 0;
+    if (off == buf_off)
+        return blockbuf;
+    buf_off = NO_BLOCK;
+    if (lz4_decompress(image + off, len, blockbuf, usize) != (int)usize)
+        return 0;
+    buf_off = off;
+    return blockbuf;
+}
+
+static int img_readpages(node_t *f, const size_t *index, uint32_t count, char *const *dst)
+{
+    const imgfs_inode_t *in = &inodes[f->ino];
+    uint32_t bs = hdr->block_size;
+    size_t full = in->size / bs;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        size_t pos = index[i] * FS_BLOCK;
+        kmemset(dst[i], 0, FS_BLOCK);
+        if (pos >= in->size)
+            continue;
+        size_t n = in->size - pos < FS_BLOCK ? in->size - pos : FS_BLOCK;
+        const uint8_t *src;
+        if (pos / bs < full)
+        {
+            const imgfs_blk_t *b = &blks[in->first + pos / bs];
+            src = unpack(b->off, b->csize, bs);
+            if (src)
+                src += pos % bs;
+        }
+        else
+        {
+            /* block_size is a multiple of FS_BLOCK: the page is all tail */
+            const imgfs_frag_t *fr = &frags[in->frag];
+            src = unpack(fr->off, fr->csize, fr->usize);
+            if (src)
+                src += in->frag_off + (pos - full * bs);
+        }
+        if (!src)
+            return -1;
+        kmemcpy(dst[i], src, n);
+    }
+    return 0;
+}
+
+static void img_load(node_t *dir)
+{
+    const imgfs_inode_t *in = &inodes[dir->ino];
+    for (uint32_t i = in->first; i < in->first + in->size; i++)
+    {
+        const imgfs_dirent_t *d = &dirents[i];
+        const imgfs_inode_t *e = &inodes[d->ino];
+        node_t *n = fs_add_entry(dir, names + d->name, d->len, e->type == IMGFS_DIR ? NODE_DIR : NODE_FILE);
+        if (!n)
+            continue; /* name too long, or out of nodes */
+        n->ino = d->ino;
+        if (n->type == NODE_FILE)
+            n->size = e->size;
+    }
+}
+
+static int img_mount(fs_super_t *sb)
+{
+    if (!image)
+        return -1;
+    if (check_image() < 0)
+    {
+        kprintf("[imgfs] bad image\n");
+        return -1;
+    }
+    sb->root->ino = IMGFS_ROOT;
+    kprintf("[imgfs] %u inodes, %u KiB holding %u KiB\n", hdr->ninodes, hdr->size / 1024,
+            hdr->data_size / 1024);
+    return 0;
+}
+
+/* Read-only: nothing can be made, removed, renamed or written. */
+static int img_refuse(node_t *dir, node_t *n)
+{
+    (void)dir;
+    (void)n;
+    return -1;
+}
+
+static int img_rename(node_t *dir, node_t *n, const char *newn)
+{
+    (void)dir;
+    (void)n;
+    (void)newn;
+    return -1;
+}
+
+static int img_pwrite(node_t *f, const char *data, size_t len, size_t off)
+{
+    (void)f;
+    (void)data;
+    (void)len;
+    (void)off;
+    return -1;
+}
+
+static int img_truncate(node_t *f, size_t size)
+{
+    return size == f->size ? 0 : -1;
+}
+
+void imgfs_set(const char *base, size_t len)
+{
+    image = (const uint8_t *)base;
+    image_len = len;
+}
+
+static const fs_super_ops_t img_sops = {0, pcache_drop};
+static const fs_inode_ops_t img_iops = {img_load, img_refuse, img_refuse, img_rename};
+static const fs_file_ops_t img_fops = {pcache_read, img_pwrite, img_truncate, pcache_data_at, img_readpages};
+
+const fs_type_t imgfs_type = {"imgfs", img_mount, &img_sops, &img_iops, &img_fops};
@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+
+/* imgfs image layout, shared by the kernel (src/fs/imgfs.c) and the
+ * packer (tools/mkimgfs.c). All fields are little-endian and every table
+ * starts 4-byte aligned; offsets are from the start of the image.
+ *
+ * A file's data is cut into block_size blocks, each LZ4-compressed on its
+ * own (or stored raw when that is no smaller). The tail that does not
+ * fill a block is packed with other files' tails into a shared fragment
+ * block, so small files cost no block of their own. Each directory's
+ * entries sit together in the entry table, sorted by name. */
+
+#define IMGFS_MAGIC "SNOWIMG1"
+#define IMGFS_BLOCK_MIN 4096
+#define IMGFS_BLOCK_MAX 65536
+#define IMGFS_RAW 0x80000000u    /* in csize: stored uncompressed */
+#define IMGFS_NOFRAG 0xFFFFFFFFu
+#define IMGFS_ROOT 0             /* inode of the root directory */
+
+#define IMGFS_DIR 1
+#define IMGFS_FILE 2
+
+typedef struct
+{
+    char magic[8];
+    uint32_t block_size;          /* power of two, MIN to MAX */
+    uint32_t ninodes, inode_off;  /* imgfs_inode_t[] */
+    uint32_t ndirents, dirent_off; /* imgfs_dirent_t[] */
+    uint32_t nblocks, block_off;  /* imgfs_blk_t[], every file's full blocks */
+    uint32_t nfrags, frag_off;    /* imgfs_frag_t[] */
+    uint32_t names_off, names_len; /* entry names, not NUL-terminated */
+    uint32_t size;                /* of the whole image */
+    uint32_t data_size;           /* file bytes before compression */
+} imgfs_super_t;
+
+typedef struct
+{
+    uint16_t type;     /* IMGFS_DIR or IMGFS_FILE */
+    uint16_t pad;
+    uint32_t size;     /* file: bytes; directory: entries */
+    uint32_t first;    /* file: its first imgfs_blk_t; directory: first entry */
+    uint32_t frag;     /* file: fragment holding the tail, or IMGFS_NOFRAG */
+    uint32_t frag_off; /* file: where in the fragment the tail starts */
+} imgfs_inode_t;
+
+typedef struct
+{
+    uint32_t ino;
+    uint32_t name; /* offset in the name table */
+    uint32_t len;
+} imgfs_dirent_t;
+
+typedef struct
+{
+    uint32_t off;
+    uint32_t csize; /* IMGFS_RAW | block_size when stored raw */
+} imgfs_blk_t;
+
+typedef struct
+{
+    uint32_t off;
+    uint32_t csize; /* IMGFS_RAW | usize when stored raw */
+    uint32_t usize;
+} imgfs_frag_t;
@@ -0,0 +1,140 @@
+#include "fs.h"
+#include "../kernel/kprint.h"
+#include "../kernel/string.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/* initramfs: the root filesystem, served in place from the cpio archive
+ * ("newc" format) the boot loader leaves in memory. Nothing is unpacked at
+ * boot. A directory is filled in from the archive the first time anything
+ * looks inside it, and its files are attached to their bytes in the
+ * archive (fs_attach), so the first write to one makes its private copy.
+ * Beyond that it is a tmpfs.
+ *
+ * A directory from the archive keeps its path there in data (ino bytes,
+ * no trailing slash), so one renamed before it is loaded still loads.
+ * Directories made after boot start out loaded and never look. */
+
+#define CPIO_HDR 110
+#define CPIO_S_IFMT 0170000
+#define CPIO_S_IFDIR 0040000
+#define CPIO_S_IFREG 0100000
+
+typedef struct
+{
+    const char *name; /* without a leading "./" or "/" */
+    size_t namelen;
+    uint32_t mode;
+    const char *data;
+    size_t size;
+} cpio_ent_t;
+
+static const char *archive;
+static size_t archive_len;
+
+static uint32_t hex8(const char *s)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        char c = s[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9')
+            v |= (uint32_t)(c - '0');
+        else if (c >= 'a' && c <= 'f')
+            v |= (uint32_t)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+            v |= (uint32_t)(c - 'A' + 10);
+    }
+    return v;
+}
+
+/* The entry at *off, moving *off past it. Returns 0 at the trailer or on a
+ * header that does not fit the archive. */
+static int cpio_next(size_t *off, cpio_ent_t *e)
+{
+    size_t o = *off;
+    if (o + CPIO_HDR > archive_len || kstrncmp(archive + o, "07070", 5) != 0)
+        return 0;
+    const char *h = archive + o;
+    e->mode = hex8(h + 14);
+    e->size = hex8(h + 54);
+    size_t namesize = hex8(h + 94);
+    size_t name = o + CPIO_HDR;
+    size_t data = (name + namesize + 3) & ~(size_t)3;
+    if (!namesize || data > archive_len || e->size > archive_len - data)
+        return 0;
+    e->name = archive + name;
+    e->namelen = namesize - 1;
+    if (e->namelen == 10 && kstrncmp(e->name, "TRAILER!!!", 10) == 0)
+        return 0;
+    while (e->namelen && (e->name[0] == '/' || (e->name[0] == '.' && e->namelen > 1 && e->name[1] == '/')))
+    {
+        size_t skip = e->name[0] == '/' ? 1 : 2;
+        e->name += skip;
+        e->namelen -= skip;
+    }
+    if (e->namelen == 1 && e->name[0] == '.')
+        e->namelen = 0;
+    e->data = archive + data;
+    *off = (data + e->size + 3) & ~(size_t)3;
+    return 1;
+}
+
+/* Entries are matched to a directory by path prefix, so one directory
+ * costs a walk over the archive's headers, never over its data. A name
+ * nested deeper than one level still makes the directory it passes
+ * through, for archives that do not list their directories. */
+static void ir_load(node_t *dir)
+{
+    const char *path = dir->data;
+    size_t plen = dir->ino;
+    cpio_ent_t e;
+    for (size_t off = 0; cpio_next(&off, &e);)
+    {
+        if (e.namelen <= plen || (plen && (kstrncmp(e.name, path, plen) != 0 || e.name[plen] != '/')))
+            continue;
+        const char *name = e.name + plen + (plen ? 1 : 0);
+        size_t len = e.namelen - (size_t)(name - e.name);
+        size_t clen = 0;
+        while (clen < len && name[clen] != '/')
+            clen++;
+        int sub = clen < len;
+        uint32_t fmt = e.mode & CPIO_S_IFMT;
+        if (!clen || (!sub && fmt != CPIO_S_IFDIR && fmt != CPIO_S_IFREG))
+            continue; /* a kind of file we lack */
+        if (dindex_find(dir, name, clen))
+            continue;
+        node_t *n = fs_add_entry(dir, name, clen, sub || fmt == CPIO_S_IFDIR ? NODE_DIR : NODE_FILE);
+        if (!n)
+            continue;
+        if (n->type == NODE_DIR)
+        {
+            n->data = (char *)e.name;
+            n->ino = (unsigned)(name + clen - e.name);
+        }
+        else
+            fs_attach(n, e.data, e.size);
+    }
+}
+
+static int ir_mount(fs_super_t *sb)
+{
+    if (!archive)
+        return -1;
+    sb->root->data = 0;
+    sb->root->ino = 0;
+    return 0;
+}
+
+void initramfs_set(const char *base, size_t len)
+{
+    archive = base;
+    archive_len = len;
+    kprintf("[initramfs] %u bytes at %x\n", (unsigned)len, (unsigned)(uintptr_t)base);
+}
+
+static const fs_super_ops_t ir_sops = {0, fs_mem_release};
+static const fs_inode_ops_t ir_iops = {ir_load, 0, 0, 0};
+
+const fs_type_t initramfs_type = {"initramfs", ir_mount, &ir_sops, &ir_iops, &fs_mem_file_ops};
@@ -0,0 +1,59 @@
+#include "lz4.h"
+
+/* A block is a run of sequences: a token (literal count in the high
+ * nibble, match length - 4 in the low one, 15 meaning more length bytes
+ * follow), the literals, then a two-byte little-endian offset back into
+ * the output. The last sequence has literals only. Every length and
+ * offset is checked, so a corrupt block fails instead of running off
+ * either buffer. */
+
+static int more_len(const uint8_t **ip, const uint8_t *end, size_t *len)
+{
+    uint8_t b;
+    do
+    {
+        if (*ip >= end)
+            return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+int lz4_decompress(const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstcap)
+{
+    const uint8_t *ip = src, *end = src + srclen;
+    uint8_t *op = dst, *oend = dst + dstcap;
+    while (ip < end)
+    {
+        uint8_t token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15 && more_len(&ip, end, &lit) < 0)
+            return -1;
+        if (lit > (size_t)(end - ip) || lit > (size_t)(oend - op))
+            return -1;
+        for (size_t i = 0; i < lit; i++)
+            op[i] = ip[i];
+        ip += lit;
+        op += lit;
+        if (ip == end)
+            break;
+        if (end - ip < 2)
+            return -1;
+        size_t off = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (!off || off > (size_t)(op - dst))
+            return -1;
+        size_t ml = token & 15;
+        if (ml == 15 && more_len(&ip, end, &ml) < 0)
+            return -1;
+        ml += 4;
+        if (ml > (size_t)(oend - op))
+            return -1;
+        const uint8_t *m = op - off;
+        for (size_t i = 0; i < ml; i++) /* may overlap: byte by byte */
+            op[i] = m[i];
+        op += ml;
+    }
+    return (int)(op - dst);
+}
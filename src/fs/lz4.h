@@ -0,0 +1,11 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* LZ4 block format (src/fs/lz4.c): no frame header, no checksum. Also
+ * built into the host packer (tools/mkimgfs.c), so it needs nothing from
+ * the kernel. */
+
+/* Decompress srclen bytes into at most dstcap: the decompressed length,
+ * or -1 if the input is corrupt or does not fit. */
+int lz4_decompress(const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstcap);
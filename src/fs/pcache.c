@@ -0,0 +1,446 @@
+#include "fs.h"
+#include "../kernel/string.h"
+#include "pmm.h"
+#include "sched.h"
+#include "irq.h"
+#include "softirq.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/* Page cache for files whose filesystem has a readpages op (ext2, imgfs):
+ * FS_BLOCK-sized pages of file data, found by (node, page index) through
+ * one hash and chained off the node so that truncate and release can find
+ * a file's pages. Reads are served from the pages by copy; misses are
+ * gathered and handed to readpages together, which for ext2 means as few
+ * disk transfers as the layout allows.
+ *
+ * Writes go through to the filesystem (and the block cache) first and
+ * are then copied into any cached page they touch, so a page always
+ * matches what a read from the disk would return. Bytes of the last page
+ * past the end of the file are zero.
+ *
+ * A page being read is busy: it is hashed, so nobody reads it twice, but
+ * anyone wanting its bytes sleeps on pwait until the read finishes.
+ * Read-ahead pages are made busy by the reader and filled on the kworker,
+ * so a sequential reader finds them ready, or at least in flight. */
+
+#define PCACHE_PAGES 2048 /* 8 MiB of file data */
+#define PCACHE_HASH 1024
+#define RA_MIN 4          /* pages in the first read-ahead window */
+#define RA_MAX 32         /* the window doubles up to this */
+#define RA_QUEUE 8        /* read-ahead requests waiting for the kworker */
+
+typedef struct page
+{
+    node_t *node;
+    size_t index;
+    struct page *hnext;
+    struct page *nnext; /* node->pages */
+    struct page *lru_prev, *lru_next;
+    int busy;
+    int failed; /* the read behind a busy page went wrong */
+    char *data;
+} page_t;
+
+/* Pages of one node to be read together, in ascending index order */
+typedef struct
+{
+    node_t *node;
+    uint32_t npages;
+    size_t index[RA_MAX];
+    char *dst[RA_MAX];
+    page_t *pages[RA_MAX];
+} fill_t;
+
+static page_t pages[PCACHE_PAGES];
+static int npages_used; /* pages[] given a data page so far */
+static page_t *hash[PCACHE_HASH];
+static page_t *lru_head, *lru_tail;
+static waitq_t pwait;
+static pcache_stats_t stats;
+
+static fill_t ra_queue[RA_QUEUE];
+static int ra_head, ra_count;
+static work_t ra_work;
+static int ra_work_ready;
+static fill_t sync_fill; /* the reader's own misses, under fill_lock */
+static kmutex_t fill_lock;
+static char bounce[FS_BLOCK]; /* when no page can be had, under fill_lock */
+
+static uint32_t phash(const node_t *n, size_t index)
+{
+    return (uint32_t)(((uintptr_t)n >> 6) * 31 + index) % PCACHE_HASH;
+}
+
+static void lru_unlink(page_t *p)
+{
+    if (p->lru_prev)
+        p->lru_prev->lru_next = p->lru_next;
+    else
+        lru_head = p->lru_next;
+    if (p->lru_next)
+        p->lru_next->lru_prev = p->lru_prev;
+    else
+        lru_tail = p->lru_prev;
+}
+
+static void lru_push(page_t *p)
+{
+    p->lru_prev = 0;
+    p->lru_next = lru_head;
+    if (lru_head)
+        lru_head->lru_prev = p;
+    else
+        lru_tail = p;
+    lru_head = p;
+}
+
+static page_t *find(const node_t *n, size_t index)
+{
+    for (page_t *p = hash[phash(n, index)]; p; p = p->hnext)
+        if (p->node == n && p->index == index)
+            return p;
+    return 0;
+}
+
+/* Take p out of the hash and its node's list; it stays on the LRU, where
+ * a page with no node is the first to be reused. */
+static void unhash(page_t *p)
+{
+    for (page_t **pp = &hash[phash(p->node, p->index)]; *pp; pp = &(*pp)->hnext)
+        if (*pp == p)
+        {
+            *pp = p->hnext;
+            break;
+        }
+    for (page_t **pp = (page_t **)&p->node->pages; *pp; pp = &(*pp)->nnext)
+        if (*pp == p)
+        {
+            *pp = p->nnext;
+            break;
+        }
+    p->node = 0;
+    lru_unlink(p);
+    p->lru_next = 0;
+    p->lru_prev = lru_tail;
+    if (lru_tail)
+        lru_tail->lru_next = p;
+    else
+        lru_head = p;
+    lru_tail = p;
+    stats.pages--;
+}
+
+static void wait_ready(page_t *p)
+{
+    uint64_t flags = irq_save();
+    while (p->busy)
+        waitq_sleep(&pwait);
+    irq_restore(flags);
+}
+
+/* A busy page for index of n, or 0 when every page is busy or memory is
+ * out. Never sleeps, so the caller's view of the hash stays good. */
+static page_t *page_new(node_t *n, size_t index)
+{
+    page_t *p = 0;
+    if (npages_used < PCACHE_PAGES)
+    {
+        char *data = pmm_alloc_page();
+        if (data)
+        {
+            p = &pages[npages_used++];
+            p->data = data;
+            lru_push(p);
+        }
+    }
+    if (!p)
+    {
+        for (p = lru_tail; p && p->busy; p = p->lru_prev)
+            ;
+        if (!p)
+            return 0;
+        if (p->node)
+        {
+            unhash(p);
+            stats.evictions++;
+        }
+    }
+    p->node = n;
+    p->index = index;
+    p->busy = 1;
+    p->failed = 0;
+    p->hnext = hash[phash(n, index)];
+    hash[phash(n, index)] = p;
+    p->nnext = (page_t *)n->pages;
+    n->pages = p;
+    lru_unlink(p);
+    lru_push(p);
+    stats.pages++;
+    return p;
+}
+
+static void fill_add(fill_t *f, page_t *p)
+{
+    f->node = p->node;
+    f->index[f->npages] = p->index;
+    f->dst[f->npages] = p->data;
+    f->pages[f->npages++] = p;
+}
+
+static int readpages(node_t *n, const size_t *index, uint32_t count, char *const *dst)
+{
+    const fs_file_ops_t *ops = n->sb ? n->sb->type->fops : 0;
+    if (!ops || !ops->readpages)
+        return -1;
+    return ops->readpages(n, index, count, dst);
+}
+
+/* Read f's pages and release them to their readers. */
+static void fill_run(fill_t *f)
+{
+    int r = readpages(f->node, f->index, f->npages, f->dst);
+    for (uint32_t i = 0; i < f->npages; i++)
+    {
+        page_t *p = f->pages[i];
+        if (r < 0)
+            p->failed = 1;
+        else if (p->node)
+        {
+            /* keep the tail past the end of the file zero */
+            size_t start = p->index * FS_BLOCK;
+            if (start + FS_BLOCK > p->node->size)
+            {
+                size_t keep = p->node->size > start ? p->node->size - start : 0;
+                kmemset(p->data + keep, 0, FS_BLOCK - keep);
+            }
+        }
+        p->busy = 0;
+    }
+    f->npages = 0;
+    waitq_wake_all(&pwait);
+}
+
+static void ra_work_fn(void *arg)
+{
+    (void)arg;
+    while (ra_count)
+    {
+        fill_t *f = &ra_queue[ra_head];
+        fill_run(f);
+        ra_head = (ra_head + 1) % RA_QUEUE;
+        ra_count--;
+    }
+}
+
+/* Start reading pages [start, end) of n in the background; pages already
+ * cached are skipped, and the request is dropped if the queue is full. */
+static void readahead(node_t *n, size_t start, size_t end)
+{
+    if (ra_count == RA_QUEUE)
+        return;
+    if (!ra_work_ready)
+    {
+        work_init(&ra_work, ra_work_fn, 0);
+        ra_work_ready = 1;
+    }
+    fill_t *f = &ra_queue[(ra_head + ra_count) % RA_QUEUE];
+    for (size_t i = start; i < end && f->npages < RA_MAX; i++)
+    {
+        if (find(n, i))
+            continue;
+        page_t *p = page_new(n, i);
+        if (!p)
+            break;
+        fill_add(f, p);
+        stats.readahead++;
+    }
+    if (!f->npages)
+        return;
+    ra_count++;
+    schedule_work(&ra_work);
+}
+
+/* Sequential-access detection on an open file, after a read of pages
+ * [first, last]. A read starting in the page where the last one ended
+ * opens a window of RA_MIN pages past it, doubling to RA_MAX; once the
+ * reader is within half a window of what has been asked for, the next
+ * window is started. Any other read clears the state, so random access
+ * reads only what it asks for. */
+static void ra_update(node_t *n, fs_ra_t *ra, size_t first, size_t last)
+{
+    size_t npages = (n->size + FS_BLOCK - 1) / FS_BLOCK;
+    if (first != ra->next)
+    {
+        ra->win = 0;
+        ra->end = 0;
+        return;
+    }
+    if (!ra->win)
+    {
+        ra->win = RA_MIN;
+        ra->end = last + 1;
+    }
+    if (ra->end < last + 1)
+        ra->end = last + 1;
+    if (last + ra->win / 2 >= ra->end && ra->end < npages)
+    {
+        size_t end = ra->end + ra->win < npages ? ra->end + ra->win : npages;
+        readahead(n, ra->end, end);
+        ra->end = end;
+        if (ra->win < RA_MAX)
+            ra->win *= 2;
+    }
+}
+
+/* The ready page for index of n, reading it and the missing pages after
+ * it up to last in one go. 0 if it cannot be had. */
+static page_t *page_get(node_t *n, size_t index, size_t last)
+{
+    for (;;)
+    {
+        page_t *p = find(n, index);
+        if (p && p->busy)
+        {
+            stats.hits++; /* already on its way */
+            wait_ready(p);
+            continue; /* it may have failed, or been dropped */
+        }
+        if (p && p->failed)
+        {
+            unhash(p);
+            return 0;
+        }
+        if (p)
+        {
+            stats.hits++;
+            lru_unlink(p);
+            lru_push(p);
+            return p;
+        }
+        kmutex_lock(&fill_lock);
+        if (find(n, index))
+        {
+            kmutex_unlock(&fill_lock); /* read in while we waited */
+            continue;
+        }
+        stats.misses++;
+        fill_t *f = &sync_fill;
+        for (size_t i = index; i <= last && f->npages < RA_MAX && (i == index || !find(n, i)); i++)
+        {
+            page_t *q = page_new(n, i);
+            if (!q)
+                break;
+            fill_add(f, q);
+        }
+        int got = f->npages != 0;
+        if (got)
+            fill_run(f);
+        kmutex_unlock(&fill_lock);
+        if (!got)
+            return 0;
+    }
+}
+
+int pcache_read(node_t *n, char *out, size_t len, size_t off, fs_ra_t *ra)
+{
+    if (off >= n->size)
+        return 0;
+    if (len > n->size - off)
+        len = n->size - off;
+    if (!len)
+        return 0;
+    size_t first = off / FS_BLOCK, last = (off + len - 1) / FS_BLOCK;
+    size_t done = 0;
+    while (done < len)
+    {
+        size_t pos = off + done;
+        size_t bo = pos % FS_BLOCK;
+        size_t c = FS_BLOCK - bo < len - done ? FS_BLOCK - bo : len - done;
+        page_t *p = page_get(n, pos / FS_BLOCK, last);
+        if (p)
+            kmemcpy(out + done, p->data + bo, c);
+        else
+        {
+            /* no page to be had: read around the cache */
+            size_t index = pos / FS_BLOCK;
+            char *dst = bounce;
+            kmutex_lock(&fill_lock);
+            int r = readpages(n, &index, 1, &dst);
+            if (r == 0)
+                kmemcpy(out + done, bounce + bo, c);
+            kmutex_unlock(&fill_lock);
+            if (r < 0)
+                break;
+        }
+        done += c;
+    }
+    if (ra && done)
+    {
+        ra_update(n, ra, first, (off + done - 1) / FS_BLOCK);
+        ra->next = (off + done) / FS_BLOCK;
+    }
+    return done ? (int)done : -1;
+}
+
+const char *pcache_data_at(node_t *n, size_t off, size_t *len)
+{
+    if (off >= n->size)
+        return 0;
+    page_t *p = page_get(n, off / FS_BLOCK, off / FS_BLOCK);
+    if (!p)
+        return 0;
+    size_t c = FS_BLOCK - off % FS_BLOCK;
+    *len = c < n->size - off ? c : n->size - off;
+    return p->data + off % FS_BLOCK;
+}
+
+void pcache_write(node_t *n, const char *data, size_t len, size_t off)
+{
+    for (size_t done = 0; done < len;)
+    {
+        size_t pos = off + done;
+        size_t bo = pos % FS_BLOCK;
+        size_t c = FS_BLOCK - bo < len - done ? FS_BLOCK - bo : len - done;
+        page_t *p = find(n, pos / FS_BLOCK);
+        if (p && p->busy)
+        {
+            wait_ready(p);
+            continue;
+        }
+        if (p)
+            kmemcpy(p->data + bo, data + done, c);
+        done += c;
+    }
+}
+
+void pcache_truncate(node_t *n, size_t size)
+{
+    size_t keep = (size + FS_BLOCK - 1) / FS_BLOCK;
+    page_t *p = (page_t *)n->pages;
+    while (p)
+    {
+        if (p->busy)
+        {
+            wait_ready(p);
+            p = (page_t *)n->pages; /* the list may have changed */
+            continue;
+        }
+        page_t *next = p->nnext;
+        if (p->index >= keep)
+            unhash(p);
+        else if (p->index == size / FS_BLOCK)
+            kmemset(p->data + size % FS_BLOCK, 0, FS_BLOCK - size % FS_BLOCK);
+        p = next;
+    }
+}
+
+void pcache_drop(node_t *n)
+{
+    pcache_truncate(n, 0);
+}
+
+void pcache_get_stats(pcache_stats_t *s)
+{
+    *s = stats;
+}
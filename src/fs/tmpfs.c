@@ -0,0 +1,11 @@
+#include "fs.h"
+
+/* tmpfs: files and directories that exist only in memory. The node tree
+ * is the whole filesystem, so there is nothing to load or create; file
+ * contents are the memory blocks of src/fs/fs_data.c. The root of the
+ * tree is a tmpfs too. */
+
+static const fs_super_ops_t tmpfs_sops = {0, fs_mem_release};
+static const fs_inode_ops_t tmpfs_iops = {0, 0, 0, 0};
+
+const fs_type_t tmpfs_type = {"tmpfs", 0, &tmpfs_sops, &tmpfs_iops, &fs_mem_file_ops};
@@ -0,0 +1,554 @@
+#include "fs.h"
+#include "../kernel/kprint.h"
+#include "../kernel/string.h"
+#include "pmm.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/* The VFS: one tree of nodes for every mounted volume, one node allocator,
+ * one name index (dcache.c). Which filesystem a node belongs to is
+ * node->sb; everything that needs the volume itself, such as reading a
+ * directory in from the disk or writing a file, goes through the tables
+ * of sb->type.
+ *
+ * A volume is mounted over a directory: the directory keeps its place in
+ * its parent, with mounted pointing at the volume, and every lookup that
+ * lands on it steps onto the volume's root instead. The root takes the
+ * covered directory's name and parent, so "..", getdents and the cwd path
+ * climb out of the volume as if it were an ordinary subdirectory. */
+
+static fs_super_t mounts[FS_MOUNT_MAX];
+static int nmounts;
+static node_t root;
+static node_t *cwd;
+static node_t *node_free; /* recycled nodes, chained through sibling */
+static int nlive = 0;
+
+static const fs_inode_ops_t *iops(const node_t *n)
+{
+    return n->sb ? n->sb->type->iops : 0;
+}
+
+static const fs_file_ops_t *fops(const node_t *n)
+{
+    return n->sb ? n->sb->type->fops : 0;
+}
+
+/* A zeroed node off the free list, which is refilled a page of nodes at a
+ * time. */
+static node_t *node_alloc(void)
+{
+    if (!node_free)
+    {
+        node_t *page = pmm_alloc_page();
+        if (!page)
+            return 0;
+        for (size_t i = 0; i < FS_BLOCK / sizeof(node_t); i++)
+        {
+            page[i].sibling = node_free;
+            node_free = &page[i];
+        }
+    }
+    node_t *n = node_free;
+    node_free = n->sibling;
+    kmemset(n, 0, sizeof(*n));
+    dcache_retire(n);
+    nlive++;
+    return n;
+}
+
+static void node_free_one(node_t *n)
+{
+    kmemset(n, 0, sizeof(*n));
+    n->sibling = node_free;
+    node_free = n;
+    nlive--;
+}
+
+/* Free a node that is neither linked into a directory nor open. */
+static void node_release(node_t *n)
+{
+    const fs_super_ops_t *ops = n->sb ? n->sb->type->sops : 0;
+    if (ops && ops->release)
+        ops->release(n);
+    node_free_one(n);
+}
+
+/* Open files and the cwd pin a node, so an unlinked file stays readable
+ * until its last user lets go. Pipe and epoll nodes live inside their own
+ * objects and are not counted. */
+void fs_node_get(node_t *n)
+{
+    if (n->type != NODE_PIPE && n->type != NODE_EPOLL)
+        n->refs++;
+}
+
+void fs_node_put(node_t *n)
+{
+    if (n->type == NODE_PIPE || n->type == NODE_EPOLL)
+        return;
+    if (--n->refs == 0 && !n->nlink)
+        node_release(n);
+}
+
+static node_t *link_child(node_t *p, node_t *n)
+{
+    n->parent = p;
+    n->nlink = 1;
+    n->sibling = p->child;
+    if (n->sibling)
+        n->sibling->psibling = &n->sibling;
+    n->psibling = &p->child;
+    p->child = n;
+    dindex_add(n);
+    return n;
+}
+
+/* Step onto whatever volume is mounted over n. */
+static node_t *cross(node_t *n)
+{
+    while (n && n->mounted)
+        n = n->mounted->root;
+    return n;
+}
+
+/* A directory's entries are read in the first time anything looks inside
+ * it; after that the node tree is kept in step with the volume. */
+static void load(node_t *dir)
+{
+    if (dir->type == NODE_DIR && !dir->loaded)
+    {
+        dir->loaded = 1;
+        if (iops(dir) && iops(dir)->load)
+            iops(dir)->load(dir);
+    }
+}
+
+static node_t *find_in(node_t *p, const char *name)
+{
+    load(p);
+    return dindex_find(p, name, kstrlen(name));
+}
+
+node_t *fs_add_entry(node_t *dir, const char *name, size_t len, node_type_t type)
+{
+    if (len >= sizeof(dir->name))
+        return 0;
+    node_t *n = node_alloc();
+    if (!n)
+        return 0;
+    kmemcpy(n->name, name, len);
+    n->type = type;
+    n->sb = dir->sb;
+    n->loaded = type != NODE_DIR; /* a directory's entries come later */
+    return link_child(dir, n);
+}
+
+/* A new child of parent, backed by parent's filesystem. */
+static node_t *new_child(node_t *parent, const char *name, node_type_t type)
+{
+    node_t *n = node_alloc();
+    if (!n)
+        return 0;
+    kstrncpy(n->name, name, 31);
+    n->type = type;
+    n->sb = parent->sb;
+    n->loaded = 1; /* empty */
+    const fs_inode_ops_t *ops = iops(parent);
+    if (ops && ops->create && ops->create(parent, n) < 0)
+    {
+        node_free_one(n);
+        return 0;
+    }
+    return link_child(parent, n);
+}
+
+int fs_mount(const char *path, const fs_type_t *type)
+{
+    if (nmounts == FS_MOUNT_MAX)
+        return -1;
+    node_t *dir = 0;
+    if (nmounts)
+    {
+        dir = fs_lookup(&root, path);
+        if (!dir || dir->type != NODE_DIR || dir == &root)
+            return -1;
+    }
+    fs_super_t *sb = &mounts[nmounts];
+    kmemset(sb, 0, sizeof(*sb));
+    sb->type = type;
+    kstrncpy(sb->path, path, sizeof(sb->path) - 1);
+    node_t *r = dir ? node_alloc() : &root;
+    if (!r)
+        return -1;
+    r->type = NODE_DIR;
+    r->nlink = 1; /* never released */
+    r->sb = sb;
+    if (dir)
+    {
+        kstrcpy(r->name, dir->name);
+        r->parent = dir->parent;
+    }
+    else
+        kstrcpy(r->name, "/");
+    sb->root = r;
+    sb->covered = dir;
+    if (type->mount && type->mount(sb) < 0)
+    {
+        if (dir)
+            node_free_one(r);
+        return -1;
+    }
+    nmounts++;
+    if (dir)
+    {
+        fs_node_get(dir);
+        dir->mounted = sb;
+    }
+    dcache_invalidate();
+    kprintf("[vfs] %s on %s\n", type->name, path);
+    return 0;
+}
+
+const fs_super_t *fs_mount_at(int i)
+{
+    return i >= 0 && i < nmounts ? &mounts[i] : 0;
+}
+
+/* Mount a volume at /name, making the directory for it if need be; one
+ * made here is taken away again if the volume will not mount. */
+static void mount_on(const char *name, const char *path, const fs_type_t *type)
+{
+    int made = !find_in(&root, name);
+    if (made && !fs_mkdir(&root, name))
+        return;
+    if (fs_mount(path, type) < 0 && made)
+        fs_unlink(&root, name);
+}
+
+/* The root is the initramfs the boot loader passed, or an empty tmpfs
+ * without one; either holds everything made at boot. The compressed
+ * image, if passed too, is /bin. /tmp is a tmpfs of its own, /dev holds
+ * the devices, and the ext2 volume on the disk, if there is one, appears
+ * at /data. */
+void fs_init(void)
+{
+    kmemset(&root, 0, sizeof(root));
+    if (fs_mount("/", &initramfs_type) < 0)
+        fs_mount("/", &tmpfs_type);
+    cwd = &root;
+    fs_node_get(cwd);
+    mount_on("bin", "/bin", &imgfs_type);
+    mount_on("tmp", "/tmp", &tmpfs_type);
+    mount_on("dev", "/dev", &devfs_type);
+    mount_on("data", "/data", &ext2fs_type);
+}
+
+node_t *fs_root(void) { return &root; }
+node_t *fs_cwd(void) { return cwd; }
+void fs_set_cwd(node_t *n)
+{
+    n = cross(n);
+    if (n && n->type == NODE_DIR)
+    {
+        fs_node_get(n);
+        fs_node_put(cwd);
+        cwd = n;
+    }
+}
+
+node_t *fs_mkdir(node_t *parent, const char *name)
+{
+    parent = cross(parent);
+    if (!parent || parent->type != NODE_DIR)
+        return 0;
+    if (find_in(parent, name))
+        return 0;
+    return new_child(parent, name, NODE_DIR);
+}
+
+node_t *fs_create_file(node_t *parent, const char *name)
+{
+    parent = cross(parent);
+    if (!parent || parent->type != NODE_DIR)
+        return 0;
+    node_t *e = find_in(parent, name);
+    if (e)
+        return e->type == NODE_FILE ? e : 0;
+    return new_child(parent, name, NODE_FILE);
+}
+
+node_t *fs_create_chardev(node_t *parent, const char *name, void *devptr)
+{
+    parent = cross(parent);
+    if (!parent || parent->type != NODE_DIR)
+        return 0;
+    node_t *e = find_in(parent, name);
+    if (e)
+        return e->type == NODE_CHAR ? e : 0;
+    node_t *n = new_child(parent, name, NODE_CHAR);
+    if (n)
+        n->data = (char *)devptr;
+    return n;
+}
+
+/* Walk [path, end) from cur one component at a time, straight out of the
+ * caller's string. On a miss, *miss (if given) says where it stopped. */
+static node_t *walk(node_t *cur, const char *path, const char *end, dcache_miss_t *miss)
+{
+    while (path < end)
+    {
+        while (path < end && *path == '/')
+            path++;
+        const char *tok = path;
+        while (path < end && *path != '/')
+            path++;
+        size_t len = (size_t)(path - tok);
+        if (len == 0 || (len == 1 && tok[0] == '.'))
+            continue;
+        if (len == 2 && tok[0] == '.' && tok[1] == '.')
+        {
+            if (cur->parent)
+                cur = cur->parent;
+            continue;
+        }
+        load(cur);
+        node_t *next = cross(dindex_find(cur, tok, len));
+        if (!next)
+        {
+            if (miss)
+            {
+                miss->dir = cur;
+                miss->name = tok;
+                miss->len = len;
+            }
+            return 0;
+        }
+        cur = next;
+    }
+    return cur;
+}
+
+/* Walk path unless the path cache already has the answer. */
+node_t *fs_lookup(node_t *parent, const char *path)
+{
+    if (!path || !*path)
+        return parent;
+    node_t *base = path[0] == '/' ? &root : cross(parent);
+    node_t *cur;
+    if (dcache_get(base, path, &cur))
+        return cur;
+    dcache_miss_t miss = {0, 0, 0};
+    cur = walk(base, path, path + kstrlen(path), &miss);
+    dcache_put(base, path, cur, &miss);
+    return cur;
+}
+
+/* The node of the directory part of path, everything before its last
+ * slash; *name is set to what follows. Walked in place, so path may be of
+ * any length. */
+node_t *fs_lookup_parent(node_t *parent, const char *path, const char **name)
+{
+    const char *slash = 0;
+    for (const char *s = path; *s; s++)
+        if (*s == '/')
+            slash = s;
+    *name = slash ? slash + 1 : path;
+    if (!slash)
+        return cross(parent);
+    return walk(path[0] == '/' ? &root : cross(parent), path, slash, 0);
+}
+
+node_t *fs_find_child(node_t *parent, const char *name)
+{
+    parent = cross(parent);
+    if (!parent || parent->type != NODE_DIR)
+        return 0;
+    return cross(find_in(parent, name));
+}
+
+/* Start of a directory listing (children chain through sibling). A mount
+ * point is listed as itself; looking it up gives the volume. */
+node_t *fs_first_child(node_t *dir)
+{
+    dir = cross(dir);
+    if (!dir)
+        return 0;
+    load(dir);
+    return dir->child;
+}
+
+/* Remove name from parent. The node is freed now, or at its last
+ * fs_node_put if it is still open. Directories must be empty, and a mount
+ * point stays while its volume is mounted. The entry is found through the
+ * name index and unlinked through psibling, so the cost does not grow with
+ * the directory. */
+int fs_unlink(node_t *parent, const char *name)
+{
+    parent = cross(parent);
+    if (!parent || parent->type != NODE_DIR)
+        return -1;
+    node_t *c = find_in(parent, name);
+    if (!c || c->mounted || (c->type == NODE_DIR && fs_first_child(c)))
+        return -1;
+    const fs_inode_ops_t *ops = iops(parent);
+    if (ops && ops->unlink && ops->unlink(parent, c) < 0)
+        return -1;
+    dindex_del(c);
+    *c->psibling = c->sibling;
+    if (c->sibling)
+        c->sibling->psibling = c->psibling;
+    c->parent = 0;
+    c->sibling = 0;
+    c->psibling = 0;
+    c->nlink = 0;
+    if (!c->refs)
+        node_release(c);
+    return 0;
+}
+
+int fs_rename(node_t *parent, const char *oldn, const char *newn)
+{
+    parent = cross(parent);
+    if (!parent || parent->type != NODE_DIR)
+        return -1;
+    node_t *n = find_in(parent, oldn);
+    if (!n || n->mounted)
+        return -1;
+    if (find_in(parent, newn))
+        return -2;
+    const fs_inode_ops_t *ops = iops(parent);
+    if (ops && ops->rename && ops->rename(parent, n, newn) < 0)
+        return -1;
+    dindex_del(n);
+    kstrncpy(n->name, newn, 31);
+    dindex_add(n);
+    return 0;
+}
+
+node_t *fs_clone_file(node_t *parent, node_t *src, const char *newname)
+{
+    parent = cross(parent);
+    if (!parent || parent->type != NODE_DIR || !src || src->type != NODE_FILE)
+        return 0;
+    if (find_in(parent, newname))
+        return 0;
+    node_t *n = new_child(parent, newname, NODE_FILE);
+    if (n && fs_reflink(n, src) < 0 && fs_copy_file(n, src) < 0)
+    {
+        /* out of data headers or out of space: no half-made copy */
+        fs_unlink(parent, n->name);
+        return 0;
+    }
+    return n;
+}
+
+/* ---- file data, through the file's filesystem ---- */
+
+int fs_pread_ra(node_t *f, char *out, size_t len, size_t off, fs_ra_t *ra)
+{
+    if (!f || f->type != NODE_FILE || !fops(f))
+        return 0;
+    return fops(f)->pread(f, out, len, off, ra);
+}
+
+int fs_pread(node_t *f, char *out, size_t len, size_t off)
+{
+    return fs_pread_ra(f, out, len, off, 0);
+}
+
+/* Write len bytes at off, growing the file as needed; a gap past the old
+ * end reads back as zeros. Returns len, or -2 when the volume is full. */
+int fs_pwrite(node_t *f, const char *data, size_t len, size_t off)
+{
+    if (!f || f->type != NODE_FILE || !fops(f))
+        return -1;
+    return fops(f)->pwrite(f, data, len, off);
+}
+
+/* Replace (append=0) or extend (append=1) the file's contents. Returns 0,
+ * or -2 when the volume is full. */
+int fs_write(node_t *f, const char *data, size_t len, int append)
+{
+    if (!f || f->type != NODE_FILE)
+        return -1;
+    if (!append)
+        fs_truncate(f, 0);
+    int r = fs_pwrite(f, data, len, f->size);
+    return r < 0 ? r : 0;
+}
+
+int fs_read(node_t *f, char *out, size_t max)
+{
+    return fs_pread(f, out, max, 0);
+}
+
+/* Set the file's size. Shrinking frees what lies past the new end;
+ * growing zero-fills. */
+int fs_truncate(node_t *f, size_t size)
+{
+    if (!f || f->type != NODE_FILE || !fops(f))
+        return -1;
+    return fops(f)->truncate(f, size);
+}
+
+/* Contiguous bytes of f at off: returns a pointer and sets *len to the
+ * count up to the end of that block (or of the file), or returns 0 at EOF.
+ * The pointer is good until the file is next written or truncated; for a
+ * disk file it points into the page cache, good until the caller next
+ * sleeps or calls in here, so copy out before anything that can block. */
+const char *fs_data_at(node_t *f, size_t off, size_t *len)
+{
+    if (!f || f->type != NODE_FILE || !fops(f))
+        return 0;
+    return fops(f)->data_at(f, off, len);
+}
+
+/* Make dst's contents a byte copy of src's, for files that cannot share
+ * (fs_reflink). Goes through a page of our own: a disk write sleeps, and
+ * the page cache may reuse the source's page meanwhile. Returns 0, -1 on
+ * a read error or -2 when dst's volume is full. */
+int fs_copy_file(node_t *dst, node_t *src)
+{
+    if (!dst || !src || dst->type != NODE_FILE || src->type != NODE_FILE || dst == src)
+        return -1;
+    char *buf = pmm_alloc_page();
+    if (!buf)
+        return -2;
+    int r = fs_truncate(dst, 0);
+    const char *p;
+    size_t n, off;
+    for (off = 0; r >= 0 && (p = fs_data_at(src, off, &n)); off += n)
+    {
+        if (n > FS_BLOCK)
+            n = FS_BLOCK;
+        kmemcpy(buf, p, n);
+        r = fs_pwrite(dst, buf, n, off);
+    }
+    pmm_free_page(buf);
+    if (r >= 0 && off < src->size)
+        r = -1; /* a read failed short of the end */
+    return r < 0 ? r : 0;
+}
+
+int fs_sync(node_t *n)
+{
+    int r = 0;
+    for (int i = 0; i < nmounts; i++)
+    {
+        fs_super_t *sb = &mounts[i];
+        if (n && n->sb != sb)
+            continue;
+        if (sb->type->sops && sb->type->sops->sync && sb->type->sops->sync(sb) < 0)
+            r = -1;
+    }
+    return r;
+}
+
+void fs_stats(size_t *out_nodes, size_t *out_blocks)
+{
+    if (out_nodes)
+        *out_nodes = (size_t)nlive;
+    if (out_blocks)
+        *out_blocks = fs_data_blocks();
+}
@@ -1,5 +1,9 @@
 #include "ata.h"
 #include "kprint.h"
+#include "irq.h"
+#include "pic.h"
+#include "timer.h"
+#include "sched.h"
 #include <stdint.h>
 
 #define ATA_IO_BASE 0x1F0
@@ -13,9 +17,14 @@
 #define ATA_REG_COMMAND 0x07
 #define ATA_REG_STATUS 0x07
 #define ATA_REG_CONTROL 0x206
+#define ATA_REG_ALTSTATUS 0x206
+
+#define ATA_IRQ 14
+#define ATA_TIMEOUT_MS 1000
 
 #define ATA_CMD_READ_SECT 0x20
 #define ATA_CMD_WRITE_SECT 0x30
+#define ATA_CMD_FLUSH_CACHE 0xE7
 
 static inline void outb(uint16_t p, uint8_t v) { __asm__ __volatile__("outb %0,%1" ::"a"(v), "Nd"(p)); }
 static inline uint8_t inb(uint16_t p)
@@ -27,46 +36,124 @@ static inline uint8_t inb(uint16_t p)
 static inline void rep_insw(uint16_t port, void *addr, int cnt) { __asm__ __volatile__("rep insw" : "=D"(addr), "=c"(cnt) : "d"(port), "0"(addr), "1"(cnt) : "memory"); }
 static inline void rep_outsw(uint16_t port, const void *addr, int cnt) { __asm__ __volatile__("rep outsw" ::"d"(port), "S"(addr), "c"(cnt) : "memory"); }
 
+static int irq_installed = 0;
+static kmutex_t ata_lock; /* one command at a time: waits let other threads run */
+
+static void ata_irq(void)
+{
+    (void)inb(ATA_IO_BASE + ATA_REG_STATUS); // reading STATUS acks the drive
+}
+
+static void ata_irq_setup(void)
+{
+    if (irq_installed)
+        return;
+    irq_installed = 1;
+    irq_install_handler(ATA_IRQ, ata_irq);
+    outb(ATA_IO_BASE + ATA_REG_CONTROL, 0x00); // nIEN=0: raise IRQ14 on DRQ
+    pic_clear_mask(2);                         // cascade to the slave PIC
+    pic_clear_mask(ATA_IRQ);
+}
+
+static int drq_or_error(void *arg)
+{
+    (void)arg;
+    uint8_t s = inb(ATA_IO_BASE + ATA_REG_ALTSTATUS);
+    return (!(s & 0x80) && (s & 0x08)) || (s & 0x01);
+}
+
+static int not_busy(void *arg)
+{
+    (void)arg;
+    return !(inb(ATA_IO_BASE + ATA_REG_ALTSTATUS) & 0x80);
+}
+
+/* A new command must wait out the last one, such as a write still going
+ * to the media after its data was handed over. */
+static int ata_wait_idle(void)
+{
+    return timer_wait_event(not_busy, 0, ATA_TIMEOUT_MS);
+}
+
+/* Sleep until the drive raises DRQ (IRQ14 wakes us) or the timeout fires. */
 static int ata_wait_drq(void)
 {
-    for (;;)
-    {
-        uint8_t s = inb(ATA_IO_BASE + ATA_REG_STATUS);
-        if (!(s & 0x80) && (s & 0x08))
-            return 0; // not busy & DRQ
-        if (s & 0x01)
-            return -1; // error
-    }
+    if (timer_wait_event(drq_or_error, 0, ATA_TIMEOUT_MS) != 0)
+        return -1; // timeout
+    uint8_t s = inb(ATA_IO_BASE + ATA_REG_ALTSTATUS);
+    if (s & 0x01)
+        return -1; // error
+    return 0;
 }
 
-int ata_read28(uint32_t lba, void *buf)
+/* Issue one command for count sectors (1 to 256) and move the data, a
+ * sector per DRQ; the caller holds ata_lock. One command for a whole run
+ * saves the per-command round trip on every sector after the first. */
+static int ata_rw(uint32_t lba, unsigned count, void *buf, uint8_t cmd)
 {
-    if (lba & 0xF0000000)
+    if (!count || count > ATA_MAX_SECTORS || ((lba + count - 1) & 0xF0000000))
         return -1;
+    ata_irq_setup();
+    if (ata_wait_idle() != 0)
+        return -2;
     outb(ATA_IO_BASE + ATA_REG_HDDEVSEL, 0xE0 | ((lba >> 24) & 0x0F));
-    outb(ATA_IO_BASE + ATA_REG_SECCOUNT0, 1);
+    outb(ATA_IO_BASE + ATA_REG_SECCOUNT0, (uint8_t)count); // 0 means 256
     outb(ATA_IO_BASE + ATA_REG_LBA0, (uint8_t)(lba));
     outb(ATA_IO_BASE + ATA_REG_LBA1, (uint8_t)(lba >> 8));
     outb(ATA_IO_BASE + ATA_REG_LBA2, (uint8_t)(lba >> 16));
-    outb(ATA_IO_BASE + ATA_REG_COMMAND, ATA_CMD_READ_SECT);
-    if (ata_wait_drq() != 0)
-        return -2;
-    rep_insw(ATA_IO_BASE + ATA_REG_DATA, buf, 256);
+    outb(ATA_IO_BASE + ATA_REG_COMMAND, cmd);
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (ata_wait_drq() != 0)
+            return -2;
+        char *p = (char *)buf + i * 512;
+        if (cmd == ATA_CMD_READ_SECT)
+            rep_insw(ATA_IO_BASE + ATA_REG_DATA, p, 256);
+        else
+            rep_outsw(ATA_IO_BASE + ATA_REG_DATA, p, 256);
+    }
     return 0;
 }
 
+int ata_read(uint32_t lba, unsigned count, void *buf)
+{
+    kmutex_lock(&ata_lock);
+    int r = ata_rw(lba, count, buf, ATA_CMD_READ_SECT);
+    kmutex_unlock(&ata_lock);
+    return r;
+}
+
+int ata_write(uint32_t lba, unsigned count, const void *buf)
+{
+    kmutex_lock(&ata_lock);
+    int r = ata_rw(lba, count, (void *)buf, ATA_CMD_WRITE_SECT);
+    kmutex_unlock(&ata_lock);
+    return r;
+}
+
+int ata_read28(uint32_t lba, void *buf)
+{
+    return ata_read(lba, 1, buf);
+}
+
 int ata_write28(uint32_t lba, const void *buf)
 {
-    if (lba & 0xF0000000)
-        return -1;
-    outb(ATA_IO_BASE + ATA_REG_HDDEVSEL, 0xE0 | ((lba >> 24) & 0x0F));
-    outb(ATA_IO_BASE + ATA_REG_SECCOUNT0, 1);
-    outb(ATA_IO_BASE + ATA_REG_LBA0, (uint8_t)(lba));
-    outb(ATA_IO_BASE + ATA_REG_LBA1, (uint8_t)(lba >> 8));
-    outb(ATA_IO_BASE + ATA_REG_LBA2, (uint8_t)(lba >> 16));
-    outb(ATA_IO_BASE + ATA_REG_COMMAND, ATA_CMD_WRITE_SECT);
-    if (ata_wait_drq() != 0)
-        return -2;
-    rep_outsw(ATA_IO_BASE + ATA_REG_DATA, buf, 256);
-    return 0;
+    return ata_write(lba, 1, buf);
+}
+
+/* Have the drive commit its write cache to the media. */
+int ata_flush(void)
+{
+    kmutex_lock(&ata_lock);
+    ata_irq_setup();
+    int r = ata_wait_idle() != 0 ? -2 : 0;
+    if (r == 0)
+    {
+        outb(ATA_IO_BASE + ATA_REG_HDDEVSEL, 0xE0);
+        outb(ATA_IO_BASE + ATA_REG_COMMAND, ATA_CMD_FLUSH_CACHE);
+        if (ata_wait_idle() != 0 || (inb(ATA_IO_BASE + ATA_REG_ALTSTATUS) & 0x01))
+            r = -2;
+    }
+    kmutex_unlock(&ata_lock);
+    return r;
 }
@@ -0,0 +1,311 @@
+#include "bcache.h"
+#include "ata.h"
+#include "pmm.h"
+#include "sched.h"
+#include "irq.h"
+#include "timer.h"
+#include "softirq.h"
+#include <stdint.h>
+
+/* Buffers are found through a hash on (dev, lba) and kept on one LRU list,
+ * most recently used first. A miss takes a never-used buffer while there
+ * are any, then the least recently used one nobody holds, writing it
+ * first if it is dirty. A buffer with a transfer in flight is busy; other
+ * threads wait for it on bwait rather than touch its data.
+ *
+ * Kernel threads switch only when one blocks, so the lists need no lock;
+ * the only blocking points are the disk transfers. */
+
+#define BCACHE_HASH 512
+
+static buf_t bufs[BCACHE_NBUF];
+static int nbufs; /* bufs[] given a data page so far */
+static buf_t *hash[BCACHE_HASH];
+static buf_t *lru_head, *lru_tail;
+static waitq_t bwait;
+static bcache_stats_t stats;
+static ktimer_t flush_timer;
+static work_t flush_work;
+
+static uint32_t bhash(int dev, uint32_t lba)
+{
+    return (lba * 2654435761u ^ (uint32_t)dev) % BCACHE_HASH;
+}
+
+static void lru_unlink(buf_t *b)
+{
+    if (b->lru_prev)
+        b->lru_prev->lru_next = b->lru_next;
+    else
+        lru_head = b->lru_next;
+    if (b->lru_next)
+        b->lru_next->lru_prev = b->lru_prev;
+    else
+        lru_tail = b->lru_prev;
+}
+
+static void lru_push(buf_t *b)
+{
+    b->lru_prev = 0;
+    b->lru_next = lru_head;
+    if (lru_head)
+        lru_head->lru_prev = b;
+    else
+        lru_tail = b;
+    lru_head = b;
+}
+
+static void hash_del(buf_t *b)
+{
+    for (buf_t **pp = &hash[bhash(b->dev, b->lba)]; *pp; pp = &(*pp)->hnext)
+    {
+        if (*pp == b)
+        {
+            *pp = b->hnext;
+            break;
+        }
+    }
+}
+
+static buf_t *hash_find(int dev, uint32_t lba, uint32_t size)
+{
+    for (buf_t *b = hash[bhash(dev, lba)]; b; b = b->hnext)
+        if (b->dev == dev && b->lba == lba && b->size == size)
+            return b;
+    return 0;
+}
+
+static void wait_idle(buf_t *b)
+{
+    uint64_t flags = irq_save();
+    while (b->busy)
+        waitq_sleep(&bwait);
+    irq_restore(flags);
+}
+
+static int dev_io(buf_t *b, int write)
+{
+    if (b->dev != BDEV_ATA)
+        return -1;
+    int r = write ? ata_write(b->lba, b->size / 512, b->data) : ata_read(b->lba, b->size / 512, b->data);
+    return r != 0 ? -1 : 0;
+}
+
+/* Write b out; it stays dirty if the disk refuses. */
+static int writeback(buf_t *b)
+{
+    b->busy = 1;
+    b->dirty = 0;
+    int r = dev_io(b, 1);
+    if (r < 0)
+        b->dirty = 1;
+    else
+        stats.writebacks++;
+    b->busy = 0;
+    waitq_wake_all(&bwait);
+    return r;
+}
+
+/* A buffer nobody holds, off the hash. 0 if every buffer is held or a
+ * dirty one could not be written; also 0, with *wrote set, once a dirty
+ * one has been written back, since the caller slept and must look again. */
+static buf_t *victim(int *wrote)
+{
+    *wrote = 0;
+    if (nbufs < BCACHE_NBUF)
+    {
+        uint8_t *page = pmm_alloc_page();
+        if (page)
+        {
+            buf_t *b = &bufs[nbufs++];
+            b->data = page;
+            lru_push(b);
+            return b;
+        }
+    }
+    for (buf_t *b = lru_tail; b; b = b->lru_prev)
+    {
+        if (b->refs || b->busy)
+            continue;
+        if (b->dirty)
+        {
+            b->refs++;
+            *wrote = writeback(b) == 0;
+            b->refs--;
+            return 0;
+        }
+        hash_del(b);
+        stats.evictions++;
+        return b;
+    }
+    return 0;
+}
+
+buf_t *bget(int dev, uint32_t lba, uint32_t size)
+{
+    for (;;)
+    {
+        buf_t *b = hash_find(dev, lba, size);
+        if (b)
+        {
+            if (b->busy)
+            {
+                wait_idle(b);
+                continue;
+            }
+            b->refs++;
+            lru_unlink(b);
+            lru_push(b);
+            return b;
+        }
+        int wrote;
+        b = victim(&wrote);
+        if (!b && !wrote)
+            return 0; /* every buffer is held, or the disk fails */
+        if (!b)
+            continue;
+        b->dev = dev;
+        b->lba = lba;
+        b->size = size;
+        b->refs = 1;
+        b->valid = 0;
+        b->dirty = 0;
+        b->hnext = hash[bhash(dev, lba)];
+        hash[bhash(dev, lba)] = b;
+        lru_unlink(b);
+        lru_push(b);
+        return b;
+    }
+}
+
+buf_t *bread(int dev, uint32_t lba, uint32_t size)
+{
+    if (!size || size > 4096 || size % 512)
+        return 0;
+    buf_t *b = bget(dev, lba, size);
+    if (!b)
+        return 0;
+    if (b->valid)
+    {
+        stats.hits++;
+        return b;
+    }
+    stats.misses++;
+    b->busy = 1;
+    int r = dev_io(b, 0);
+    b->busy = 0;
+    waitq_wake_all(&bwait);
+    if (r < 0)
+    {
+        brelse(b);
+        return 0;
+    }
+    b->valid = 1;
+    return b;
+}
+
+buf_t *bpeek(int dev, uint32_t lba, uint32_t size)
+{
+    buf_t *b = hash_find(dev, lba, size);
+    if (b && b->busy)
+        wait_idle(b);
+    b = hash_find(dev, lba, size); /* it may have been evicted meanwhile */
+    if (!b || !b->valid || b->busy)
+        return 0;
+    b->refs++;
+    return b;
+}
+
+int bdev_read(int dev, uint32_t lba, uint32_t count, void *buf)
+{
+    if (dev != BDEV_ATA)
+        return -1;
+    while (count)
+    {
+        uint32_t n = count < ATA_MAX_SECTORS ? count : ATA_MAX_SECTORS;
+        if (ata_read(lba, n, buf) != 0)
+            return -1;
+        lba += n;
+        count -= n;
+        buf = (char *)buf + n * 512;
+    }
+    return 0;
+}
+
+void bdirty(buf_t *b)
+{
+    b->valid = 1;
+    b->dirty = 1;
+}
+
+void brelse(buf_t *b)
+{
+    if (b && b->refs > 0)
+        b->refs--;
+}
+
+int bwrite(buf_t *b)
+{
+    b->valid = 1;
+    return writeback(b);
+}
+
+/* Write back the dirty buffers of dev (all devices for -1) nobody holds.
+ * bufs[] does not move, so the walk survives the sleeps in writeback. */
+static int flush_dirty(int dev)
+{
+    int err = 0;
+    for (int i = 0; i < nbufs; i++)
+    {
+        buf_t *b = &bufs[i];
+        if (b->busy)
+            wait_idle(b);
+        if (!b->dirty || (dev >= 0 && b->dev != dev))
+            continue;
+        b->refs++;
+        if (writeback(b) < 0)
+            err = -1;
+        b->refs--;
+    }
+    return err;
+}
+
+int bcache_sync(int dev)
+{
+    int r = flush_dirty(dev);
+    if (dev == BDEV_ATA && ata_flush() != 0)
+        r = -1;
+    return r;
+}
+
+static void flush_work_fn(void *arg)
+{
+    (void)arg;
+    flush_dirty(-1);
+    timer_add(&flush_timer, ticks + timer_ms_to_ticks(BCACHE_FLUSH_MS));
+}
+
+static void flush_timer_fn(void *arg)
+{
+    (void)arg;
+    schedule_work(&flush_work);
+}
+
+/* Start the periodic write-back; the cache itself works from the first
+ * bread, before the work queue is up. */
+void bcache_init(void)
+{
+    work_init(&flush_work, flush_work_fn, 0);
+    timer_setup(&flush_timer, flush_timer_fn, 0);
+    timer_add(&flush_timer, ticks + timer_ms_to_ticks(BCACHE_FLUSH_MS));
+}
+
+void bcache_get_stats(bcache_stats_t *s)
+{
+    *s = stats;
+    s->nbuf = (uint32_t)nbufs;
+    s->ndirty = 0;
+    for (int i = 0; i < nbufs; i++)
+        if (bufs[i].dirty)
+            s->ndirty++;
+}
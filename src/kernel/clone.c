@@ -0,0 +1,128 @@
+#include "syscall.h"
+#include "sched.h"
+#include "proc.h"
+#include "futex.h"
+#include "kprint.h"
+#include <stdint.h>
+
+/* User threads: clone() children share the parent's process_t (address
+ * space and fd table) and run on their own kernel thread and stack. */
+
+extern void trap_return(trap_frame_t *tf);
+
+static void clone_child_start(void *arg)
+{
+    (void)arg;
+    thread_t *t = thread_current();
+    trap_frame_t tf = t->uregs;
+    __asm__ volatile("cli");
+    trap_return(&tf);
+}
+
+long sys_clone(unsigned long flags, uint64_t newsp, int *ptid, int *ctid, uint64_t tls)
+{
+    thread_t *self = thread_current();
+    process_t *p = proc_current();
+    if (!self || !self->tf || !p)
+        return -1;
+    /* only threads for now: a separate address space needs fork() */
+    if (!(flags & CLONE_VM) || !newsp)
+        return -1;
+    thread_t *t = kthread_create(clone_child_start, 0, "uthread");
+    if (!t)
+        return -1;
+    t->proc = p;
+    t->is_clone = 1;
+    t->uregs = *self->tf;
+    t->uregs.rax = 0;
+    t->uregs.rsp = newsp;
+    t->fs_base = (flags & CLONE_SETTLS) ? tls : self->fs_base;
+    if (flags & CLONE_CHILD_CLEARTID)
+        t->clear_tid = ctid;
+    if ((flags & CLONE_PARENT_SETTID) && ptid)
+        *ptid = t->tid;
+    if ((flags & CLONE_CHILD_SETTID) && ctid)
+        *ctid = t->tid;
+    return t->tid;
+}
+
+/* End the calling clone thread; wakes a joiner waiting on clear_tid. */
+static void thread_exit_user(void)
+{
+    thread_t *t = thread_current();
+    if (t->clear_tid)
+    {
+        *t->clear_tid = 0;
+        futex_wake(t->clear_tid, 1);
+    }
+    kthread_exit();
+}
+
+/* Checked before every return to user mode. */
+void thread_check_killed(void)
+{
+    thread_t *t = thread_current();
+    if (!t || !t->killed)
+        return;
+    if (t->is_clone)
+        thread_exit_user();
+    process_t *p = proc_current();
+    sys_exit(p ? p->exit_code : 0);
+}
+
+/* exit(): a clone thread ends alone; the main thread takes the process down. */
+long sys_exit_thread(int code)
+{
+    thread_t *t = thread_current();
+    if (t && t->is_clone)
+        thread_exit_user();
+    return sys_exit(code);
+}
+
+long sys_exit_group(int code)
+{
+    thread_t *t = thread_current();
+    process_t *p = proc_current();
+    if (p)
+    {
+        p->exit_code = code;
+        sched_kill_process(p);
+    }
+    if (t && t->is_clone)
+        thread_exit_user();
+    return sys_exit(code);
+}
+
+long sys_arch_prctl(int code, uint64_t addr)
+{
+    thread_t *t = thread_current();
+    switch (code)
+    {
+    case ARCH_SET_FS:
+        t->fs_base = addr;
+        thread_activate(t);
+        return 0;
+    case ARCH_GET_FS:
+        if (!addr)
+            return -1;
+        *(uint64_t *)(uintptr_t)addr = t->fs_base;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+long sys_set_tid_address(int *tidptr)
+{
+    thread_t *t = thread_current();
+    t->clear_tid = tidptr;
+    return t->tid;
+}
+
+long sys_gettid(void) { return thread_current()->tid; }
+
+long sys_sched_yield(void)
+{
+    sched_yield();
+    return 0;
+}
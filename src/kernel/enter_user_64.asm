@@ -7,12 +7,12 @@ enter_user:
     mov     cr3, rcx
 
     ; Segment selectors for user mode
-    mov     ax, 0x23            ; user data selector (index 4, RPL=3)
+    mov     ax, 0x1B            ; user data selector (index 3, RPL=3)
     mov     ds, ax
     mov     es, ax
     mov     fs, ax
     mov     gs, ax
-    mov     r8, 0x1B            ; user code selector (index 3, RPL=3)
+    mov     r8, 0x23            ; user code selector (index 4, RPL=3)
 
     ; Build an iretq frame on current kernel stack to transition
     ; Stack layout (top->bottom as pushed):
@@ -22,13 +22,13 @@ enter_user:
     ;   RSP (user stack pointer)
     ;   SS  (user data selector | RPL=3)
 
-    push    qword 0x23          ; SS already includes RPL=3
+    push    qword 0x1B          ; SS already includes RPL=3
     push    rsi                 ; user stack pointer
     pushfq
     pop     rax
     or      eax, 0x200          ; ensure IF=1
     push    rax
-    push    qword 0x1B          ; CS already includes RPL=3
+    push    qword 0x23          ; CS already includes RPL=3
     push    rdi                 ; RIP = entry point
 
     xor     rax, rax
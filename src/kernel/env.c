@@ -1,10 +1,11 @@
 #include "env.h"
 #include "kprint.h"
 #include "string.h"
-#include "ata.h"
+#include "bcache.h"
 
 #define ENV_MAX 64
 #define ENV_KV_MAX 96
+#define ENV_LBA 16
 static char env_store[ENV_MAX][ENV_KV_MAX];
 static int env_count = 0;
 static int initialized = 0;
@@ -38,9 +39,10 @@ void env_init(void)
     // default path
     env_set("PATH=/bin");
 
-    unsigned char sector[512];
-    if (ata_read28(16, sector) == 0)
+    buf_t *b = bread(BDEV_ATA, ENV_LBA, 512);
+    if (b)
     {
+        const unsigned char *sector = b->data;
         if (sector[0] == 'E' && sector[1] == 'N' && sector[2] == 'V' && sector[3] == '0')
         {
             int c = sector[4];
@@ -64,6 +66,7 @@ void env_init(void)
                 off += len;
             }
         }
+        brelse(b);
     }
 }
 
@@ -172,5 +175,12 @@ int env_save(void)
             sector[off + j] = (unsigned char)kv[j];
         off += len;
     }
-    return ata_write28(16, sector);
+    // written through: env_save is the user asking for it on disk now
+    buf_t *b = bget(BDEV_ATA, ENV_LBA, 512);
+    if (!b)
+        return -1;
+    kmemcpy(b->data, sector, 512);
+    int r = bwrite(b);
+    brelse(b);
+    return r;
 }
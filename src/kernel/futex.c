@@ -0,0 +1,151 @@
+#include "futex.h"
+#include "irq.h"
+#include "timer.h"
+#include <stdint.h>
+
+/* Futex wait queues hashed by user address. Waiters are threads linked
+ * through thread_t; a key only matches waiters of the same process since
+ * the address is virtual. All queue updates run with interrupts off. */
+#define FUTEX_HASH_BITS 6
+#define FUTEX_HASH_SIZE (1 << FUTEX_HASH_BITS)
+
+static thread_t *futex_queues[FUTEX_HASH_SIZE];
+
+static inline unsigned futex_hash(uint64_t key)
+{
+    return (unsigned)(((key >> 2) * 0x9E3779B97F4A7C15ULL) >> (64 - FUTEX_HASH_BITS));
+}
+
+static void queue_remove(thread_t *t)
+{
+    thread_t **pp = &futex_queues[futex_hash(t->futex_key)];
+    while (*pp && *pp != t)
+        pp = &(*pp)->futex_next;
+    if (*pp)
+        *pp = t->futex_next;
+    t->futex_next = 0;
+    t->futex_key = 0;
+}
+
+struct futex_timeout
+{
+    thread_t *t;
+    int expired;
+};
+
+static void futex_timeout_fn(void *arg)
+{
+    struct futex_timeout *to = (struct futex_timeout *)arg;
+    uint64_t flags = irq_save();
+    if (to->t->futex_key)
+    {
+        queue_remove(to->t);
+        to->expired = 1;
+        sched_wakeup(to->t);
+    }
+    irq_restore(flags);
+}
+
+/* Sleep while *uaddr == val. Returns 0 when woken, -1 if the value already
+ * differed or the timeout (in ticks, 0 = none) expired. */
+int futex_wait(int *uaddr, int val, uint64_t timeout_ticks)
+{
+    thread_t *t = thread_current();
+    uint64_t key = (uint64_t)(uintptr_t)uaddr;
+    struct futex_timeout to = {t, 0};
+    ktimer_t timer;
+    uint64_t flags = irq_save();
+    if (*(volatile int *)uaddr != val)
+    {
+        irq_restore(flags);
+        return -1;
+    }
+    /* append so wakeups are FIFO */
+    thread_t **pp = &futex_queues[futex_hash(key)];
+    while (*pp)
+        pp = &(*pp)->futex_next;
+    t->futex_key = key;
+    t->futex_next = 0;
+    t->futex_woken = 0;
+    *pp = t;
+    if (timeout_ticks)
+    {
+        timer_setup(&timer, futex_timeout_fn, &to);
+        timer_add(&timer, ticks + timeout_ticks);
+    }
+    while (!t->futex_woken && !to.expired)
+        sched_block();
+    irq_restore(flags);
+    if (timeout_ticks)
+        timer_del(&timer);
+    return to.expired ? -1 : 0;
+}
+
+/* Wake up to n waiters on uaddr; returns how many were woken. */
+int futex_wake(int *uaddr, int n)
+{
+    thread_t *self = thread_current();
+    uint64_t key = (uint64_t)(uintptr_t)uaddr;
+    int woken = 0;
+    uint64_t flags = irq_save();
+    thread_t **pp = &futex_queues[futex_hash(key)];
+    while (*pp && woken < n)
+    {
+        thread_t *t = *pp;
+        if (t->futex_key != key || t->proc != self->proc)
+        {
+            pp = &t->futex_next;
+            continue;
+        }
+        *pp = t->futex_next;
+        t->futex_next = 0;
+        t->futex_key = 0;
+        t->futex_woken = 1;
+        sched_wakeup(t);
+        woken++;
+    }
+    irq_restore(flags);
+    return woken;
+}
+
+/* Pull a waiter off its queue (thread being killed). */
+void futex_cancel(thread_t *t)
+{
+    uint64_t flags = irq_save();
+    if (t->futex_key)
+    {
+        queue_remove(t);
+        t->futex_woken = 1;
+        sched_wakeup(t);
+    }
+    irq_restore(flags);
+}
+
+long sys_futex(int *uaddr, int op, int val, const struct kernel_timespec *timeout, int *uaddr2, int val3)
+{
+    (void)uaddr2;
+    (void)val3;
+    if (!uaddr || ((uintptr_t)uaddr & 3))
+        return -1;
+    switch (op & FUTEX_CMD_MASK)
+    {
+    case FUTEX_WAIT:
+    {
+        uint64_t tmo = 0;
+        if (timeout)
+        {
+            if (timeout->tv_sec < 0 || timeout->tv_nsec < 0 || timeout->tv_nsec >= (int64_t)NSEC_PER_SEC)
+                return -1;
+            uint64_t ns = (uint64_t)timeout->tv_sec * NSEC_PER_SEC + (uint64_t)timeout->tv_nsec;
+            tmo = (ns + TICK_NSEC - 1) / TICK_NSEC;
+            if (!tmo)
+                tmo = 1;
+        }
+        return futex_wait(uaddr, val, tmo);
+    }
+    case FUTEX_WAKE:
+        return futex_wake(uaddr, val);
+    default:
+        return -1;
+    }
+}
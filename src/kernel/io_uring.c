@@ -0,0 +1,186 @@
+#include "io_uring.h"
+#include "syscall.h"
+#include "proc.h"
+#include "pmm.h"
+#include "vm.h"
+#include "kerrno.h"
+#include "string.h"
+#include <stdint.h>
+
+/* Kernel side of the submission/completion rings (include/io_uring.h). The
+ * ring pages are ordinary process pages, reached here through the identity
+ * map; the ring geometry is kept in kernel memory so a process cannot
+ * change the masks under us. */
+
+typedef struct io_ring
+{
+    process_t *owner;
+    file_t *file; /* the FD_IORING file naming it */
+    struct io_uring_ctl *ctl;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    uint32_t sq_mask, cq_mask, cq_entries;
+    uint32_t sq_head;
+} io_ring_t;
+
+static io_ring_t rings[PROC_MAX];
+
+static void *ring_page(process_t *p, uint64_t va)
+{
+    /* a ring closed earlier left its page mapped here: use it again */
+    uint64_t old = vm_get_phys_pml4(p->pml4_phys, va);
+    if (old)
+    {
+        kmemset((void *)old, 0, 4096);
+        return (void *)old;
+    }
+    void *phys = pmm_alloc_page();
+    if (!phys)
+        return 0;
+    kmemset(phys, 0, 4096);
+    vm_map_page_pml4(p->pml4_phys, va, (uint64_t)phys, PTE_PRESENT | PTE_USER | PTE_WRITABLE);
+    proc_add_allocated_page((uint64_t)phys);
+    return phys;
+}
+
+long sys_io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    process_t *p = proc_current();
+    if (!p || !p->pml4_phys || !params)
+        return -EINVAL;
+    if (p->uring)
+        return -EBUSY;
+    if (entries == 0 || entries > IORING_MAX_ENTRIES)
+        return -EINVAL;
+    uint32_t sq = 1;
+    while (sq < entries)
+        sq <<= 1;
+    io_ring_t *r = 0;
+    for (int i = 0; i < PROC_MAX; i++)
+    {
+        if (!rings[i].owner)
+        {
+            r = &rings[i];
+            break;
+        }
+    }
+    if (!r)
+        return -ENOMEM;
+    int fd = proc_alloc_fd(0);
+    if (fd < 0)
+        return -EMFILE;
+    r->ctl = ring_page(p, IORING_USER_VADDR);
+    r->sqes = ring_page(p, IORING_USER_VADDR + 0x1000);
+    r->cqes = ring_page(p, IORING_USER_VADDR + 0x2000);
+    if (!r->ctl || !r->sqes || !r->cqes)
+    {
+        sys_close(fd);
+        return -ENOMEM;
+    }
+    r->owner = p;
+    r->sq_mask = sq - 1;
+    r->cq_entries = sq * 2;
+    r->cq_mask = r->cq_entries - 1;
+    r->sq_head = 0;
+    r->ctl->sq_mask = r->sq_mask;
+    r->ctl->sq_entries = sq;
+    r->ctl->cq_mask = r->cq_mask;
+    r->ctl->cq_entries = r->cq_entries;
+    p->uring = r;
+    r->file = proc_get_fd(fd);
+    r->file->flags = FD_IORING;
+    params->sq_entries = sq;
+    params->cq_entries = r->cq_entries;
+    params->ctl = IORING_USER_VADDR;
+    params->sqes = IORING_USER_VADDR + 0x1000;
+    params->cqes = IORING_USER_VADDR + 0x2000;
+    return fd;
+}
+
+/* Forget p's ring; its pages go with the rest of the image. */
+void io_uring_release(process_t *p)
+{
+    if (p->uring)
+    {
+        p->uring->owner = 0;
+        p->uring->file = 0;
+        p->uring = 0;
+    }
+}
+
+/* Closing the ring's last fd ends it, so the process may set up another;
+ * that one reuses the pages, which stay mapped until exit. */
+void io_uring_close(file_t *f)
+{
+    for (int i = 0; i < PROC_MAX; i++)
+        if (rings[i].owner && rings[i].file == f)
+            io_uring_release(rings[i].owner);
+}
+
+static long ring_issue(const struct io_uring_sqe *sqe)
+{
+    switch (sqe->opcode)
+    {
+    case IORING_OP_NOP:
+        return 0;
+    case IORING_OP_FSYNC:
+        return sys_fsync(sqe->fd);
+    case IORING_OP_OPENAT:
+        return sys_openat(sqe->fd, (const char *)(uintptr_t)sqe->addr, (int)sqe->op_flags, (int)sqe->len);
+    case IORING_OP_CLOSE:
+        return sys_close(sqe->fd);
+    case IORING_OP_STATX:
+        if (sqe->addr)
+            return sys_stat((const char *)(uintptr_t)sqe->addr, (void *)(uintptr_t)sqe->off);
+        return sys_fstat(sqe->fd, (void *)(uintptr_t)sqe->off);
+    case IORING_OP_READ:
+        if (sqe->off == (uint64_t)-1)
+            return sys_read(sqe->fd, (void *)(uintptr_t)sqe->addr, sqe->len);
+        return sys_pread64(sqe->fd, (void *)(uintptr_t)sqe->addr, sqe->len, (long)sqe->off);
+    case IORING_OP_WRITE:
+        if (sqe->off == (uint64_t)-1)
+            return sys_write(sqe->fd, (const void *)(uintptr_t)sqe->addr, sqe->len);
+        return sys_pwrite64(sqe->fd, (const void *)(uintptr_t)sqe->addr, sqe->len, (long)sqe->off);
+    default:
+        return -EINVAL;
+    }
+}
+
+/* Run up to to_submit queued SQEs. Stops early when the CQ is full. Returns
+ * the number consumed. Every operation has completed on return, so
+ * min_complete and IORING_ENTER_GETEVENTS need no waiting. */
+long sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    (void)min_complete;
+    (void)flags;
+    process_t *p = proc_current();
+    file_t *e = proc_get_fd(fd);
+    if (!p || !e || !(e->flags & FD_IORING) || !p->uring)
+        return -EBADF;
+    io_ring_t *r = p->uring;
+    uint32_t tail = __atomic_load_n(&r->ctl->sq_tail, __ATOMIC_ACQUIRE);
+    uint32_t cq_tail = r->ctl->cq_tail;
+    long done = 0;
+    while ((unsigned)done < to_submit && r->sq_head != tail)
+    {
+        if (cq_tail - __atomic_load_n(&r->ctl->cq_head, __ATOMIC_ACQUIRE) >= r->cq_entries)
+        {
+            r->ctl->cq_overflow++;
+            break;
+        }
+        /* copy: the SQE stays writable by user space while we work */
+        struct io_uring_sqe sqe = r->sqes[r->sq_head & r->sq_mask];
+        struct io_uring_cqe *cqe = &r->cqes[cq_tail & r->cq_mask];
+        cqe->user_data = sqe.user_data;
+        cqe->res = (int32_t)ring_issue(&sqe);
+        cqe->flags = 0;
+        cq_tail++;
+        r->sq_head++;
+        __atomic_store_n(&r->ctl->cq_tail, cq_tail, __ATOMIC_RELEASE);
+        __atomic_store_n(&r->ctl->sq_head, r->sq_head, __ATOMIC_RELEASE);
+        done++;
+    }
+    if (done == 0 && r->sq_head != tail && to_submit)
+        return -EBUSY;
+    return done;
+}
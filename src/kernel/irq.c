@@ -2,17 +2,27 @@
 #include "idt.h"
 #include "pic.h"
 #include "kprint.h"
+#include "softirq.h"
+#include "sched.h"
+#include "syscall.h"
 
 #define IRQ_BASE 0x20
-#define MAX_IRQ 16
+#define MAX_IRQ IRQ_LINES
 
 static void (*irq_handlers[MAX_IRQ])(void);
+static irq_stat_t irq_stats[MAX_IRQ];
 
-void irq_common_dispatch(int irq)
+/* Top halves run with interrupts disabled and only capture device state;
+ * raised softirqs run after the EOI. `frame` is the CPU interrupt frame
+ * (rip, cs, rflags, rsp, ss): an IRQ that arrived in user mode is a
+ * preemption point. */
+void irq_common_dispatch(int irq, uint64_t *frame)
 {
     if (irq < MAX_IRQ && irq_handlers[irq])
     {
+        uint64_t t0 = irq_rdtsc();
         irq_handlers[irq]();
+        irq_stat_add(&irq_stats[irq], irq_rdtsc() - t0);
     }
     else
     {
@@ -24,6 +34,19 @@ void irq_common_dispatch(int irq)
         }
     }
     pic_eoi(irq);
+    softirq_run();
+    if (frame && (frame[1] & 3))
+    {
+        sched_preempt();
+        thread_check_killed();
+    }
+}
+
+const irq_stat_t *irq_get_stats(int irq)
+{
+    if (irq < 0 || irq >= MAX_IRQ)
+        return 0;
+    return &irq_stats[irq];
 }
 
 void irq_install_handler(int irq, void (*h)(void))
@@ -0,0 +1,164 @@
+#include "ktime.h"
+#include "vdso.h"
+#include "timer.h"
+#include "kprint.h"
+#include "kerrno.h"
+#include <stdint.h>
+
+#define CALIBRATE_TICKS 16
+
+static inline void outb(uint16_t p, uint8_t v) { __asm__ __volatile__("outb %0,%1" ::"a"(v), "Nd"(p)); }
+static inline uint8_t inb(uint16_t p)
+{
+    uint8_t r;
+    __asm__ __volatile__("inb %1,%0" : "=a"(r) : "Nd"(p));
+    return r;
+}
+
+static uint8_t cmos_read(uint8_t reg)
+{
+    outb(0x70, reg);
+    return inb(0x71);
+}
+
+static uint64_t days_from_civil(int64_t y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (uint64_t)(era * 146097 + (int64_t)doe - 719468);
+}
+
+/* Wall clock seconds since the epoch from the CMOS RTC (read once at boot). */
+static uint64_t rtc_read_epoch(void)
+{
+    for (int i = 0; i < 10000 && (cmos_read(0x0A) & 0x80); i++)
+        ;
+    unsigned sec = cmos_read(0x00), min = cmos_read(0x02), hour = cmos_read(0x04);
+    unsigned day = cmos_read(0x07), mon = cmos_read(0x08), year = cmos_read(0x09);
+    uint8_t regb = cmos_read(0x0B);
+    int pm = hour & 0x80;
+    hour &= 0x7F;
+    if (!(regb & 0x04))
+    {
+#define BCD(v) (((v) & 0x0F) + ((v) >> 4) * 10)
+        sec = BCD(sec);
+        min = BCD(min);
+        hour = BCD(hour);
+        day = BCD(day);
+        mon = BCD(mon);
+        year = BCD(year);
+#undef BCD
+    }
+    if (!(regb & 0x02) && pm)
+        hour = (hour % 12) + 12;
+    if (mon < 1 || mon > 12 || day < 1 || day > 31)
+        return 0;
+    uint64_t days = days_from_civil(2000 + (int64_t)year, mon, day);
+    return days * 86400 + hour * 3600 + min * 60 + sec;
+}
+
+static uint64_t calib_sum = 0;
+static int calib_ticks = -1;
+
+void ktime_init(void)
+{
+    struct vdso_data *vd = vdso_data();
+    vd->hz = HZ;
+    vd->tick_ns = TICK_NSEC;
+    vd->mono_ns = 0;
+    vd->wall_base = rtc_read_epoch();
+    vd->tsc_last = vdso_rdtsc();
+    kprintf("[time] HZ=%u rtc epoch=%u\n", (unsigned)HZ, (unsigned)vd->wall_base);
+}
+
+/* Timer IRQ: publish the new tick to the vDSO page under the seqcount. The
+ * first CALIBRATE_TICKS intervals calibrate the TSC for sub-tick reads. */
+void ktime_tick(void)
+{
+    struct vdso_data *vd = vdso_data();
+    uint64_t now = vdso_rdtsc();
+    uint64_t delta = now - vd->tsc_last;
+    vd->seq++;
+    __asm__ volatile("" ::: "memory");
+    vd->mono_ns += vd->tick_ns;
+    vd->tsc_last = now;
+    if (calib_ticks < CALIBRATE_TICKS)
+    {
+        if (calib_ticks >= 0)
+            calib_sum += delta;
+        if (++calib_ticks == CALIBRATE_TICKS && calib_sum)
+        {
+            vd->tsc_per_tick = calib_sum / CALIBRATE_TICKS;
+            vd->tsc_mult = (vd->tick_ns << VDSO_TSC_SHIFT) / vd->tsc_per_tick;
+        }
+    }
+    __asm__ volatile("" ::: "memory");
+    vd->seq++;
+}
+
+uint64_t ktime_get_ns(void)
+{
+    struct kernel_timespec ts;
+    vdso_read_clock(vdso_data(), CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+/* TSC cycles to ns using the calibrated multiplier; 0 until calibrated. */
+uint64_t ktime_cycles_to_ns(uint64_t cycles)
+{
+    return (cycles * vdso_data()->tsc_mult) >> VDSO_TSC_SHIFT;
+}
+
+long sys_clock_gettime(int clk, struct kernel_timespec *ts)
+{
+    if (!ts)
+        return -1;
+    /* no per-process accounting yet: CPU-time clocks read the monotonic clock */
+    if (clk == CLOCK_PROCESS_CPUTIME_ID || clk == CLOCK_THREAD_CPUTIME_ID)
+        clk = CLOCK_MONOTONIC;
+    return vdso_read_clock(vdso_data(), clk, ts) == 0 ? 0 : -1;
+}
+
+long sys_gettimeofday(struct kernel_timeval *tv, void *tz)
+{
+    (void)tz;
+    struct kernel_timespec ts;
+    if (!tv)
+        return 0;
+    vdso_read_clock(vdso_data(), CLOCK_REALTIME, &ts);
+    tv->tv_sec = ts.tv_sec;
+    tv->tv_usec = ts.tv_nsec / 1000;
+    return 0;
+}
+
+long sys_time(int64_t *t)
+{
+    struct kernel_timespec ts;
+    vdso_read_clock(vdso_data(), CLOCK_REALTIME_COARSE, &ts);
+    if (t)
+        *t = ts.tv_sec;
+    return (long)ts.tv_sec;
+}
+
+/* Sleep for *req. A thread killed part-way returns -EINTR with the time
+ * it still had to sleep in *rem. */
+long sys_nanosleep(const struct kernel_timespec *req, struct kernel_timespec *rem)
+{
+    if (!req)
+        return -EFAULT;
+    if (req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= (int64_t)NSEC_PER_SEC)
+        return -EINVAL;
+    uint64_t ns = (uint64_t)req->tv_sec * NSEC_PER_SEC + (uint64_t)req->tv_nsec;
+    uint64_t end = ktime_get_ns() + ns;
+    int r = timer_sleep_ticks((ns + TICK_NSEC - 1) / TICK_NSEC);
+    if (rem)
+    {
+        uint64_t now = ktime_get_ns(), left = r < 0 && now < end ? end - now : 0;
+        rem->tv_sec = (int64_t)(left / NSEC_PER_SEC);
+        rem->tv_nsec = (int64_t)(left % NSEC_PER_SEC);
+    }
+    return r < 0 ? -EINTR : 0;
+}
@@ -1,8 +1,12 @@
 #include "mouse.h"
 #include "kprint.h"
 #include "irq.h"
+#include "timer.h"
+#include "softirq.h"
 #include <stdint.h>
 
+#define PS2_TIMEOUT_MS 50
+
 static int mx = 0, my = 0; /* absolute position */
 static int mb = 0;         /* buttons */
 static int init_done = 0;
@@ -15,22 +19,18 @@ static inline uint8_t inb(uint16_t port)
     return v;
 }
 
-static void ps2_wait_write(void)
+static int ps2_can_write(void *arg)
 {
-    for (int i = 0; i < 100000; i++)
-    {
-        if (!(inb(0x64) & 0x02))
-            return;
-    }
+    (void)arg;
+    return !(inb(0x64) & 0x02);
 }
-static void ps2_wait_read(void)
+static int ps2_can_read(void *arg)
 {
-    for (int i = 0; i < 100000; i++)
-    {
-        if (inb(0x64) & 0x01)
-            return;
-    }
+    (void)arg;
+    return inb(0x64) & 0x01;
 }
+static void ps2_wait_write(void) { timer_wait_event(ps2_can_write, 0, PS2_TIMEOUT_MS); }
+static void ps2_wait_read(void) { timer_wait_event(ps2_can_read, 0, PS2_TIMEOUT_MS); }
 static void ps2_write_aux(uint8_t val)
 {
     ps2_wait_write();
@@ -54,35 +54,62 @@ static uint8_t packet[3];
 static int packet_index = 0;
 
 static int dbg_counter = 0;
+
+/* Bytes captured by the IRQ; packets are assembled in the softirq. */
+#define MOUSE_RAW_SIZE 64
+static uint8_t raw_buf[MOUSE_RAW_SIZE];
+static volatile uint32_t raw_head = 0, raw_tail = 0;
+
 static void mouse_irq(void)
 {
     uint8_t status = inb(0x64);
     if (!(status & 0x20))
         return; /* not from mouse */
     uint8_t data = inb(0x60);
-    packet[packet_index++] = data;
-    if (packet_index == 3)
+    if (raw_head - raw_tail < MOUSE_RAW_SIZE)
+        raw_buf[raw_head++ % MOUSE_RAW_SIZE] = data;
+    softirq_raise(SOFTIRQ_MOUSE);
+}
+
+static void mouse_packet(void)
+{
+    uint8_t b = packet[0];
+    int dx = (int)((int8_t)packet[1]);
+    int dy = (int)((int8_t)packet[2]);
+    mx += dx;
+    my -= dy; /* y is inverted */
+    if (mx < 0)
+        mx = 0;
+    if (my < 0)
+        my = 0;
+    if (mx > 1023)
+        mx = 1023;
+    if (my > 767)
+        my = 767; /* clamp to current mode (assumed) */
+    mb = ((b & 1) ? 1 : 0) | ((b & 2) ? 2 : 0) | ((b & 4) ? 4 : 0);
+    if (++dbg_counter % 50 == 0)
+        kprintf("[mouse] pkt b=%x dx=%d dy=%d mx=%d my=%d btn=%x\n", b, dx, dy, mx, my, mb);
+}
+
+static void mouse_softirq(void)
+{
+    while (1)
     {
-        packet_index = 0;
-        uint8_t b = packet[0];
-        int dx = (int)((int8_t)packet[1]);
-        int dy = (int)((int8_t)packet[2]);
-        mx += dx;
-        my -= dy; /* y is inverted */
-        if (mx < 0)
-            mx = 0;
-        if (my < 0)
-            my = 0;
-        if (mx > 1023)
-            mx = 1023;
-        if (my > 767)
-            my = 767; /* clamp to current mode (assumed) */
-        mb = ((b & 1) ? 1 : 0) | ((b & 2) ? 2 : 0) | ((b & 4) ? 4 : 0);
-        if (++dbg_counter % 50 == 0)
-            kprintf("[mouse] pkt b=%x dx=%d dy=%d mx=%d my=%d btn=%x\n", b, dx, dy, mx, my, mb);
+        uint64_t flags = irq_save();
+        if (raw_tail == raw_head)
+        {
+            irq_restore(flags);
+            break;
+        }
+        uint8_t data = raw_buf[raw_tail++ % MOUSE_RAW_SIZE];
+        irq_restore(flags);
+        packet[packet_index++] = data;
+        if (packet_index == 3)
+        {
+            packet_index = 0;
+            mouse_packet();
+        }
     }
-    outb(0x20, 0x20); /* EOI PIC1 */
-    outb(0xA0, 0x20); /* EOI PIC2 */
 }
 
 void mouse_init(void)
@@ -113,6 +140,7 @@ void mouse_init(void)
     ack = mouse_command(0xF4);
     if (ack != 0xFA)
         kprintf("[mouse] F4 no ACK (%x)\n", ack);
+    softirq_register(SOFTIRQ_MOUSE, mouse_softirq);
     irq_install_handler(12, mouse_irq);
     kprintf("[mouse] initialized (IRQ12 handler installed)\n");
 }
@@ -0,0 +1,420 @@
+#include "pipe.h"
+#include "proc.h"
+#include "pmm.h"
+#include "irq.h"
+#include "kerrno.h"
+#include "kfcntl.h"
+#include "string.h"
+#include <stdint.h>
+
+/* Pipes: a 64 KiB ring spread over PIPE_PAGES physical pages. Readers block
+ * while the ring is empty and a writer remains; writers block while it is
+ * full and a reader remains. Writes of at most PIPE_BUF bytes wait until
+ * they fit whole, so they are never interleaved with other writers. All
+ * callers run in thread context, where the kernel is not preempted; only
+ * the sleep/wakeup checks need interrupts off. */
+
+static pipe_t pipes[PIPE_MAX];
+
+static pipe_t *as_pipe(node_t *n) { return (n && n->type == NODE_PIPE) ? (pipe_t *)n->data : 0; }
+
+static void wake_readers(pipe_t *p)
+{
+    waitq_wake_all(&p->rwait);
+    poll_notify(&p->poll, POLLIN);
+}
+
+static void wake_writers(pipe_t *p)
+{
+    waitq_wake_all(&p->wwait);
+    poll_notify(&p->poll, POLLOUT);
+}
+
+static void pipe_free(pipe_t *p)
+{
+    poll_detach_all(&p->poll);
+    for (int i = 0; i < PIPE_PAGES; i++)
+    {
+        if (p->pages[i])
+            pmm_free_page(p->pages[i]);
+        p->pages[i] = 0;
+    }
+    p->used = 0;
+}
+
+static pipe_t *pipe_alloc(void)
+{
+    pipe_t *p = 0;
+    for (int i = 0; i < PIPE_MAX; i++)
+    {
+        if (!pipes[i].used)
+        {
+            p = &pipes[i];
+            break;
+        }
+    }
+    if (!p)
+        return 0;
+    p->used = 1;
+    for (int i = 0; i < PIPE_PAGES; i++)
+    {
+        p->pages[i] = pmm_alloc_page();
+        if (!p->pages[i])
+        {
+            pipe_free(p);
+            return 0;
+        }
+    }
+    kmemset(&p->node, 0, sizeof(p->node));
+    kstrcpy(p->node.name, "pipe");
+    p->node.type = NODE_PIPE;
+    p->node.data = (char *)p;
+    p->head = p->tail = 0;
+    p->readers = p->writers = 1;
+    p->rwait.head = p->wwait.head = 0;
+    p->poll.first = 0;
+    return p;
+}
+
+/* Copy n bytes between the ring at byte position pos and a linear buffer. */
+static void ring_copy_out(pipe_t *p, uint64_t pos, char *dst, size_t n)
+{
+    while (n)
+    {
+        size_t off = pos % PIPE_SIZE;
+        size_t c = 4096 - off % 4096;
+        if (c > n)
+            c = n;
+        kmemcpy(dst, p->pages[off / 4096] + off % 4096, c);
+        dst += c;
+        pos += c;
+        n -= c;
+    }
+}
+
+static void ring_copy_in(pipe_t *p, uint64_t pos, const char *src, size_t n)
+{
+    while (n)
+    {
+        size_t off = pos % PIPE_SIZE;
+        size_t c = 4096 - off % 4096;
+        if (c > n)
+            c = n;
+        kmemcpy(p->pages[off / 4096] + off % 4096, src, c);
+        src += c;
+        pos += c;
+        n -= c;
+    }
+}
+
+/* Wait until p has data or no writers are left (EOF). */
+static int pipe_wait_data(pipe_t *p, int nonblock)
+{
+    uint64_t flags = irq_save();
+    while (p->head == p->tail && p->writers)
+    {
+        if (nonblock || thread_current()->killed)
+        {
+            irq_restore(flags);
+            return nonblock ? -EAGAIN : -EINTR;
+        }
+        waitq_sleep(&p->rwait);
+    }
+    irq_restore(flags);
+    return 0;
+}
+
+/* Wait until want bytes fit in p; -EPIPE once every reader has gone. */
+static int pipe_wait_space(pipe_t *p, size_t want, int nonblock)
+{
+    uint64_t flags = irq_save();
+    while (p->readers && PIPE_SIZE - (p->head - p->tail) < want)
+    {
+        if (nonblock || thread_current()->killed)
+        {
+            irq_restore(flags);
+            return nonblock ? -EAGAIN : -EINTR;
+        }
+        waitq_sleep(&p->wwait);
+    }
+    irq_restore(flags);
+    return p->readers ? 0 : -EPIPE;
+}
+
+long pipe_read(node_t *n, void *buf, unsigned long count, int fdflags)
+{
+    pipe_t *p = as_pipe(n);
+    if (!p)
+        return -EBADF;
+    if (!count)
+        return 0;
+    int r = pipe_wait_data(p, fdflags & O_NONBLOCK);
+    if (r < 0)
+        return r;
+    size_t avail = p->head - p->tail;
+    if (count > avail)
+        count = avail;
+    ring_copy_out(p, p->tail, (char *)buf, count);
+    p->tail += count;
+    wake_writers(p);
+    return (long)count;
+}
+
+long pipe_write(node_t *n, const void *buf, unsigned long count, int fdflags)
+{
+    pipe_t *p = as_pipe(n);
+    if (!p)
+        return -EBADF;
+    const char *src = (const char *)buf;
+    unsigned long done = 0;
+    while (done < count)
+    {
+        size_t left = count - done;
+        int r = pipe_wait_space(p, count <= PIPE_BUF ? left : 1, fdflags & O_NONBLOCK);
+        if (r < 0)
+            return done ? (long)done : r;
+        size_t space = PIPE_SIZE - (p->head - p->tail);
+        size_t c = left < space ? left : space;
+        ring_copy_in(p, p->head, src + done, c);
+        p->head += c;
+        done += c;
+        wake_readers(p);
+    }
+    return (long)done;
+}
+
+/* Called when the last reference to an open file naming an end goes. */
+void pipe_unref(node_t *n, int flags)
+{
+    pipe_t *p = as_pipe(n);
+    if (!p)
+        return;
+    if ((flags & O_ACCMODE) == O_WRONLY)
+    {
+        if (--p->writers == 0)
+        {
+            waitq_wake_all(&p->rwait); /* readers see EOF */
+            poll_notify(&p->poll, POLLHUP);
+        }
+    }
+    else if (--p->readers == 0)
+    {
+        waitq_wake_all(&p->wwait); /* writers see EPIPE */
+        poll_notify(&p->poll, POLLERR);
+    }
+    if (!p->readers && !p->writers)
+        pipe_free(p);
+}
+
+unsigned pipe_poll(node_t *n, int fdflags, poll_head_t **head)
+{
+    pipe_t *p = as_pipe(n);
+    unsigned m = 0;
+    *head = &p->poll;
+    if ((fdflags & O_ACCMODE) == O_WRONLY)
+    {
+        if (!p->readers)
+            m |= POLLERR;
+        else if (PIPE_SIZE - (p->head - p->tail) >= PIPE_BUF)
+            m |= POLLOUT;
+    }
+    else
+    {
+        if (p->head != p->tail)
+            m |= POLLIN;
+        if (!p->writers)
+            m |= POLLHUP;
+    }
+    return m;
+}
+
+long sys_pipe2(int *pipefd, int flags)
+{
+    if (!pipefd)
+        return -EFAULT;
+    pipe_t *p = pipe_alloc();
+    if (!p)
+        return -ENFILE;
+    int rfd = proc_install_fd(proc_current(), -1, file_alloc(&p->node, O_RDONLY | (flags & O_NONBLOCK)));
+    if (rfd < 0)
+    {
+        pipe_free(p);
+        return rfd;
+    }
+    int wfd = proc_install_fd(proc_current(), -1, file_alloc(&p->node, O_WRONLY | (flags & O_NONBLOCK)));
+    if (wfd < 0)
+    {
+        /* a failed install already dropped the writer, a failed file_alloc did not */
+        if (p->writers)
+            pipe_unref(&p->node, O_WRONLY);
+        proc_close_fd(proc_current(), rfd); /* last reference: frees the pipe */
+        return wfd;
+    }
+    pipefd[0] = rfd;
+    pipefd[1] = wfd;
+    return 0;
+}
+
+long sys_pipe(int *pipefd) { return sys_pipe2(pipefd, 0); }
+
+/* Move (or, for tee, copy) up to len bytes from one pipe ring to another
+ * without a bounce buffer. */
+static long pipe_to_pipe(pipe_t *in, pipe_t *out, unsigned long len, int nonblock, int consume)
+{
+    if (in == out)
+        return -EINVAL;
+    int r = pipe_wait_data(in, nonblock);
+    if (r < 0)
+        return r;
+    if (in->head == in->tail)
+        return 0;
+    r = pipe_wait_space(out, 1, nonblock);
+    if (r < 0)
+        return r;
+    size_t n = in->head - in->tail;
+    size_t space = PIPE_SIZE - (out->head - out->tail);
+    if (n > len)
+        n = len;
+    if (n > space)
+        n = space;
+    for (size_t done = 0; done < n;)
+    {
+        size_t off = (in->tail + done) % PIPE_SIZE;
+        size_t c = 4096 - off % 4096;
+        if (c > n - done)
+            c = n - done;
+        ring_copy_in(out, out->head + done, in->pages[off / 4096] + off % 4096, c);
+        done += c;
+    }
+    out->head += n;
+    wake_readers(out);
+    if (consume)
+    {
+        in->tail += n;
+        wake_writers(in);
+    }
+    return (long)n;
+}
+
+/* splice: one end must be a pipe. Data goes straight between the ring
+ * pages and the file store, without passing through user memory. */
+long sys_splice(int fd_in, long *off_in, int fd_out, long *off_out, unsigned long len, unsigned flags)
+{
+    file_t *in = proc_get_fd(fd_in), *out = proc_get_fd(fd_out);
+    if (!in || !out || !in->node || !out->node)
+        return -EBADF;
+    if ((in->flags & O_ACCMODE) == O_WRONLY || (out->flags & O_ACCMODE) == O_RDONLY)
+        return -EBADF;
+    pipe_t *pi = as_pipe(in->node), *po = as_pipe(out->node);
+    int nonblock = (flags & SPLICE_F_NONBLOCK) != 0;
+    if (!pi && !po)
+        return -EINVAL;
+    if ((pi && off_in) || (po && off_out))
+        return -ESPIPE;
+    if (!len)
+        return 0;
+    if (pi && po)
+        return pipe_to_pipe(pi, po, len, nonblock, 1);
+
+    if (pi)
+    {
+        /* pipe -> file */
+        node_t *f = out->node;
+        if (f->type != NODE_FILE)
+            return -EINVAL;
+        int r = pipe_wait_data(pi, nonblock);
+        if (r < 0)
+            return r;
+        size_t pos = off_out ? (size_t)*off_out : (out->flags & O_APPEND) ? f->size : out->ofs;
+        size_t n = pi->head - pi->tail;
+        if (n > len)
+            n = len;
+        size_t done = 0;
+        while (done < n)
+        {
+            size_t off = pi->tail % PIPE_SIZE;
+            size_t c = 4096 - off % 4096;
+            if (c > n - done)
+                c = n - done;
+            /* a disk write sleeps, and another reader may drain the pipe */
+            if (c > pi->head - pi->tail)
+                c = pi->head - pi->tail;
+            if (!c)
+                break;
+            if (fs_pwrite(f, pi->pages[off / 4096] + off % 4096, c, pos + done) < 0)
+                break;
+            pi->tail += c;
+            done += c;
+        }
+        if (!done && n)
+            return -ENOSPC;
+        if (off_out)
+            *off_out += (long)done;
+        else
+            out->ofs = pos + done;
+        wake_writers(pi);
+        return (long)done;
+    }
+
+    /* file -> pipe */
+    node_t *f = in->node;
+    if (f->type != NODE_FILE)
+        return -EINVAL;
+    size_t pos = off_in ? (size_t)*off_in : in->ofs;
+    if (pos >= f->size)
+        return 0;
+    int r = pipe_wait_space(po, 1, nonblock);
+    if (r < 0)
+        return r;
+    size_t n = f->size - pos;
+    if (n > len)
+        n = len;
+    size_t done = 0;
+    while (done < n)
+    {
+        size_t c;
+        const char *p = fs_data_at(f, pos + done, &c);
+        if (!p)
+            break; /* disk read failed */
+        /* a page cache miss sleeps, and another writer may have moved
+         * head meanwhile: take head and the room left only now */
+        size_t space = PIPE_SIZE - (po->head - po->tail);
+        if (!space && done)
+            break;
+        if (!space)
+        {
+            if ((r = pipe_wait_space(po, 1, nonblock)) < 0)
+                return r;
+            continue;
+        }
+        if (c > n - done)
+            c = n - done;
+        if (c > space)
+            c = space;
+        ring_copy_in(po, po->head, p, c);
+        po->head += c;
+        done += c;
+    }
+    if (!done)
+        return -EIO;
+    if (off_in)
+        *off_in += (long)done;
+    else
+        in->ofs = pos + done;
+    wake_readers(po);
+    return (long)done;
+}
+
+/* tee: duplicate pipe data into another pipe, leaving the source intact. */
+long sys_tee(int fd_in, int fd_out, unsigned long len, unsigned flags)
+{
+    file_t *in = proc_get_fd(fd_in), *out = proc_get_fd(fd_out);
+    if (!in || !out)
+        return -EBADF;
+    if ((in->flags & O_ACCMODE) == O_WRONLY || (out->flags & O_ACCMODE) == O_RDONLY)
+        return -EBADF;
+    pipe_t *pi = as_pipe(in->node), *po = as_pipe(out->node);
+    if (!pi || !po)
+        return -EINVAL;
+    return pipe_to_pipe(pi, po, len, (flags & SPLICE_F_NONBLOCK) != 0, 0);
+}
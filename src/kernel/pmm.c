@@ -45,3 +45,17 @@ void pmm_free_page(void *p)
     *(void**)p = pmm_free_list;
     pmm_free_list = p;
 }
+
+/* Pages are handed out upward from the end of the kernel, so a range in
+ * their way moves the start past it. */
+void pmm_reserve(uintptr_t start, uintptr_t end)
+{
+    if (!pmm_cur)
+        pmm_init();
+    if (end <= pmm_cur || start >= pmm_end)
+        return;
+    if (start < pmm_cur)
+        kprintf("[pmm] reserve %x: already in use\n", (unsigned)start);
+    pmm_cur = (end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    kprintf("[pmm] reserved %x-%x\n", (unsigned)start, (unsigned)end);
+}
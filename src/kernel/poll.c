@@ -0,0 +1,460 @@
+#include "poll.h"
+#include "pipe.h"
+#include "proc.h"
+#include "sched.h"
+#include "timer.h"
+#include "tty.h"
+#include "irq.h"
+#include "kerrno.h"
+#include "string.h"
+#include <stdint.h>
+
+/* Readiness sources keep a list of poll entries. poll() hooks one entry per
+ * descriptor for the length of the call. An epoll instance keeps one per
+ * watched fd while it is registered, and its callback moves the item onto
+ * the instance's ready list, so epoll_wait only ever looks at ready items.
+ * Keyboard input notifies from IRQ context, so the lists are only changed
+ * with interrupts disabled. */
+
+void poll_add(poll_head_t *h, poll_entry_t *pe)
+{
+    uint64_t flags = irq_save();
+    pe->next = h->first;
+    h->first = pe;
+    irq_restore(flags);
+}
+
+void poll_remove(poll_head_t *h, poll_entry_t *pe)
+{
+    uint64_t flags = irq_save();
+    poll_entry_t **pp = &h->first;
+    while (*pp && *pp != pe)
+        pp = &(*pp)->next;
+    if (*pp)
+        *pp = pe->next;
+    pe->next = 0;
+    irq_restore(flags);
+}
+
+void poll_notify(poll_head_t *h, unsigned events)
+{
+    uint64_t flags = irq_save();
+    for (poll_entry_t *pe = h->first, *next; pe; pe = next)
+    {
+        next = pe->next; /* fn may unhook pe */
+        pe->fn(pe, events);
+    }
+    irq_restore(flags);
+}
+
+/* The source is being freed: tell every watcher, then forget them. */
+void poll_detach_all(poll_head_t *h)
+{
+    uint64_t flags = irq_save();
+    poll_notify(h, POLLHUP | POLLFREE);
+    h->first = 0;
+    irq_restore(flags);
+}
+
+static unsigned epoll_poll(node_t *n, poll_head_t **head);
+
+/* Current readiness of n as opened with fdflags, and the source to hook
+ * for changes (none for objects that never block). */
+unsigned node_poll(node_t *n, int fdflags, poll_head_t **head)
+{
+    *head = 0;
+    if (!n)
+        return POLLOUT; /* console stdout/stderr */
+    switch (n->type)
+    {
+    case NODE_PIPE:
+        return pipe_poll(n, fdflags, head);
+    case NODE_CHAR:
+        return n->data ? tty_poll((tty_t *)n->data, head) : POLLOUT;
+    case NODE_EPOLL:
+        return epoll_poll(n, head);
+    default:
+        return POLLIN | POLLOUT; /* regular files and directories */
+    }
+}
+
+typedef struct poll_waiter
+{
+    thread_t *t;
+    volatile int triggered;
+    volatile int expired;
+} poll_waiter_t;
+
+static void waiter_wake(poll_entry_t *pe, unsigned events)
+{
+    (void)events;
+    poll_waiter_t *w = (poll_waiter_t *)pe->owner;
+    w->triggered = 1;
+    sched_wakeup(w->t);
+}
+
+static void waiter_timeout(void *arg)
+{
+    poll_waiter_t *w = (poll_waiter_t *)arg;
+    w->expired = 1;
+    sched_wakeup(w->t);
+}
+
+static void waiter_arm(poll_waiter_t *w, ktimer_t *timer, int timeout_ms, int *armed)
+{
+    if (timeout_ms > 0 && !*armed)
+    {
+        timer_setup(timer, waiter_timeout, w);
+        timer_add(timer, ticks + timer_ms_to_ticks((uint64_t)timeout_ms));
+        *armed = 1;
+    }
+}
+
+/* Block until a hooked source fires, the timer expires or the thread is
+ * killed. Interrupts must be disabled. */
+static void waiter_sleep(poll_waiter_t *w)
+{
+    w->t->sleep_intr = 1;
+    while (!w->triggered && !w->expired && !w->t->killed)
+        sched_block();
+    w->t->sleep_intr = 0;
+}
+
+long sys_poll(struct pollfd *fds, unsigned long nfds, int timeout)
+{
+    if (nfds > POLL_MAX)
+        return -EINVAL;
+    if (nfds && !fds)
+        return -EFAULT;
+    poll_entry_t entries[POLL_MAX];
+    poll_head_t *heads[POLL_MAX];
+    poll_waiter_t w = {thread_current(), 0, 0};
+    ktimer_t timer;
+    int armed = 0;
+    long ready;
+    uint64_t flags = irq_save();
+    for (;;)
+    {
+        w.triggered = 0;
+        ready = 0;
+        for (unsigned long i = 0; i < nfds; i++)
+        {
+            heads[i] = 0;
+            fds[i].revents = 0;
+            if (fds[i].fd < 0)
+                continue;
+            file_t *e = proc_get_fd(fds[i].fd);
+            unsigned m = POLLNVAL;
+            if (e)
+                m = node_poll(e->node, e->flags, &heads[i]) & ((unsigned short)fds[i].events | POLLERR | POLLHUP);
+            fds[i].revents = (short)m;
+            if (m)
+                ready++;
+        }
+        if (ready || timeout == 0 || w.expired || w.t->killed)
+            break;
+        /* interrupts stay off from the scan to the sleep, so no event is missed */
+        for (unsigned long i = 0; i < nfds; i++)
+        {
+            if (!heads[i])
+                continue;
+            entries[i].fn = waiter_wake;
+            entries[i].owner = &w;
+            poll_add(heads[i], &entries[i]);
+        }
+        waiter_arm(&w, &timer, timeout, &armed);
+        waiter_sleep(&w);
+        for (unsigned long i = 0; i < nfds; i++)
+            if (heads[i])
+                poll_remove(heads[i], &entries[i]);
+    }
+    irq_restore(flags);
+    if (armed)
+        timer_del(&timer);
+    if (!ready && w.t->killed)
+        return -EINTR;
+    return ready;
+}
+
+/* epoll */
+
+typedef struct epitem
+{
+    int used;
+    int fd;
+    node_t *node;
+    int fdflags;
+    uint32_t events; /* requested mask plus EPOLLET/EPOLLONESHOT; 0 = disabled */
+    uint64_t data;
+    poll_head_t *head; /* source the item is hooked on, if any */
+    poll_entry_t pe;
+    struct epitem *rnext;
+    int on_ready;
+    struct epoll *ep;
+} epitem_t;
+
+typedef struct epoll
+{
+    node_t node;
+    int refs;
+    epitem_t items[EPOLL_MAX_ITEMS];
+    epitem_t *ready, **ready_tail;
+    poll_head_t wait; /* epoll_wait callers and pollers of the epoll fd */
+} epoll_t;
+
+static epoll_t epolls[EPOLL_MAX];
+
+static epoll_t *as_epoll(node_t *n) { return (n && n->type == NODE_EPOLL) ? (epoll_t *)n->data : 0; }
+
+static unsigned epoll_poll(node_t *n, poll_head_t **head)
+{
+    epoll_t *ep = as_epoll(n);
+    *head = &ep->wait;
+    return ep->ready ? POLLIN : 0;
+}
+
+static void ep_ready_push(epoll_t *ep, epitem_t *it)
+{
+    if (it->on_ready)
+        return;
+    it->rnext = 0;
+    *ep->ready_tail = it;
+    ep->ready_tail = &it->rnext;
+    it->on_ready = 1;
+}
+
+static void ep_callback(poll_entry_t *pe, unsigned events)
+{
+    epitem_t *it = (epitem_t *)pe->owner;
+    if (events & POLLFREE)
+        it->head = 0; /* the source reset its list */
+    if (!it->events || !(events & (it->events | POLLERR | POLLHUP)))
+        return;
+    ep_ready_push(it->ep, it);
+    poll_notify(&it->ep->wait, POLLIN);
+}
+
+static void ep_item_remove(epoll_t *ep, epitem_t *it)
+{
+    if (it->head)
+        poll_remove(it->head, &it->pe);
+    if (it->on_ready)
+    {
+        epitem_t **pp = &ep->ready;
+        while (*pp != it)
+            pp = &(*pp)->rnext;
+        *pp = it->rnext;
+        if (ep->ready_tail == &it->rnext)
+            ep->ready_tail = pp;
+    }
+    kmemset(it, 0, sizeof(*it));
+}
+
+void epoll_unref(node_t *n)
+{
+    epoll_t *ep = as_epoll(n);
+    if (!ep || --ep->refs > 0)
+        return;
+    uint64_t flags = irq_save();
+    for (int i = 0; i < EPOLL_MAX_ITEMS; i++)
+        if (ep->items[i].used)
+            ep_item_remove(ep, &ep->items[i]);
+    ep->ready = 0;
+    ep->ready_tail = &ep->ready;
+    poll_detach_all(&ep->wait);
+    irq_restore(flags);
+}
+
+long sys_epoll_create1(int flags)
+{
+    (void)flags; /* EPOLL_CLOEXEC: there is no exec-time fd closing yet */
+    epoll_t *ep = 0;
+    for (int i = 0; i < EPOLL_MAX && !ep; i++)
+        if (!epolls[i].refs)
+            ep = &epolls[i];
+    if (!ep)
+        return -ENFILE;
+    kmemset(ep, 0, sizeof(*ep));
+    kstrcpy(ep->node.name, "epoll");
+    ep->node.type = NODE_EPOLL;
+    ep->node.data = (char *)ep;
+    ep->ready_tail = &ep->ready;
+    int fd = proc_alloc_fd(&ep->node);
+    if (fd < 0)
+        return -EMFILE;
+    ep->refs = 1;
+    return fd;
+}
+
+long sys_epoll_create(int size)
+{
+    if (size <= 0)
+        return -EINVAL;
+    return sys_epoll_create1(0);
+}
+
+long sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *ev)
+{
+    file_t *epe = proc_get_fd(epfd), *e = proc_get_fd(fd);
+    if (!epe || !e)
+        return -EBADF;
+    epoll_t *ep = as_epoll(epe->node);
+    if (!ep || as_epoll(e->node)) /* no nested instances */
+        return -EINVAL;
+    if (op != EPOLL_CTL_DEL && !ev)
+        return -EFAULT;
+    epitem_t *it = 0, *slot = 0;
+    for (int i = 0; i < EPOLL_MAX_ITEMS; i++)
+    {
+        epitem_t *c = &ep->items[i];
+        if (c->used && c->fd == fd && c->node == e->node)
+            it = c;
+        else if (!c->used && !slot)
+            slot = c;
+    }
+    long r = 0;
+    uint64_t flags = irq_save();
+    switch (op)
+    {
+    case EPOLL_CTL_ADD:
+        if (it)
+        {
+            r = -EEXIST;
+            break;
+        }
+        if (!slot)
+        {
+            r = -ENOSPC;
+            break;
+        }
+        it = slot;
+        it->used = 1;
+        it->fd = fd;
+        it->node = e->node;
+        it->fdflags = e->flags;
+        it->ep = ep;
+        it->pe.fn = ep_callback;
+        it->pe.owner = it;
+        /* fall through */
+    case EPOLL_CTL_MOD:
+        if (!it)
+        {
+            r = -ENOENT;
+            break;
+        }
+        it->events = ev->events;
+        it->data = ev->data;
+        {
+            poll_head_t *head;
+            unsigned m = node_poll(it->node, it->fdflags, &head);
+            if (op == EPOLL_CTL_ADD && head)
+            {
+                it->head = head;
+                poll_add(head, &it->pe);
+            }
+            if (m & (it->events | POLLERR | POLLHUP))
+            {
+                ep_ready_push(ep, it);
+                poll_notify(&ep->wait, POLLIN);
+            }
+        }
+        break;
+    case EPOLL_CTL_DEL:
+        if (!it)
+            r = -ENOENT;
+        else
+            ep_item_remove(ep, it);
+        break;
+    default:
+        r = -EINVAL;
+    }
+    irq_restore(flags);
+    return r;
+}
+
+/* Report up to max ready items. Each is re-checked first: items that are no
+ * longer ready drop off the list, edge-triggered ones leave it once
+ * reported, and level-triggered ones go back on the end to be checked
+ * again next time. Interrupts must be disabled. */
+static int ep_collect(epoll_t *ep, struct epoll_event *out, int max)
+{
+    epitem_t *list = ep->ready;
+    ep->ready = 0;
+    ep->ready_tail = &ep->ready;
+    epitem_t *keep = 0, **keep_tail = &keep;
+    int n = 0;
+    while (list && n < max)
+    {
+        epitem_t *it = list;
+        list = it->rnext;
+        it->rnext = 0;
+        it->on_ready = 0;
+        if (!it->events)
+            continue;
+        poll_head_t *head;
+        unsigned m = node_poll(it->node, it->fdflags, &head) & (it->events | POLLERR | POLLHUP);
+        if (!m)
+            continue;
+        out[n].events = m;
+        out[n].data = it->data;
+        n++;
+        if (it->events & EPOLLONESHOT)
+            it->events = 0; /* disabled until EPOLL_CTL_MOD */
+        else if (!(it->events & EPOLLET))
+        {
+            *keep_tail = it;
+            keep_tail = &it->rnext;
+            it->on_ready = 1;
+        }
+    }
+    /* unvisited items stay ahead of the ones just reported */
+    if (list)
+    {
+        ep->ready = list;
+        epitem_t *t = list;
+        while (t->rnext)
+            t = t->rnext;
+        ep->ready_tail = &t->rnext;
+    }
+    if (keep)
+    {
+        *ep->ready_tail = keep;
+        ep->ready_tail = keep_tail;
+    }
+    return n;
+}
+
+long sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+    file_t *e = proc_get_fd(epfd);
+    if (!e)
+        return -EBADF;
+    epoll_t *ep = as_epoll(e->node);
+    if (!ep || maxevents <= 0)
+        return -EINVAL;
+    if (!events)
+        return -EFAULT;
+    poll_waiter_t w = {thread_current(), 0, 0};
+    poll_entry_t pe = {0, waiter_wake, &w};
+    ktimer_t timer;
+    int armed = 0;
+    long n;
+    uint64_t flags = irq_save();
+    for (;;)
+    {
+        w.triggered = 0;
+        n = ep_collect(ep, events, maxevents);
+        if (n || timeout == 0 || w.expired || w.t->killed)
+            break;
+        poll_add(&ep->wait, &pe);
+        waiter_arm(&w, &timer, timeout, &armed);
+        waiter_sleep(&w);
+        poll_remove(&ep->wait, &pe);
+    }
+    irq_restore(flags);
+    if (armed)
+        timer_del(&timer);
+    if (!n && w.t->killed)
+        return -EINTR;
+    return n;
+}
@@ -0,0 +1,331 @@
+#include "sched.h"
+#include "irq.h"
+#include "kprint.h"
+#include "proc.h"
+#include "vm.h"
+#include "futex.h"
+#include "percpu.h"
+#include <stdint.h>
+
+/* Kernel threads. Each thread owns a slot in a static stack pool; the boot
+ * thread keeps running on the boot stack. Kernel code switches cooperatively
+ * on sched_yield/sched_block, and idle points call sched_idle so queued work
+ * runs whenever the foreground thread would otherwise halt. Threads running
+ * user code are also preempted from the timer once their slice is used. */
+
+#define MSR_FS_BASE 0xC0000100
+
+extern void context_switch(uint64_t *old_rsp, uint64_t new_rsp);
+extern uint8_t tss[]; /* multiboot64.asm */
+
+static thread_t threads[THREAD_MAX];
+static uint8_t kstacks[THREAD_MAX][KSTACK_SIZE] __attribute__((aligned(16)));
+static thread_t *current = 0;
+static thread_t *runq_head = 0, *runq_tail = 0;
+static int next_tid = 0;
+static volatile int need_resched = 0;
+static int slice_left = SCHED_SLICE_TICKS;
+
+static inline void wrmsr(uint32_t msr, uint64_t v)
+{
+    __asm__ volatile("wrmsr" : : "c"(msr), "a"((uint32_t)v), "d"((uint32_t)(v >> 32)));
+}
+
+static void runq_push(thread_t *t)
+{
+    t->next = 0;
+    if (runq_tail)
+        runq_tail->next = t;
+    else
+        runq_head = t;
+    runq_tail = t;
+}
+
+static thread_t *runq_pop(void)
+{
+    thread_t *t = runq_head;
+    if (t)
+    {
+        runq_head = t->next;
+        if (!runq_head)
+            runq_tail = 0;
+        t->next = 0;
+    }
+    return t;
+}
+
+/* Interrupts must be disabled. Switches to the next runnable thread; if the
+ * current thread cannot continue and nothing is runnable, halts until an
+ * interrupt makes something runnable. */
+static void schedule(void)
+{
+    thread_t *prev = current;
+    thread_t *next;
+    while (!(next = runq_pop()))
+    {
+        if (prev->state == THREAD_RUNNABLE)
+            return;
+        __asm__ volatile("sti; hlt; cli" : : : "memory");
+    }
+    if (next == prev)
+        return;
+    if (prev->state == THREAD_RUNNABLE)
+        runq_push(prev);
+    current = next;
+    need_resched = 0;
+    slice_left = SCHED_SLICE_TICKS;
+    thread_activate(next);
+    context_switch(&prev->rsp, next->rsp);
+}
+
+/* Load the per-thread CPU state that context_switch does not carry: the
+ * ring-0 stack for traps and SYSCALL from user mode, the TLS base and the
+ * address space. */
+void thread_activate(thread_t *t)
+{
+    if (t->kstack_top)
+    {
+        *(uint64_t *)(tss + 4) = t->kstack_top; /* tss.rsp0 */
+        cpu0.kernel_rsp = t->kstack_top;        /* syscall_entry64 */
+    }
+    wrmsr(MSR_FS_BASE, t->fs_base);
+    /* threads without a user image run on the kernel tables, so a reaped
+     * process's PML4 is never left loaded */
+    uint64_t cr3 = (t->proc && t->proc->pml4_phys) ? t->proc->pml4_phys : vm_get_kernel_cr3();
+    if (cr3 && (vm_get_cr3() & ~0xFFFULL) != cr3)
+        vm_set_cr3(cr3);
+}
+
+void sched_init(void)
+{
+    thread_t *t = &threads[0];
+    t->tid = next_tid++;
+    t->state = THREAD_RUNNABLE;
+    t->name = "init";
+    t->kstack = 0;
+    t->kstack_top = 0;
+    current = t;
+    kprintf("[sched] boot thread tid=%d\n", t->tid);
+}
+
+thread_t *thread_current(void) { return current; }
+
+static void kthread_trampoline(void)
+{
+    current->entry(current->arg);
+    kthread_exit();
+}
+
+thread_t *kthread_create(void (*fn)(void *), void *arg, const char *name)
+{
+    uint64_t flags = irq_save();
+    thread_t *t = 0;
+    int slot = 0;
+    for (int i = 1; i < THREAD_MAX; i++)
+    {
+        if (threads[i].state == THREAD_UNUSED || (threads[i].state == THREAD_DEAD && &threads[i] != current))
+        {
+            t = &threads[i];
+            slot = i;
+            break;
+        }
+    }
+    if (!t)
+    {
+        irq_restore(flags);
+        return 0;
+    }
+    t->tid = next_tid++;
+    t->name = name;
+    t->entry = fn;
+    t->arg = arg;
+    t->kstack = kstacks[slot];
+    t->kstack_top = (uint64_t)(uintptr_t)(t->kstack + KSTACK_SIZE);
+    t->proc = 0;
+    t->is_clone = 0;
+    t->killed = 0;
+    t->fs_base = 0;
+    t->tf = 0;
+    t->clear_tid = 0;
+    t->futex_key = 0;
+    t->futex_next = 0;
+    t->waitq = 0;
+    t->wait_next = 0;
+    t->sleep_intr = 0;
+    /* Initial frame consumed by context_switch: RFLAGS (IF=1), six
+     * callee-saved registers, then the return into the trampoline. */
+    uint64_t *sp = (uint64_t *)(uintptr_t)t->kstack_top;
+    *--sp = 0;
+    *--sp = (uint64_t)(uintptr_t)kthread_trampoline;
+    for (int i = 0; i < 6; i++)
+        *--sp = 0;
+    *--sp = 0x202;
+    t->rsp = (uint64_t)(uintptr_t)sp;
+    t->state = THREAD_RUNNABLE;
+    runq_push(t);
+    irq_restore(flags);
+    return t;
+}
+
+/* End the current thread, waking a sys_exit of its process that waits
+ * for the other threads to go. */
+void kthread_exit(void)
+{
+    irq_save();
+    current->state = THREAD_DEAD;
+    if (current->proc)
+        waitq_wake_all(&current->proc->thread_wait);
+    schedule();
+    for (;;)
+        __asm__ volatile("hlt");
+}
+
+static void waitq_remove(thread_t *t)
+{
+    thread_t **pp = &t->waitq->head;
+    while (*pp && *pp != t)
+        pp = &(*pp)->wait_next;
+    if (*pp)
+        *pp = t->wait_next;
+    t->waitq = 0;
+    t->wait_next = 0;
+}
+
+/* Ask another thread to exit: it notices at its next return to user mode.
+ * A futex, wait queue or poll sleeper is woken so it gets there. */
+void sched_kill(thread_t *t)
+{
+    uint64_t flags = irq_save();
+    if (t != current && t->state != THREAD_UNUSED && t->state != THREAD_DEAD)
+    {
+        t->killed = 1;
+        futex_cancel(t);
+        if (t->waitq)
+        {
+            waitq_remove(t);
+            sched_wakeup(t);
+        }
+        if (t->sleep_intr)
+            sched_wakeup(t);
+    }
+    irq_restore(flags);
+}
+
+/* exit_group: kill every other thread sharing the process. */
+void sched_kill_process(struct process *p)
+{
+    for (int i = 0; i < THREAD_MAX; i++)
+        if (threads[i].proc == p && &threads[i] != current)
+            sched_kill(&threads[i]);
+}
+
+/* Live threads (including the caller) that belong to p. */
+int sched_count_threads(struct process *p)
+{
+    int n = 0;
+    for (int i = 0; i < THREAD_MAX; i++)
+        if (threads[i].proc == p && threads[i].state != THREAD_UNUSED && threads[i].state != THREAD_DEAD)
+            n++;
+    return n;
+}
+
+void sched_yield(void)
+{
+    uint64_t flags = irq_save();
+    schedule();
+    irq_restore(flags);
+}
+
+/* Block the current thread until sched_wakeup. Callers re-check their wait
+ * condition with interrupts disabled to avoid losing a wakeup. */
+void sched_block(void)
+{
+    uint64_t flags = irq_save();
+    current->state = THREAD_BLOCKED;
+    schedule();
+    irq_restore(flags);
+}
+
+/* Sleep on q until waitq_wake_all. Interrupts must be disabled, and the
+ * caller re-checks its condition (and thread->killed) on return. */
+void waitq_sleep(waitq_t *q)
+{
+    current->waitq = q;
+    current->wait_next = q->head;
+    q->head = current;
+    sched_block();
+    if (current->waitq)
+        waitq_remove(current);
+}
+
+void waitq_wake_all(waitq_t *q)
+{
+    uint64_t flags = irq_save();
+    thread_t *t = q->head;
+    q->head = 0;
+    while (t)
+    {
+        thread_t *next = t->wait_next;
+        t->waitq = 0;
+        t->wait_next = 0;
+        sched_wakeup(t);
+        t = next;
+    }
+    irq_restore(flags);
+}
+
+void kmutex_lock(kmutex_t *m)
+{
+    uint64_t flags = irq_save();
+    while (m->held)
+        waitq_sleep(&m->q);
+    m->held = 1;
+    irq_restore(flags);
+}
+
+void kmutex_unlock(kmutex_t *m)
+{
+    m->held = 0;
+    waitq_wake_all(&m->q);
+}
+
+void sched_wakeup(thread_t *t)
+{
+    uint64_t flags = irq_save();
+    if (t && t->state == THREAD_BLOCKED)
+    {
+        t->state = THREAD_RUNNABLE;
+        runq_push(t);
+    }
+    irq_restore(flags);
+}
+
+/* Idle point, called with interrupts disabled: run other threads if any are
+ * ready, otherwise halt until the next interrupt. */
+void sched_idle(void)
+{
+    if (runq_head)
+        schedule();
+    else
+        __asm__ volatile("sti; hlt; cli" : : : "memory");
+}
+
+/* Timer top half: account the running thread's slice. */
+void sched_tick(void)
+{
+    if (slice_left > 0 && --slice_left == 0)
+        need_resched = 1;
+}
+
+/* Called on the way out of an IRQ that interrupted user mode, on the
+ * thread's own kernel stack, with interrupts disabled. */
+void sched_preempt(void)
+{
+    if (need_resched && runq_head)
+        schedule();
+    else if (need_resched)
+    {
+        need_resched = 0;
+        slice_left = SCHED_SLICE_TICKS;
+    }
+}
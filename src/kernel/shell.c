@@ -6,6 +6,12 @@
 #include "string.h"
 #include "env.h"
 #include "syscall.h"
+#include "proc.h"
+#include "softirq.h"
+#include "sched.h"
+#include "ktime.h"
+#include "strace.h"
+#include "bcache.h"
 
 typedef void (*cmd_fn)(char *);
 typedef struct
@@ -76,6 +82,8 @@ static void builtin_mv(char *);
 static void builtin_cp(char *);
 static void builtin_hw(char *);
 static void builtin_free(char *);
+static void builtin_sync(char *);
+static void builtin_mount(char *);
 static void builtin_pwd(char *);
 static void builtin_keymap(char *);
 static void builtin_edit(char *);
@@ -85,6 +93,10 @@ static void builtin_unset(char *);
 static void builtin_exit(char *arg);
 static void builtin_export(char *arg);
 static void builtin_ui(char *args);
+static void builtin_irqstat(char *args);
+static void builtin_ps(char *args);
+static void builtin_sysstat(char *args);
+static void builtin_strace(char *args);
 
 static cmd_t CMDS[] = {
     {"help", "List commands", builtin_help},
@@ -108,7 +120,13 @@ static cmd_t CMDS[] = {
     {"export", "Export NAME=VALUE", builtin_export},
     {"hw", "Kernel info", builtin_hw},
     {"free", "Memory usage", builtin_free},
+    {"sync", "Write cached disk blocks", builtin_sync},
+    {"mount", "List mounted filesystems", builtin_mount},
     {"ui", "Launch simple UI", builtin_ui},
+    {"irqstat", "IRQ and softirq latency", builtin_irqstat},
+    {"ps", "List processes", builtin_ps},
+    {"sysstat", "Syscall counts and latency", builtin_sysstat},
+    {"strace", "Trace a command's syscalls", builtin_strace},
 };
 static const int CMDS_N = sizeof(CMDS) / sizeof(CMDS[0]);
 
@@ -193,7 +211,7 @@ static void builtin_ls(char *args)
 {
     (void)args;
     node_t *cwd = fs_cwd();
-    for (node_t *c = cwd->child; c; c = c->sibling)
+    for (node_t *c = fs_first_child(cwd); c; c = c->sibling)
     {
         kprintf("%s%s\n", c->name, c->type == NODE_DIR ? "/" : "");
     }
@@ -224,12 +242,12 @@ static void builtin_rm(char *args)
         kputs("no such entry\n");
         return;
     }
-    if (n->type == NODE_DIR && n->child)
+    if (n->type == NODE_DIR && fs_first_child(n))
     {
         kputs("not empty\n");
         return;
     }
-    if (!fs_unlink(cwd, args))
+    if (fs_unlink(cwd, args) < 0)
         kputs("fail\n");
 }
 
@@ -307,9 +325,35 @@ static void builtin_hw(char *args)
 static void builtin_free(char *args)
 {
     (void)args;
-    size_t nodes, used, tot;
-    fs_stats(&nodes, &used, &tot);
-    kprintf("nodes: %u used: %u arena: %u/%u\n", (unsigned)nodes, (unsigned)(nodes * sizeof(node_t)), (unsigned)used, (unsigned)tot);
+    size_t nodes, blocks;
+    fs_stats(&nodes, &blocks);
+    kprintf("nodes: %u used: %u data: %uK in %u blocks\n", (unsigned)nodes, (unsigned)(nodes * sizeof(node_t)),
+            (unsigned)(blocks * FS_BLOCK / 1024), (unsigned)blocks);
+    bcache_stats_t bs;
+    bcache_get_stats(&bs);
+    uint64_t lookups = bs.hits + bs.misses;
+    kprintf("bcache: %u buffers %u dirty, %u hits %u misses (%u%%), %u written %u evicted\n", bs.nbuf, bs.ndirty,
+            (unsigned)bs.hits, (unsigned)bs.misses, lookups ? (unsigned)(bs.hits * 100 / lookups) : 0,
+            (unsigned)bs.writebacks, (unsigned)bs.evictions);
+    pcache_stats_t ps;
+    pcache_get_stats(&ps);
+    kprintf("pcache: %u pages, %u hits %u misses, %u read ahead, %u evicted\n", (unsigned)ps.pages,
+            (unsigned)ps.hits, (unsigned)ps.misses, (unsigned)ps.readahead, (unsigned)ps.evictions);
+}
+
+static void builtin_sync(char *args)
+{
+    (void)args;
+    if (fs_sync(0) < 0)
+        kprintf("sync: write error\n");
+}
+
+static void builtin_mount(char *args)
+{
+    (void)args;
+    const fs_super_t *sb;
+    for (int i = 0; (sb = fs_mount_at(i)); i++)
+        kprintf("%s on %s\n", sb->type->name, sb->path);
 }
 
 static void builtin_pwd(char *args)
@@ -441,6 +485,8 @@ static int read_line_mux(char *buf, int max)
                 kputc(c);
             }
         }
+        else
+            sched_yield(); /* let deferred work run between polls */
     }
 }
 
@@ -582,7 +628,7 @@ static int run_builtin(parsed_cmd_t *pc)
 }
 
 extern long sys_execve(const char *path, char *const argv[], char *const envp[]);
-static void run_external(parsed_cmd_t *pc)
+static void run_external(parsed_cmd_t *pc, strace_ring_t *trace)
 {
     if (pc->argc == 0)
         return;
@@ -649,9 +695,8 @@ static void run_external(parsed_cmd_t *pc)
             for (int k = 0; pc->argv[0][k] && pos < (int)sizeof(temp) - 1; k++)
                 temp[pos++] = pc->argv[0][k];
             temp[pos] = '\0';
-            // try execve
-            long r = sys_execve(temp, pc->argv, 0);
-            if (r >= 0)
+            node_t *bin = fs_lookup(fs_cwd(), temp);
+            if (bin && bin->type == NODE_FILE)
             {
                 attempted = 1;
                 break;
@@ -669,6 +714,16 @@ static void run_external(parsed_cmd_t *pc)
     {
         kputs("command not found\n");
     }
+    else
+    {
+        // run it as a child process and reap it
+        long pid = proc_spawn(temp, pc->argv, 0);
+        if (pid >= 0 && trace)
+            strace_attach(proc_lookup((int)pid), trace);
+        int status = 0;
+        if (pid < 0 || sys_wait4((int)pid, &status, 0, 0) < 0)
+            kputs("cannot start process\n");
+    }
 
     if (saved_stdout >= 0)
     {
@@ -697,7 +752,7 @@ void shell_run(void)
             continue;
         if (run_builtin(&pc))
             continue;
-        run_external(&pc);
+        run_external(&pc, 0);
     }
 }
 
@@ -768,3 +823,146 @@ static void builtin_ui(char *args)
     (void)args;
     ui_run();
 }
+
+static void print_irq_stat(const char *name, int n, const irq_stat_t *st)
+{
+    if (!st || !st->count)
+        return;
+    kprintf("%s%d: count=%u avg=%uns max=%uns\n", name, n, (unsigned)st->count,
+            (unsigned)ktime_cycles_to_ns(st->total_cycles / st->count), (unsigned)ktime_cycles_to_ns(st->max_cycles));
+}
+
+static void builtin_irqstat(char *args)
+{
+    (void)args;
+    for (int i = 0; i < IRQ_LINES; i++)
+        print_irq_stat("irq", i, irq_get_stats(i));
+    for (int i = 0; i < SOFTIRQ_MAX; i++)
+        print_irq_stat("softirq", i, softirq_get_stats(i));
+}
+
+static void builtin_ps(char *args)
+{
+    (void)args;
+    kprintf("PID\tPPID\tSTATE\tMEM\tNAME\n");
+    for (int i = 0; i < PROC_MAX; i++)
+    {
+        process_t *p = proc_slot(i);
+        if (!p)
+            continue;
+        kprintf("%d\t%d\t%s\t%uK\t%s\n", p->pid, p->parent ? p->parent->pid : 0,
+                p->state == PROC_ZOMBIE ? "zombie" : "run", (unsigned)p->alloc_count * 4, p->name);
+    }
+}
+
+static void builtin_sysstat(char *args)
+{
+    (void)args;
+    if (!syscall_get_stats(0))
+    {
+        kputs("syscall stats compiled out (SYSCALL_STATS=0)\n");
+        return;
+    }
+    for (long nr = 0; nr < NR_SYSCALLS; nr++)
+    {
+        const syscall_stat_t *st = syscall_get_stats(nr);
+        if (!st->count)
+            continue;
+        kprintf("%s: count=%u avg=%uns\n", syscall_name(nr), (unsigned)st->count,
+                (unsigned)ktime_cycles_to_ns(st->total_cycles / st->count));
+        // histogram: upper bound of each non-empty bucket and its count
+        for (int b = 0; b < SYSCALL_HIST_BUCKETS; b++)
+        {
+            if (!st->hist[b])
+                continue;
+            if (b == SYSCALL_HIST_BUCKETS - 1)
+                kprintf("  >=%uns %u\n", (unsigned)ktime_cycles_to_ns(1ULL << (b + SYSCALL_HIST_SHIFT)),
+                        (unsigned)st->hist[b]);
+            else
+                kprintf("  <%uns %u\n", (unsigned)ktime_cycles_to_ns(1ULL << (b + SYSCALL_HIST_SHIFT + 1)),
+                        (unsigned)st->hist[b]);
+        }
+    }
+}
+
+/* Small values in decimal, anything else (pointers, flags) in hex. */
+static void strace_print_long(long v)
+{
+    char buf[20];
+    int n = 0;
+    if (v > -4096 && v < 4096)
+    {
+        if (v < 0)
+            kputc('-');
+        unsigned long u = v < 0 ? -(unsigned long)v : (unsigned long)v;
+        do
+            buf[n++] = '0' + u % 10;
+        while (u /= 10);
+    }
+    else
+    {
+        kputs("0x");
+        unsigned long u = (unsigned long)v;
+        do
+            buf[n++] = "0123456789abcdef"[u & 15];
+        while (u >>= 4);
+    }
+    while (n)
+        kputc(buf[--n]);
+}
+
+static void builtin_strace(char *args)
+{
+    static char line[256];
+    parsed_cmd_t pc;
+    kstrncpy(line, args, sizeof(line) - 1);
+    line[sizeof(line) - 1] = '\0';
+    parse_command_line(line, &pc);
+    if (pc.argc == 0)
+    {
+        kputs("usage: strace <cmd> [args]\n");
+        return;
+    }
+    strace_ring_t *r = strace_alloc();
+    if (!r)
+    {
+        kputs("strace: too many traced processes\n");
+        return;
+    }
+    run_external(&pc, r);
+
+    /* the child has exited, so the ring is quiet: decode oldest first */
+    uint32_t end = r->head;
+    uint32_t start = end > STRACE_RING ? end - STRACE_RING : 0;
+    if (start)
+        kprintf("(%u older records lost)\n", (unsigned)start);
+    for (uint32_t pos = start; pos < end; pos++)
+    {
+        const strace_rec_t *rec = &r->recs[pos & (STRACE_RING - 1)];
+        if (rec->seq != pos + 1)
+            continue;
+        const char *name = syscall_name(rec->nr);
+        kprintf("[%d] ", (int)rec->tid);
+        if (name)
+            kputs(name);
+        else
+            kprintf("syscall_%u", (unsigned)rec->nr);
+        kputc('(');
+        int nargs = name ? syscall_nargs(rec->nr) : 6;
+        for (int i = 0; i < nargs; i++)
+        {
+            if (i)
+                kputs(", ");
+            strace_print_long(rec->args[i]);
+        }
+        if (!rec->t_exit)
+        {
+            kputs(") = ?\n");
+            continue;
+        }
+        kputs(") = ");
+        strace_print_long(rec->ret);
+        kprintf(" <%uns>\n", (unsigned)ktime_cycles_to_ns(rec->t_exit - rec->t_enter));
+    }
+    strace_free(r);
+}
@@ -0,0 +1,113 @@
+#include "softirq.h"
+#include "sched.h"
+#include "kprint.h"
+#include <stdint.h>
+
+static void (*softirq_vec[SOFTIRQ_MAX])(void);
+static irq_stat_t softirq_stats[SOFTIRQ_MAX];
+static volatile uint32_t softirq_pending = 0;
+static int in_softirq = 0;
+
+void softirq_register(int nr, void (*fn)(void))
+{
+    if (nr >= 0 && nr < SOFTIRQ_MAX)
+        softirq_vec[nr] = fn;
+}
+
+void softirq_raise(int nr)
+{
+    uint64_t flags = irq_save();
+    softirq_pending |= 1u << nr;
+    irq_restore(flags);
+}
+
+/* Called at the tail of the IRQ dispatcher after EOI, with interrupts
+ * disabled. Handlers run with interrupts enabled so a slow bottom half does
+ * not delay the next hard IRQ; nested IRQs see in_softirq and return. */
+void softirq_run(void)
+{
+    if (in_softirq)
+        return;
+    in_softirq = 1;
+    uint32_t pending;
+    while ((pending = softirq_pending) != 0)
+    {
+        softirq_pending = 0;
+        __asm__ volatile("sti" : : : "memory");
+        for (int nr = 0; nr < SOFTIRQ_MAX; nr++)
+        {
+            if (!(pending & (1u << nr)) || !softirq_vec[nr])
+                continue;
+            uint64_t t0 = irq_rdtsc();
+            softirq_vec[nr]();
+            irq_stat_add(&softirq_stats[nr], irq_rdtsc() - t0);
+        }
+        __asm__ volatile("cli" : : : "memory");
+    }
+    in_softirq = 0;
+}
+
+const irq_stat_t *softirq_get_stats(int nr)
+{
+    if (nr < 0 || nr >= SOFTIRQ_MAX)
+        return 0;
+    return &softirq_stats[nr];
+}
+
+static work_t *work_head = 0, *work_tail = 0;
+static thread_t *kworker = 0;
+
+void work_init(work_t *w, void (*fn)(void *), void *arg)
+{
+    w->next = 0;
+    w->fn = fn;
+    w->arg = arg;
+    w->pending = 0;
+}
+
+/* Queue w for the kworker thread; safe from IRQ context. Returns 0 if the
+ * item was already pending. */
+int schedule_work(work_t *w)
+{
+    uint64_t flags = irq_save();
+    if (w->pending)
+    {
+        irq_restore(flags);
+        return 0;
+    }
+    w->pending = 1;
+    w->next = 0;
+    if (work_tail)
+        work_tail->next = w;
+    else
+        work_head = w;
+    work_tail = w;
+    sched_wakeup(kworker);
+    irq_restore(flags);
+    return 1;
+}
+
+static void kworker_main(void *arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        irq_save();
+        while (!work_head)
+            sched_block();
+        work_t *w = work_head;
+        work_head = w->next;
+        if (!work_head)
+            work_tail = 0;
+        w->pending = 0;
+        __asm__ volatile("sti" : : : "memory");
+        w->fn(w->arg);
+    }
+}
+
+void workqueue_init(void)
+{
+    kworker = kthread_create(kworker_main, 0, "kworker");
+    if (!kworker)
+        kprintf("[work] failed to start kworker\n");
+}
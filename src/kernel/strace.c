@@ -0,0 +1,88 @@
+#include "strace.h"
+#include "proc.h"
+#include "sched.h"
+#include "irq.h"
+#include "string.h"
+#include <stdint.h>
+
+static strace_ring_t rings[STRACE_MAX];
+volatile int strace_active = 0;
+
+strace_ring_t *strace_alloc(void)
+{
+    uint64_t flags = irq_save();
+    strace_ring_t *r = 0;
+    for (int i = 0; i < STRACE_MAX && !r; i++)
+        if (!rings[i].used)
+            r = &rings[i];
+    if (r)
+    {
+        kmemset(r, 0, sizeof(*r));
+        r->used = 1;
+    }
+    irq_restore(flags);
+    return r;
+}
+
+void strace_free(strace_ring_t *r)
+{
+    if (r)
+        r->used = 0;
+}
+
+void strace_attach(struct process *p, strace_ring_t *r)
+{
+    uint64_t flags = irq_save();
+    if (p && r && !p->trace)
+    {
+        p->trace = r;
+        strace_active++;
+    }
+    irq_restore(flags);
+}
+
+/* Stop tracing p; the ring stays with whoever allocated it. */
+void strace_detach(struct process *p)
+{
+    uint64_t flags = irq_save();
+    if (p && p->trace)
+    {
+        p->trace = 0;
+        strace_active--;
+    }
+    irq_restore(flags);
+}
+
+/* Claim a record for a syscall of the current process, or return 0 if it
+ * is not traced. The caller passes the record and its seq to strace_exit. */
+strace_rec_t *strace_enter(long nr, long a1, long a2, long a3, long a4, long a5, long a6)
+{
+    process_t *p = proc_current();
+    strace_ring_t *r = p ? p->trace : 0;
+    if (!r)
+        return 0;
+    uint32_t pos = __atomic_fetch_add(&r->head, 1, __ATOMIC_RELAXED);
+    strace_rec_t *rec = &r->recs[pos & (STRACE_RING - 1)];
+    rec->nr = (uint16_t)nr;
+    rec->tid = (uint16_t)thread_current()->tid;
+    rec->args[0] = a1;
+    rec->args[1] = a2;
+    rec->args[2] = a3;
+    rec->args[3] = a4;
+    rec->args[4] = a5;
+    rec->args[5] = a6;
+    rec->ret = 0;
+    rec->t_exit = 0;
+    rec->t_enter = irq_rdtsc();
+    __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+    return rec;
+}
+
+/* Fill in the result, unless the ring wrapped onto the record meanwhile. */
+void strace_exit(strace_rec_t *rec, uint32_t seq, long ret)
+{
+    if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != seq)
+        return;
+    rec->ret = ret;
+    rec->t_exit = irq_rdtsc();
+}
@@ -8,7 +8,19 @@
 #include "pmm.h"
 #include "vm.h"
 #include "tty.h"
+#include "ktime.h"
+#include "vdso.h"
+#include "sched.h"
+#include "irq.h"
+#include "futex.h"
+#include "io_uring.h"
+#include "kerrno.h"
+#include "kfcntl.h"
+#include "pipe.h"
 #include <stdint.h>
+#ifndef S_IFIFO
+#define S_IFIFO 0010000
+#endif
 #ifndef S_IFCHR
 #define S_IFCHR 0020000
 #endif
@@ -24,16 +36,31 @@ typedef struct {
 } elf_seg_info_t;
 #endif
 
-#define MAX_FDS PROC_FD_MAX
+/* Transfer on a regular file at an explicit offset (pread/pwrite and the
+ * offset-tracking read/write). Reads feed the file's read-ahead. */
+static long file_read_at(file_t *e, void *buf, unsigned long count, size_t ofs)
+{
+    return fs_pread_ra(e->node, (char *)buf, count, ofs, &e->ra);
+}
+
+static long file_write_at(node_t *n, const void *buf, unsigned long count, size_t ofs)
+{
+    int r = fs_pwrite(n, (const char *)buf, count, ofs);
+    return r < 0 ? -ENOSPC : r;
+}
 
 long sys_read(int fd, void *buf, unsigned long count)
 {
-    fd_entry_t *e = proc_get_fd(fd);
-    if (fd < 3 || !e)
+    file_t *e = proc_get_fd(fd);
+    if (!e)
         return -1;
     node_t *n = e->node;
     if (!n)
         return -1;
+    if ((e->flags & O_ACCMODE) == O_WRONLY)
+        return -EBADF; /* a pipe's write end, or a file opened write-only */
+    if (n->type == NODE_PIPE)
+        return pipe_read(n, buf, count, e->flags);
     if (n->type == NODE_CHAR) {
         extern int tty_read(struct tty*, char*, size_t);
         struct tty *t = (struct tty*)n->data;
@@ -43,31 +70,29 @@ long sys_read(int fd, void *buf, unsigned long count)
     }
     if (n->type != NODE_FILE)
         return -1;
-    size_t ofs = e->ofs;
-    if (ofs >= n->size)
-        return 0;
-    size_t remain = n->size - ofs;
-    if (count > remain)
-        count = remain;
-    int r = fs_read(n, (char *)buf, count);
-    e->ofs += r;
+    long r = file_read_at(e, buf, count, e->ofs);
+    if (r > 0)
+        e->ofs += r;
     return r;
 }
 long sys_write(int fd, const void *buf, unsigned long count)
 {
     const char *c = (const char *)buf;
-    if (fd == 1 || fd == 2)
+    file_t *e = proc_get_fd(fd);
+    node_t *n = e ? e->node : 0;
+    /* stdout/stderr go to the console unless redirected to a file or pipe */
+    if ((fd == 1 || fd == 2) && (!n || n->type == NODE_CHAR))
     {
         for (unsigned long i = 0; i < count; i++)
             kputc(c[i]);
         return (long)count;
     }
-    fd_entry_t *e = proc_get_fd(fd);
-    if (fd < 3 || !e)
-        return -1;
-    node_t *n = e->node;
     if (!n)
         return -1;
+    if ((e->flags & O_ACCMODE) == O_RDONLY)
+        return -EBADF;
+    if (n->type == NODE_PIPE)
+        return pipe_write(n, buf, count, e->flags);
     if (n->type == NODE_CHAR) {
         extern int tty_write(struct tty*, const char*, size_t);
         struct tty *t = (struct tty*)n->data;
@@ -76,79 +101,360 @@ long sys_write(int fd, const void *buf, unsigned long count)
     }
     if (n->type != NODE_FILE)
         return -1;
-    if (fs_write(n, c, count, 1) == 0)
-    {
+    if (e->flags & O_APPEND)
         e->ofs = n->size;
-        return (long)count;
-    }
-    return -1;
+    long r = file_write_at(n, c, count, e->ofs);
+    if (r > 0)
+        e->ofs += r;
+    return r;
 }
-long sys_open(const char *path, int flags, int mode)
+
+long sys_pread64(int fd, void *buf, unsigned long count, long off)
 {
-    (void)mode;
-    node_t *cwd = fs_cwd();
-    node_t *f = fs_lookup(cwd, path);
-    if (!f)
+    file_t *e = proc_get_fd(fd);
+    if (!e || !e->node)
+        return -EBADF;
+    if (e->node->type != NODE_FILE)
+        return -ESPIPE;
+    if ((e->flags & O_ACCMODE) == O_WRONLY)
+        return -EBADF;
+    if (off < 0)
+        return -EINVAL;
+    return file_read_at(e, buf, count, (size_t)off);
+}
+
+long sys_pwrite64(int fd, const void *buf, unsigned long count, long off)
+{
+    file_t *e = proc_get_fd(fd);
+    if (!e || !e->node)
+        return -EBADF;
+    if (e->node->type != NODE_FILE)
+        return -ESPIPE;
+    if ((e->flags & O_ACCMODE) == O_RDONLY)
+        return -EBADF;
+    if (off < 0)
+        return -EINVAL;
+    return file_write_at(e->node, buf, count, (size_t)off);
+}
+
+/* Copy n bytes of src at ipos into dst at opos, a block at a time. The
+ * write can sleep, and a disk file's page may be reused meanwhile, so
+ * each block goes through a page of our own. */
+static long file_copy_data(node_t *src, size_t ipos, node_t *dst, size_t opos, size_t n)
+{
+    char *buf = pmm_alloc_page();
+    if (!buf)
+        return -ENOMEM;
+    size_t done = 0;
+    long r = 0;
+    while (done < n)
     {
-        if (flags & 1)
-        { // O_CREAT simplified
-            f = fs_create_file(cwd, path);
+        size_t c;
+        const char *p = fs_data_at(src, ipos + done, &c);
+        if (!p)
+        {
+            r = -EIO; /* n stops short of the end, so this is a failed read */
+            break;
         }
+        if (c > n - done)
+            c = n - done;
+        if (c > FS_BLOCK)
+            c = FS_BLOCK;
+        kmemcpy(buf, p, c);
+        r = file_write_at(dst, buf, c, opos + done);
+        if (r < 0)
+            break;
+        done += (size_t)r;
+    }
+    pmm_free_page(buf);
+    return done || r >= 0 ? (long)done : r;
+}
+
+/* Copy between two regular files. A whole-file copy between memory files
+ * onto an empty or shorter destination becomes a reflink (fs_reflink), so
+ * it costs the same for any size; anything else, and every copy from or
+ * to a disk file, copies block by block. */
+static long file_copy_range(file_t *in, long *off_in, file_t *out, long *off_out, unsigned long len)
+{
+    node_t *src = in->node, *dst = out->node;
+    if ((off_in && *off_in < 0) || (off_out && *off_out < 0))
+        return -EINVAL;
+    size_t ipos = off_in ? (size_t)*off_in : in->ofs;
+    size_t opos = off_out ? (size_t)*off_out : (out->flags & O_APPEND) ? dst->size : out->ofs;
+    if (ipos >= src->size || !len)
+        return 0;
+    size_t n = src->size - ipos;
+    if (n > len)
+        n = len;
+    if (src == dst && ipos < opos + n && opos < ipos + n)
+        return -EINVAL;
+    long r;
+    if (ipos == 0 && opos == 0 && n == src->size && dst->size <= n && fs_reflink(dst, src) == 0)
+        r = (long)n;
+    else
+        r = file_copy_data(src, ipos, dst, opos, n);
+    if (r <= 0)
+        return r;
+    if (off_in)
+        *off_in += r;
+    else
+        in->ofs = ipos + (size_t)r;
+    if (off_out)
+        *off_out += r;
+    else
+        out->ofs = opos + (size_t)r;
+    return r;
+}
+
+long sys_copy_file_range(int fd_in, long *off_in, int fd_out, long *off_out, unsigned long len, unsigned flags)
+{
+    file_t *in = proc_get_fd(fd_in), *out = proc_get_fd(fd_out);
+    if (!in || !out || !in->node || !out->node)
+        return -EBADF;
+    if (flags)
+        return -EINVAL;
+    if (in->node->type != NODE_FILE || out->node->type != NODE_FILE)
+        return -EINVAL;
+    if ((in->flags & O_ACCMODE) == O_WRONLY || (out->flags & O_ACCMODE) == O_RDONLY)
+        return -EBADF;
+    return file_copy_range(in, off_in, out, off_out, len);
+}
+
+/* sendfile: file data to any descriptor. Regular files take the
+ * copy_file_range path; pipes, the tty and the console get one write of
+ * at most a block (a short count, which callers loop on), from a copy,
+ * since a pipe write can sleep while the page cache reuses the page. */
+long sys_sendfile(int out_fd, int in_fd, long *offset, unsigned long count)
+{
+    file_t *in = proc_get_fd(in_fd), *out = proc_get_fd(out_fd);
+    if (!in || !in->node || (in->flags & O_ACCMODE) == O_WRONLY)
+        return -EBADF;
+    node_t *src = in->node;
+    if (src->type != NODE_FILE)
+        return -EINVAL;
+    if (out && out->node && out->node->type == NODE_FILE)
+    {
+        if ((out->flags & O_ACCMODE) == O_RDONLY)
+            return -EBADF;
+        return file_copy_range(in, offset, out, 0, count);
+    }
+    if (offset && *offset < 0)
+        return -EINVAL;
+    size_t pos = offset ? (size_t)*offset : in->ofs;
+    if (pos >= src->size || !count)
+        return 0;
+    size_t n;
+    const char *p = fs_data_at(src, pos, &n);
+    if (!p)
+        return -EIO;
+    if (n > count)
+        n = count;
+    if (n > FS_BLOCK)
+        n = FS_BLOCK;
+    char *buf = pmm_alloc_page();
+    if (!buf)
+        return -ENOMEM;
+    kmemcpy(buf, p, n);
+    long r = sys_write(out_fd, buf, n);
+    pmm_free_page(buf);
+    if (r <= 0)
+        return r;
+    if (offset)
+        *offset += r;
+    else
+        in->ofs = pos + (size_t)r;
+    return r;
+}
+
+/* readv/writev: one call per vector, stopping at the first short transfer
+ * as a single read of the whole span would. */
+long sys_readv(int fd, const struct kernel_iovec *iov, int iovcnt)
+{
+    if (iovcnt < 0 || iovcnt > IOV_MAX || (iovcnt && !iov))
+        return -EINVAL;
+    long total = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        if (!iov[i].iov_len)
+            continue;
+        long r = sys_read(fd, iov[i].iov_base, iov[i].iov_len);
+        if (r < 0)
+            return total ? total : r;
+        total += r;
+        if ((size_t)r < iov[i].iov_len)
+            break;
+    }
+    return total;
+}
+
+long sys_writev(int fd, const struct kernel_iovec *iov, int iovcnt)
+{
+    if (iovcnt < 0 || iovcnt > IOV_MAX || (iovcnt && !iov))
+        return -EINVAL;
+    long total = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        if (!iov[i].iov_len)
+            continue;
+        long r = sys_write(fd, iov[i].iov_base, iov[i].iov_len);
+        if (r < 0)
+            return total ? total : r;
+        total += r;
+        if ((size_t)r < iov[i].iov_len)
+            break;
+    }
+    return total;
+}
+
+/* Create path's last component in its parent directory, relative to base. */
+static node_t *create_path(node_t *base, const char *path)
+{
+    const char *name;
+    node_t *parent = fs_lookup_parent(base, path, &name);
+    if (!parent || parent->type != NODE_DIR)
+        return 0;
+    return fs_create_file(parent, name);
+}
+
+/* Directory a *at() path is resolved from: the cwd for AT_FDCWD, else the
+ * node open on dirfd. Absolute paths ignore dirfd, as on Linux. */
+static long at_base(int dirfd, const char *path, node_t **base)
+{
+    if (!path)
+        return -EFAULT;
+    if (dirfd == AT_FDCWD || path[0] == '/')
+    {
+        *base = fs_cwd();
+        return 0;
+    }
+    file_t *f = proc_get_fd(dirfd);
+    if (!f || !f->node)
+        return -EBADF;
+    if (*path && f->node->type != NODE_DIR)
+        return -ENOTDIR;
+    *base = f->node;
+    return 0;
+}
+
+/* Resolve (dirfd, path). With AT_EMPTY_PATH, "" is dirfd itself, which
+ * lets fstatat stand in for fstat on any fd. */
+static long at_lookup(int dirfd, const char *path, int flags, node_t **out)
+{
+    node_t *base;
+    long err = at_base(dirfd, path, &base);
+    if (err)
+        return err;
+    if (!*path)
+    {
+        if (!(flags & AT_EMPTY_PATH))
+            return -ENOENT;
+        *out = base;
+        return 0;
     }
+    *out = fs_lookup(base, path);
+    return *out ? 0 : -ENOENT;
+}
+
+long sys_openat(int dirfd, const char *path, int flags, int mode)
+{
+    (void)mode;
+    node_t *base;
+    long err = at_base(dirfd, path, &base);
+    if (err)
+        return err;
+    if (!*path)
+        return -ENOENT;
+    node_t *f = fs_lookup(base, path);
+    if (f && (flags & O_CREAT) && (flags & O_EXCL))
+        return -EEXIST;
+    if (!f && (flags & O_CREAT))
+        f = create_path(base, path);
     if (!f)
-        return -1;
+        return -ENOENT;
+    if ((flags & O_DIRECTORY) && f->type != NODE_DIR)
+        return -ENOTDIR;
+    if ((flags & O_TRUNC) && f->type == NODE_FILE && (flags & O_ACCMODE) != O_RDONLY)
+        fs_truncate(f, 0);
     int fd = proc_alloc_fd(f);
+    if (fd >= 0)
+        proc_get_fd(fd)->flags = flags;
     return fd;
 }
+
+long sys_open(const char *path, int flags, int mode)
+{
+    return sys_openat(AT_FDCWD, path, flags, mode);
+}
 long sys_close(int fd)
 {
-    fd_entry_t *e = proc_get_fd(fd);
-    if (fd < 3 || !e)
-        return -1;
-    e->used = 0;
-    e->node = 0;
-    e->ofs = 0;
-    return 0;
+    return proc_close_fd(proc_current(), fd);
 }
+
+/* dup'd fds share one open file, offset included */
 long sys_dup(int oldfd)
 {
-    process_t *proc = proc_current();
-    if (oldfd < 0 || oldfd >= MAX_FDS || !proc->fds[oldfd].node)
-        return -1;
-    int newfd = proc_alloc_fd(proc->fds[oldfd].node);
-    if (newfd < 0)
-        return -1;
-    proc->fds[newfd] = proc->fds[oldfd];
-    return newfd;
+    file_t *f = proc_get_fd(oldfd);
+    if (!f)
+        return -EBADF;
+    file_get(f);
+    return proc_install_fd(proc_current(), -1, f);
 }
 
+/* newfd, if open, is closed and replaced in one step */
 long sys_dup2(int oldfd, int newfd)
 {
-    process_t *proc = proc_current();
-    if (oldfd < 0 || oldfd >= MAX_FDS || !proc->fds[oldfd].node)
-        return -1;
-    if (newfd < 0 || newfd >= MAX_FDS)
-        return -1;
-    if (proc->fds[newfd].node)
-        sys_close(newfd);
-    proc->fds[newfd] = proc->fds[oldfd];
-    return newfd;
+    file_t *f = proc_get_fd(oldfd);
+    if (!f || newfd < 0 || newfd >= PROC_FD_MAX)
+        return -EBADF;
+    if (oldfd == newfd)
+        return newfd;
+    file_get(f);
+    return proc_install_fd(proc_current(), newfd, f);
 }
 
-long sys_pipe(int *pipefd)
+long sys_fork(void)
 {
-    // TODO: implement pipes
-    (void)pipefd;
     return -1; // not implemented
 }
-
-long sys_fork(void)
+/* Lay out argc, argv, envp and the auxiliary vector at the top of the user
+ * stack page the way the SysV x86-64 ABI expects them at _start. Returns the
+ * initial user rsp, or 0 if everything does not fit in the page. */
+static uint64_t build_user_stack(char *page, uint64_t page_va, char *const argv[], char *const envp[],
+                                 const uint64_t *auxv, int auxc)
 {
-    return -1; // not implemented
+    uint64_t strs[64];
+    int argc = 0, envc = 0;
+    size_t top = 4096;
+    for (int pass = 0; pass < 2; pass++) {
+        char *const *vec = pass ? envp : argv;
+        for (int i = 0; vec && vec[i] && argc + envc < 63; i++) {
+            size_t len = kstrlen(vec[i]) + 1;
+            if (len + 256 > top)
+                return 0;
+            top -= len;
+            kmemcpy(page + top, vec[i], len);
+            strs[argc + envc] = page_va + top;
+            if (pass) envc++; else argc++;
+        }
+    }
+    size_t words = 1 + (size_t)argc + 1 + (size_t)envc + 1 + (size_t)auxc * 2 + 2;
+    if (top < words * 8 + 16)
+        return 0;
+    size_t sp = ((top & ~0xFULL) - words * 8) & ~0xFULL;
+    uint64_t *w = (uint64_t *)(page + sp);
+    *w++ = (uint64_t)argc;
+    for (int i = 0; i < argc; i++) *w++ = strs[i];
+    *w++ = 0;
+    for (int i = 0; i < envc; i++) *w++ = strs[argc + i];
+    *w++ = 0;
+    for (int i = 0; i < auxc * 2; i++) *w++ = auxv[i];
+    *w++ = AT_NULL;
+    *w++ = 0;
+    return page_va + sp;
 }
+
 long sys_execve(const char *path, char *const argv[], char *const envp[])
 {
-    (void)envp;
     if (!path || !*path)
         return -1;
     node_t *cwd = fs_cwd();
@@ -157,10 +463,18 @@ long sys_execve(const char *path, char *const argv[], char *const envp[])
         return -1;
     kprintf("[execve] start path='%s' size=%u\n", path, (unsigned)n->size);
 
-    /* Inspect ELF without mapping into kernel address space */
+    /* Inspect ELF without mapping into kernel address space. The headers
+     * must sit in the file's first block, which is all we read up front. */
+    static char hdr[4096];
+    size_t hdr_len = (size_t)fs_pread(n, hdr, sizeof(hdr), 0);
+    const Elf64_Ehdr *ehdr = (const Elf64_Ehdr*)hdr;
+    if (hdr_len < sizeof(Elf64_Ehdr) || ehdr->e_phoff + (uint64_t)ehdr->e_phnum * ehdr->e_phentsize > hdr_len) {
+        kprintf("[execve] ELF headers not in the first block (%s)\n", path);
+        return -1;
+    }
     elf_seg_info_t segs[16];
     uintptr_t entry = 0; 
-    int seg_count = elf_inspect(n->data, n->size, segs, 16, &entry);
+    int seg_count = elf_inspect(hdr, n->size, segs, 16, &entry);
     if (seg_count < 0) {
         kprintf("[execve] not a valid ELF (%s)\n", path);
         return -1;
@@ -171,8 +485,7 @@ long sys_execve(const char *path, char *const argv[], char *const envp[])
         return -1;
     }
     /* Basic feature rejection: look for PT_INTERP or dynamic / unsupported flags */
-    const Elf64_Ehdr *ehdr = (const Elf64_Ehdr*)n->data;
-    const unsigned char *baseptr_img = (const unsigned char*)n->data;
+    const unsigned char *baseptr_img = (const unsigned char*)hdr;
     /* Sanity checks on program header table before iterating */
     if (ehdr->e_phentsize < sizeof(Elf64_Phdr)) {
         kprintf("[execve] e_phentsize=%u < sizeof(Phdr) -> reject\n", (unsigned)ehdr->e_phentsize);
@@ -207,20 +520,12 @@ long sys_execve(const char *path, char *const argv[], char *const envp[])
         kprintf("[execve] PT_DYNAMIC present -> dynamic/reloc binary unsupported (reject)\n");
         return -1;
     }
-    /* Light scan for 64-bit SYSCALL instruction (0x0F 0x05). If present, warn: we only implement int 0x80 path. */
-    int found_syscall = 0;
-    const unsigned char *scan = (const unsigned char*)n->data;
-    for (size_t i=0;i+1<n->size && i<4096; i++) { /* limit scan for speed */
-        if (scan[i]==0x0F && scan[i+1]==0x05) { found_syscall=1; break; }
-    }
-    if (found_syscall) {
-        kprintf("[execve] WARNING: binary uses SYSCALL instruction (unsupported) -> abort\n");
-        return -1;
-    }
 
     /* Reset brk tracking for this process (fresh image). */
     process_t *pc = proc_current();
-    if (pc) { pc->brk_start = 0; pc->brk_curr = 0; }
+    if (pc) { pc->brk_start = 0; pc->brk_curr = 0; pc->image_hi = 0; }
+    /* Pages of the image being replaced; freed once the new one is live. */
+    int old_pages = pc ? pc->alloc_count : 0;
 
     uint64_t new_pml4 = vm_clone_current_pml4();
     if (!new_pml4)
@@ -251,7 +556,7 @@ long sys_execve(const char *path, char *const argv[], char *const envp[])
             /* copy portion overlapping file */
             if (page_offset < filesz) {
                 uintptr_t copy = filesz - page_offset; if (copy>4096) copy=4096;
-                kmemcpy((char*)phys, (char*)n->data + segs[si].offset + page_offset - delta, copy);
+                fs_pread(n, (char*)phys, copy, segs[si].offset + page_offset - delta);
             }
             vm_map_page_pml4(new_pml4, vaddr_aligned + p*4096, (uint64_t)phys, flags);
             proc_add_allocated_page((uint64_t)phys);
@@ -271,6 +576,8 @@ long sys_execve(const char *path, char *const argv[], char *const envp[])
     vm_map_page_pml4(new_pml4, USER_STACK_TOP - 4096, (uint64_t)ustack_phys, PTE_PRESENT | PTE_USER | PTE_WRITABLE);
     proc_add_allocated_page((uint64_t)ustack_phys);
 
+    uint64_t vdso_base = vdso_map(new_pml4);
+
     proc_set_pml4(new_pml4);
     proc_add_allocated_page(new_pml4);
 
@@ -279,40 +586,50 @@ long sys_execve(const char *path, char *const argv[], char *const envp[])
     uint64_t kstack_page = cur_rsp_k & ~0xFFFULL;
     vm_map_page_pml4(new_pml4, kstack_page, kstack_page, PTE_PRESENT | PTE_WRITABLE);
 
-    uint64_t cur_rsp;
-    __asm__ volatile("mov %%rsp, %0" : "=r"(cur_rsp));
-    process_t *curp = proc_current();
-    if (curp)
+    kprintf("[execve] prepared user image %s entry=%x pml4=%x\n", path, (unsigned)entry, (unsigned)new_pml4);
+    uint64_t auxv[14];
+    int auxc = 0;
+    for (int si = 0; si < seg_count; si++) {
+        if (ehdr->e_phoff >= segs[si].offset && ehdr->e_phoff < segs[si].offset + segs[si].filesz) {
+            auxv[auxc++] = AT_PHDR;
+            auxv[auxc++] = segs[si].vaddr + (ehdr->e_phoff - segs[si].offset);
+            break;
+        }
+    }
+    auxv[auxc++] = AT_PHENT; auxv[auxc++] = ehdr->e_phentsize;
+    auxv[auxc++] = AT_PHNUM; auxv[auxc++] = ehdr->e_phnum;
+    auxv[auxc++] = AT_PAGESZ; auxv[auxc++] = 4096;
+    auxv[auxc++] = AT_ENTRY; auxv[auxc++] = entry;
+    if (vdso_base) { auxv[auxc++] = AT_SYSINFO_EHDR; auxv[auxc++] = vdso_base; }
+    char *const fallback_argv[2] = { (char *)path, 0 };
+    if (!argv || !argv[0])
+        argv = fallback_argv;
+    uint64_t user_sp = build_user_stack((char *)ustack_phys, USER_STACK_TOP - 4096, argv, envp, auxv, auxc / 2);
+    if (!user_sp)
+        return -1;
+    /* Traps from the new image land on this thread's kernel stack; the boot
+     * thread has no separate one, so keep them below the live frames. */
+    thread_t *self = thread_current();
+    self->fs_base = 0;
+    if (!self->kstack)
+        self->kstack_top = (cur_rsp_k - 512) & ~0xFULL;
+    thread_activate(self);
+    if (pc)
     {
-        curp->kernel_saved_rsp = cur_rsp;
-        curp->kernel_saved_rip = (uint64_t)&&after_enter;
+        const char *base = path;
+        for (const char *s = path; *s; s++)
+            if (*s == '/')
+                base = s + 1;
+        kstrncpy(pc->name, base, PROC_NAME_MAX - 1);
+        pc->name[PROC_NAME_MAX - 1] = '\0';
+        /* argv has been copied and CR3 now points at the new image */
+        for (int i = 0; i < old_pages; i++)
+            pmm_free_page((void *)pc->alloc_pages[i]);
+        for (int i = old_pages; i < pc->alloc_count; i++)
+            pc->alloc_pages[i - old_pages] = pc->alloc_pages[i];
+        pc->alloc_count -= old_pages;
+        io_uring_release(pc);
     }
-
-after_enter:;
-    kprintf("[execve] prepared user image %s entry=%x pml4=%x\n", path, (unsigned)entry, (unsigned)new_pml4);
-    uint64_t user_sp = USER_STACK_TOP;
-    uint64_t str_off = 0x100;
-    char *phys_stack = (char *)ustack_phys;
-    size_t alen = 0;
-    while (path[alen])
-        alen++;
-    if (alen + 1 > 4096 - str_off)
-        return -1;
-
-    for (size_t i = 0; i <= alen; i++)
-        phys_stack[str_off + i] = path[i];
-    uint64_t arg0_vaddr = (USER_STACK_TOP - 4096) + str_off;
-    user_sp -= 8; /* argv NULL terminator */
-    uint64_t argv0_ptr_slot = user_sp - 8;
-    user_sp = argv0_ptr_slot;
-    uint64_t ptr_off = (uint64_t)(argv0_ptr_slot - (USER_STACK_TOP - 4096));
-    if (ptr_off + 8 > 4096)
-        return -1;
-    *(uint64_t *)((char *)ustack_phys + ptr_off) = arg0_vaddr;
-    uint64_t null_off = (uint64_t)(user_sp + 8 - (USER_STACK_TOP - 4096));
-    if (null_off + 8 <= 4096)
-        *(uint64_t *)((char *)ustack_phys + null_off) = 0;
-    user_sp &= ~0xFULL;
     kprintf("[execve] entering user entry=%x sp=%x pml4=%x (final)\n", (unsigned)entry, (unsigned)user_sp, (unsigned)new_pml4);
     enter_user(entry, user_sp, new_pml4);
     kprintf("[execve] ERROR: returned from enter_user (aborting exec)\n");
@@ -329,6 +646,8 @@ static void fill_stat(node_t *n, struct stat *st)
         st->st_mode = S_IFDIR;
     else if (n->type == NODE_CHAR)
         st->st_mode = S_IFCHR;
+    else if (n->type == NODE_PIPE)
+        st->st_mode = S_IFIFO;
     else
         st->st_mode = S_IFREG;
     st->st_mode |= S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
@@ -344,19 +663,50 @@ static void fill_stat(node_t *n, struct stat *st)
 
 long sys_stat(const char *path, void *ubuf)
 {
-    if (!path || !ubuf)
-        return -1;
-    node_t *cwd = fs_cwd();
-    node_t *n = fs_lookup(cwd, path);
-    if (!n)
-        return -1;
+    return sys_newfstatat(AT_FDCWD, path, ubuf, 0);
+}
+
+long sys_newfstatat(int dirfd, const char *path, void *ubuf, int flags)
+{
+    node_t *n;
+    if (!ubuf)
+        return -EFAULT;
+    long err = at_lookup(dirfd, path, flags, &n);
+    if (err)
+        return err;
     fill_stat(n, (struct stat *)ubuf);
     return 0;
 }
+
+/* Everything is in memory, so mask does not change the work done. */
+long sys_statx(int dirfd, const char *path, int flags, unsigned mask, void *ubuf)
+{
+    (void)mask;
+    node_t *n;
+    struct stat st;
+    if (!ubuf)
+        return -EFAULT;
+    long err = at_lookup(dirfd, path, flags, &n);
+    if (err)
+        return err;
+    fill_stat(n, &st);
+    struct statx *sx = ubuf;
+    kmemset(sx, 0, sizeof(*sx));
+    sx->stx_mask = STATX_BASIC_STATS;
+    sx->stx_blksize = (uint32_t)st.st_blksize;
+    sx->stx_nlink = st.st_nlink;
+    sx->stx_uid = st.st_uid;
+    sx->stx_gid = st.st_gid;
+    sx->stx_mode = (uint16_t)st.st_mode;
+    sx->stx_ino = st.st_ino;
+    sx->stx_size = st.st_size;
+    sx->stx_blocks = st.st_blocks;
+    return 0;
+}
 long sys_fstat(int fd, void *ubuf)
 {
-    fd_entry_t *e = proc_get_fd(fd);
-    if (fd < 3 || !e || !ubuf)
+    file_t *e = proc_get_fd(fd);
+    if (!e || !ubuf)
         return -1;
     node_t *n = e->node;
     if (!n)
@@ -366,17 +716,28 @@ long sys_fstat(int fd, void *ubuf)
 }
 
 int sys_isatty(int fd) {
-    fd_entry_t *e = proc_get_fd(fd);
+    file_t *e = proc_get_fd(fd);
     if (!e) return 0;
     if (e->node && e->node->type == NODE_CHAR) return 1;
     return 0;
 }
 long sys_lseek(int fd, long off, int whence)
 {
-    fd_entry_t *e = proc_get_fd(fd);
-    if (fd < 3 || !e)
+    file_t *e = proc_get_fd(fd);
+    if (!e)
         return -1;
     node_t *n = e->node;
+    if (!n || n->type == NODE_PIPE || n->type == NODE_CHAR)
+        return -ESPIPE;
+    if (n && n->type == NODE_DIR)
+    {
+        /* only rewinding or returning to a d_off makes sense */
+        if (whence != 0 || off < 0)
+            return -EINVAL;
+        e->ofs = (size_t)off;
+        e->dir_pos = 0;
+        return off;
+    }
     size_t newofs;
     switch (whence)
     {
@@ -398,30 +759,136 @@ long sys_lseek(int fd, long off, int whence)
     return (long)newofs;
 }
 
-long sys_exit(int code)
+/* Memory files are already as durable as they get; a disk file's blocks
+ * are shared with the rest of the volume in the cache, so the whole
+ * volume is flushed, drive write cache included. */
+long sys_fsync(int fd)
 {
-    kprintf("[proc] exit code=%d\n", code);
-    process_t *cur = proc_current();
-    if (cur)
+    file_t *e = proc_get_fd(fd);
+    if (!e || !e->node)
+        return -EBADF;
+    if (e->node->type == NODE_PIPE || e->node->type == NODE_CHAR)
+        return -EINVAL;
+    if (fs_sync(e->node) < 0)
+        return -EIO;
+    return 0;
+}
+
+/* The inode goes out with the data anyway. */
+long sys_fdatasync(int fd)
+{
+    return sys_fsync(fd);
+}
+
+long sys_sync(void)
+{
+    fs_sync(0);
+    return 0;
+}
+
+static uint8_t dirent_type(node_t *n)
+{
+    switch (n->type)
     {
-        if (cur->pml4_phys)
-        {
-            for (int i = 0; i < cur->alloc_count; i++)
-            {
-                pmm_free_page((void *)cur->alloc_pages[i]);
-            }
-            proc_free_allocated_pages();
-            uint64_t kernel_cr3 = vm_get_kernel_cr3();
-            vm_set_cr3(kernel_cr3);
-            cur->pml4_phys = 0;
-        }
+    case NODE_DIR:
+        return DT_DIR;
+    case NODE_CHAR:
+        return DT_CHR;
+    case NODE_PIPE:
+        return DT_FIFO;
+    default:
+        return DT_REG;
     }
+}
+
+/* Emit one record at buf+pos; 0 when it does not fit. */
+static size_t dirent_put(char *buf, size_t pos, unsigned long count, node_t *n, const char *name, size_t next)
+{
+    size_t len = kstrlen(name);
+    size_t reclen = (sizeof(struct linux_dirent64) + len + 1 + 7) & ~(size_t)7;
+    if (pos + reclen > count)
+        return 0;
+    struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + pos);
+    d->d_ino = (uintptr_t)n;
+    d->d_off = (int64_t)next;
+    d->d_reclen = (uint16_t)reclen;
+    d->d_type = dirent_type(n);
+    kmemcpy(d->d_name, name, len + 1);
+    return reclen;
+}
 
-    extern void context_restore(uint64_t rsp, uint64_t rip);
-    if (cur && cur->kernel_saved_rip)
+/* Fill dirp with as many entries as fit. Positions 0 and 1 are "." and
+ * "..", then the children in list order. The fd remembers the child at its
+ * position so a walk costs one call per buffer, not a rescan per entry; if
+ * that child was unlinked meanwhile the position is found again by count. */
+long sys_getdents64(int fd, void *dirp, unsigned long count)
+{
+    file_t *e = proc_get_fd(fd);
+    if (!e || !e->node)
+        return -EBADF;
+    node_t *dir = e->node;
+    if (dir->type != NODE_DIR)
+        return -ENOTDIR;
+    if (!dirp)
+        return -EFAULT;
+    char *buf = (char *)dirp;
+    size_t pos = 0, r;
+    while (e->ofs < 2)
+    {
+        node_t *n = e->ofs == 0 ? dir : (dir->parent ? dir->parent : dir);
+        r = dirent_put(buf, pos, count, n, e->ofs == 0 ? "." : "..", e->ofs + 1);
+        if (!r)
+            return pos ? (long)pos : -EINVAL;
+        pos += r;
+        e->ofs++;
+        e->dir_pos = 0;
+    }
+    node_t *c = e->dir_pos;
+    if (!c || c->parent != dir)
     {
-        context_restore(cur->kernel_saved_rsp, cur->kernel_saved_rip);
+        c = fs_first_child(dir);
+        for (size_t i = 2; c && i < e->ofs; i++)
+            c = c->sibling;
     }
+    for (; c; c = c->sibling)
+    {
+        r = dirent_put(buf, pos, count, c, c->name, e->ofs + 1);
+        if (!r)
+        {
+            e->dir_pos = c;
+            return pos ? (long)pos : -EINVAL;
+        }
+        pos += r;
+        e->ofs++;
+    }
+    e->dir_pos = 0;
+    return (long)pos;
+}
+
+/* Process exit: other threads leave at their next return to user mode
+ * (sched_kill wakes any that sleep), and this one sleeps until they have
+ * gone. Then the process becomes a zombie for its parent to reap with
+ * wait4 and this thread ends. A clone thread leaves the last step to the
+ * main thread, which it has just killed, so two exiting threads never
+ * wait for each other. The boot thread runs init and the shell and has
+ * nowhere to exit to. */
+long sys_exit(int code)
+{
+    kprintf("[proc] exit code=%d\n", code);
+    process_t *cur = proc_current();
+    thread_t *self = thread_current();
+    if (!cur || !self->kstack)
+        return 0;
+    cur->exit_code = code;
+    sched_kill_process(cur);
+    if (self->is_clone)
+        kthread_exit();
+    uint64_t flags = irq_save();
+    while (sched_count_threads(cur) > 1)
+        waitq_sleep(&cur->thread_wait);
+    irq_restore(flags);
+    proc_exit(cur, code);
+    kthread_exit();
     return 0;
 }
 
@@ -461,42 +928,3 @@ long sys_brk(void *addr)
     p->brk_curr = new_brk;
     return (long)p->brk_curr;
 }
-
-long syscall_dispatch(long num, long a1, long a2, long a3, long a4, long a5, long a6)
-{
-    (void)a5;
-    (void)a6;
-    switch (num)
-    {
-    case SYS_read:
-        return sys_read((int)a1, (void *)a2, (unsigned long)a3);
-    case SYS_write:
-        return sys_write((int)a1, (const void *)a2, (unsigned long)a3);
-    case SYS_open:
-        return sys_open((const char *)a1, (int)a2, (int)a3);
-    case SYS_close:
-        return sys_close((int)a1);
-    case SYS_stat:
-        return sys_stat((const char *)a1, (void *)a2);
-    case SYS_fstat:
-        return sys_fstat((int)a1, (void *)a2);
-    case SYS_lseek:
-        return sys_lseek((int)a1, a2, (int)a3);
-    case SYS_pipe:
-        return sys_pipe((int *)a1);
-    case SYS_dup:
-        return sys_dup((int)a1);
-    case SYS_dup2:
-        return sys_dup2((int)a1, (int)a2);
-    case SYS_fork:
-        return sys_fork();
-    case SYS_execve:
-        return sys_execve((const char *)a1, (char *const *)a2, (char *const *)a3);
-    case SYS_exit:
-        return sys_exit((int)a1);
-    case SYS_brk:
-        return sys_brk((void*)a1);
-    default:
-        return -1;
-    }
-}
@@ -0,0 +1,157 @@
+#include "syscall.h"
+#include "proc.h"
+#include "futex.h"
+#include "ktime.h"
+#include "kerrno.h"
+#include "io_uring.h"
+#include "pipe.h"
+#include "poll.h"
+#include "irq.h"
+#include "strace.h"
+#include <stdint.h>
+
+/* System call table, indexed by number. Every argument is an integer or a
+ * pointer, so under the SysV ABI each handler can be called through the
+ * common six-long signature: unused registers are ignored and int
+ * parameters read the low half of their register. */
+
+typedef long (*syscall_fn_t)(long, long, long, long, long, long);
+
+typedef struct
+{
+    syscall_fn_t fn;
+    const char *name;
+    int nargs; /* for decoding traces */
+} syscall_entry_t;
+
+/* through void (*)(void), which GCC accepts as a generic function pointer */
+#define SYSCALL(nr, f, n) [nr] = {(syscall_fn_t)(void (*)(void))(f), #nr + 4, n} /* name without "SYS_" */
+
+static const syscall_entry_t syscall_table[NR_SYSCALLS] = {
+    SYSCALL(SYS_read, sys_read, 3),
+    SYSCALL(SYS_write, sys_write, 3),
+    SYSCALL(SYS_open, sys_open, 3),
+    SYSCALL(SYS_close, sys_close, 1),
+    SYSCALL(SYS_stat, sys_stat, 2),
+    SYSCALL(SYS_fstat, sys_fstat, 2),
+    SYSCALL(SYS_poll, sys_poll, 3),
+    SYSCALL(SYS_lseek, sys_lseek, 3),
+    SYSCALL(SYS_brk, sys_brk, 1),
+    SYSCALL(SYS_pread64, sys_pread64, 4),
+    SYSCALL(SYS_pwrite64, sys_pwrite64, 4),
+    SYSCALL(SYS_readv, sys_readv, 3),
+    SYSCALL(SYS_writev, sys_writev, 3),
+    SYSCALL(SYS_pipe, sys_pipe, 1),
+    SYSCALL(SYS_sched_yield, sys_sched_yield, 0),
+    SYSCALL(SYS_dup, sys_dup, 1),
+    SYSCALL(SYS_dup2, sys_dup2, 2),
+    SYSCALL(SYS_nanosleep, sys_nanosleep, 2),
+    SYSCALL(SYS_getpid, sys_getpid, 0),
+    SYSCALL(SYS_sendfile, sys_sendfile, 4),
+    SYSCALL(SYS_clone, sys_clone, 5),
+    SYSCALL(SYS_fork, sys_fork, 0),
+    SYSCALL(SYS_execve, sys_execve, 3),
+    SYSCALL(SYS_exit, sys_exit_thread, 1),
+    SYSCALL(SYS_wait4, sys_wait4, 4),
+    SYSCALL(SYS_fsync, sys_fsync, 1),
+    SYSCALL(SYS_fdatasync, sys_fdatasync, 1),
+    SYSCALL(SYS_gettimeofday, sys_gettimeofday, 2),
+    SYSCALL(SYS_getppid, sys_getppid, 0),
+    SYSCALL(SYS_arch_prctl, sys_arch_prctl, 2),
+    SYSCALL(SYS_sync, sys_sync, 0),
+    SYSCALL(SYS_gettid, sys_gettid, 0),
+    SYSCALL(SYS_time, sys_time, 1),
+    SYSCALL(SYS_futex, sys_futex, 6),
+    SYSCALL(SYS_epoll_create, sys_epoll_create, 1),
+    SYSCALL(SYS_getdents64, sys_getdents64, 3),
+    SYSCALL(SYS_set_tid_address, sys_set_tid_address, 1),
+    SYSCALL(SYS_clock_gettime, sys_clock_gettime, 2),
+    SYSCALL(SYS_exit_group, sys_exit_group, 1),
+    SYSCALL(SYS_epoll_wait, sys_epoll_wait, 4),
+    SYSCALL(SYS_epoll_ctl, sys_epoll_ctl, 4),
+    SYSCALL(SYS_openat, sys_openat, 4),
+    SYSCALL(SYS_newfstatat, sys_newfstatat, 4),
+    SYSCALL(SYS_splice, sys_splice, 6),
+    SYSCALL(SYS_tee, sys_tee, 4),
+    SYSCALL(SYS_epoll_create1, sys_epoll_create1, 1),
+    SYSCALL(SYS_pipe2, sys_pipe2, 2),
+    SYSCALL(SYS_copy_file_range, sys_copy_file_range, 6),
+    SYSCALL(SYS_statx, sys_statx, 5),
+    SYSCALL(SYS_io_uring_setup, sys_io_uring_setup, 2),
+    SYSCALL(SYS_io_uring_enter, sys_io_uring_enter, 4),
+};
+
+#if SYSCALL_STATS
+static syscall_stat_t syscall_stats[NR_SYSCALLS];
+
+static void syscall_stat_add(syscall_stat_t *s, uint64_t cycles)
+{
+    int b = cycles ? 63 - __builtin_clzll(cycles) - SYSCALL_HIST_SHIFT : 0;
+    if (b < 0)
+        b = 0;
+    if (b >= SYSCALL_HIST_BUCKETS)
+        b = SYSCALL_HIST_BUCKETS - 1;
+    s->total_cycles += cycles;
+    s->hist[b]++;
+}
+#endif
+
+static inline long syscall_invoke(long num, long a1, long a2, long a3, long a4, long a5, long a6)
+{
+    if (num < 0 || num >= NR_SYSCALLS || !syscall_table[num].fn)
+        return -ENOSYS;
+#if SYSCALL_STATS
+    /* counted up front: exit and execve do not come back */
+    syscall_stat_t *s = &syscall_stats[num];
+    s->count++;
+    uint64_t t0 = irq_rdtsc();
+    long r = syscall_table[num].fn(a1, a2, a3, a4, a5, a6);
+    syscall_stat_add(s, irq_rdtsc() - t0);
+    return r;
+#else
+    return syscall_table[num].fn(a1, a2, a3, a4, a5, a6);
+#endif
+}
+
+/* Out of line so the untraced path stays one predicted branch. */
+static __attribute__((noinline)) long syscall_traced(long num, long a1, long a2, long a3, long a4, long a5, long a6)
+{
+    strace_rec_t *rec = strace_enter(num, a1, a2, a3, a4, a5, a6);
+    uint32_t seq = rec ? rec->seq : 0;
+    long r = syscall_invoke(num, a1, a2, a3, a4, a5, a6);
+    if (rec)
+        strace_exit(rec, seq, r);
+    return r;
+}
+
+long syscall_dispatch(long num, long a1, long a2, long a3, long a4, long a5, long a6)
+{
+    if (__builtin_expect(strace_active != 0, 0))
+        return syscall_traced(num, a1, a2, a3, a4, a5, a6);
+    return syscall_invoke(num, a1, a2, a3, a4, a5, a6);
+}
+
+const char *syscall_name(long nr)
+{
+    if (nr < 0 || nr >= NR_SYSCALLS)
+        return 0;
+    return syscall_table[nr].name;
+}
+
+int syscall_nargs(long nr)
+{
+    if (nr < 0 || nr >= NR_SYSCALLS)
+        return 0;
+    return syscall_table[nr].nargs;
+}
+
+const syscall_stat_t *syscall_get_stats(long nr)
+{
+#if SYSCALL_STATS
+    if (nr >= 0 && nr < NR_SYSCALLS)
+        return &syscall_stats[nr];
+#else
+    (void)nr;
+#endif
+    return 0;
+}
@@ -0,0 +1,228 @@
+#include "timer.h"
+#include "irq.h"
+#include "kprint.h"
+#include "sched.h"
+#include <stdint.h>
+
+/* Hierarchical timer wheel: 256 one-tick slots followed by four 64-slot
+ * levels, each slot covering 64x the range of the level below. Insert and
+ * delete are O(1); a level is cascaded down once per wrap of the level
+ * below it, so expiry is amortised O(1) per timer. */
+#define TVR_BITS 8
+#define TVN_BITS 6
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_MASK (TVR_SIZE - 1)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TV_LEVELS 4
+#define MAX_TVAL ((1ULL << (TVR_BITS + TV_LEVELS * TVN_BITS)) - 1)
+
+/* Poll a wait condition this many times before halting for an interrupt;
+ * most devices answer well within the burst. */
+#define WAIT_SPIN_POLLS 256
+
+static ktimer_t *tv1[TVR_SIZE];
+static ktimer_t *tvn[TV_LEVELS][TVN_SIZE];
+static uint64_t wheel_clk = 0;
+
+static void slot_insert(ktimer_t **head, ktimer_t *t)
+{
+    t->next = *head;
+    if (t->next)
+        t->next->pprev = &t->next;
+    *head = t;
+    t->pprev = head;
+}
+
+static void slot_remove(ktimer_t *t)
+{
+    *t->pprev = t->next;
+    if (t->next)
+        t->next->pprev = t->pprev;
+    t->next = 0;
+    t->pprev = 0;
+}
+
+static void internal_add(ktimer_t *t)
+{
+    uint64_t expires = t->expires;
+    if ((int64_t)(expires - wheel_clk) < 0)
+        expires = wheel_clk; /* already due: fire on the next run */
+    uint64_t idx = expires - wheel_clk;
+    if (idx < TVR_SIZE)
+    {
+        slot_insert(&tv1[expires & TVR_MASK], t);
+        return;
+    }
+    if (idx > MAX_TVAL)
+    {
+        expires = wheel_clk + MAX_TVAL;
+        idx = MAX_TVAL;
+    }
+    int lvl = 0;
+    while (lvl < TV_LEVELS - 1 && idx >= (1ULL << (TVR_BITS + (lvl + 1) * TVN_BITS)))
+        lvl++;
+    slot_insert(&tvn[lvl][(expires >> (TVR_BITS + lvl * TVN_BITS)) & TVN_MASK], t);
+}
+
+/* Re-file every timer of one upper-level slot; returns the slot index so the
+ * caller knows whether this level wrapped too. */
+static int cascade(int lvl)
+{
+    int index = (int)((wheel_clk >> (TVR_BITS + lvl * TVN_BITS)) & TVN_MASK);
+    ktimer_t *t = tvn[lvl][index];
+    tvn[lvl][index] = 0;
+    while (t)
+    {
+        ktimer_t *next = t->next;
+        t->next = 0;
+        t->pprev = 0;
+        internal_add(t);
+        t = next;
+    }
+    return index;
+}
+
+void timer_init(void)
+{
+    wheel_clk = ticks;
+    kprintf("[timer] wheel ready (%u+%ux%u slots, HZ=%u)\n", (unsigned)TVR_SIZE, (unsigned)TV_LEVELS, (unsigned)TVN_SIZE, (unsigned)HZ);
+}
+
+void timer_setup(ktimer_t *t, void (*fn)(void *), void *arg)
+{
+    t->next = 0;
+    t->pprev = 0;
+    t->expires = 0;
+    t->fn = fn;
+    t->arg = arg;
+}
+
+void timer_add(ktimer_t *t, uint64_t expires)
+{
+    uint64_t flags = irq_save();
+    if (timer_pending(t))
+        slot_remove(t);
+    t->expires = expires;
+    internal_add(t);
+    irq_restore(flags);
+}
+
+/* Re-arm a timer; returns 1 if it was still pending. */
+int timer_mod(ktimer_t *t, uint64_t expires)
+{
+    uint64_t flags = irq_save();
+    int was = timer_pending(t);
+    if (was)
+        slot_remove(t);
+    t->expires = expires;
+    internal_add(t);
+    irq_restore(flags);
+    return was;
+}
+
+int timer_del(ktimer_t *t)
+{
+    uint64_t flags = irq_save();
+    int was = timer_pending(t);
+    if (was)
+        slot_remove(t);
+    irq_restore(flags);
+    return was;
+}
+
+/* Timer softirq: catch the wheel up to `ticks` and run every timer that
+ * came due. Wheel updates happen with interrupts off; callbacks run with the
+ * caller's interrupt state. */
+void timer_run(void)
+{
+    uint64_t flags = irq_save();
+    while ((int64_t)(ticks - wheel_clk) >= 0)
+    {
+        int index = (int)(wheel_clk & TVR_MASK);
+        if (!index)
+        {
+            for (int lvl = 0; lvl < TV_LEVELS; lvl++)
+                if (cascade(lvl) != 0)
+                    break;
+        }
+        wheel_clk++;
+        ktimer_t *t;
+        while ((t = tv1[index]) != 0)
+        {
+            slot_remove(t);
+            irq_restore(flags);
+            t->fn(t->arg);
+            flags = irq_save();
+        }
+    }
+    irq_restore(flags);
+}
+
+static void wait_expired(void *arg) { *(volatile int *)arg = 1; }
+
+static int wait_until(int (*cond)(void *), void *arg, uint64_t expires)
+{
+    volatile int expired = 0;
+    ktimer_t t;
+    timer_setup(&t, wait_expired, (void *)&expired);
+    timer_add(&t, expires);
+    uint64_t flags = irq_save();
+    int met;
+    while (!(met = cond(arg)) && !expired)
+        sched_idle();
+    irq_restore(flags);
+    timer_del(&t);
+    return met ? 0 : -1;
+}
+
+/* Wait until cond(arg) is true or timeout_ms passes. cond reads device
+ * state that nothing signals, so it is polled: after a short burst the
+ * caller idles (running other kernel threads, or halting until the next
+ * device IRQ or tick) between polls instead of spinning. Returns 0 when
+ * the condition was met, -1 on timeout. */
+int timer_wait_event(int (*cond)(void *), void *arg, uint32_t timeout_ms)
+{
+    for (int i = 0; i < WAIT_SPIN_POLLS; i++)
+    {
+        if (cond(arg))
+            return 0;
+        __asm__ volatile("pause");
+    }
+    if (!timeout_ms)
+        return -1;
+    return wait_until(cond, arg, ticks + timer_ms_to_ticks(timeout_ms));
+}
+
+typedef struct sleeper
+{
+    thread_t *t;
+    volatile int expired;
+} sleeper_t;
+
+static void sleeper_wake(void *arg)
+{
+    sleeper_t *s = (sleeper_t *)arg;
+    s->expired = 1;
+    sched_wakeup(s->t);
+}
+
+/* Block the calling thread for n ticks: the timer wakes it, and so does
+ * sched_kill. Returns 0 once the time has passed, -1 if killed first. */
+int timer_sleep_ticks(uint64_t n)
+{
+    if (!n)
+        return 0;
+    sleeper_t s = {thread_current(), 0};
+    ktimer_t t;
+    timer_setup(&t, sleeper_wake, &s);
+    uint64_t flags = irq_save();
+    timer_add(&t, ticks + n);
+    s.t->sleep_intr = 1;
+    while (!s.expired && !s.t->killed)
+        sched_block();
+    s.t->sleep_intr = 0;
+    irq_restore(flags);
+    timer_del(&t);
+    return s.expired ? 0 : -1;
+}
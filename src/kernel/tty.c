@@ -12,6 +12,7 @@ void tty_init(void) {
         ttys[i].index = i;
         ttys[i].in_head = ttys[i].in_tail = 0;
         ttys[i].foreground = (i==0);
+        ttys[i].poll.first = 0;
     }
 }
 
@@ -30,6 +31,7 @@ void tty_kbd_putc(char c) {
     }
     t->inbuf[t->in_head] = c;
     t->in_head = nh;
+    poll_notify(&t->poll, POLLIN);
 }
 
 int tty_read(tty_t *t, char *buf, size_t count) {
@@ -42,6 +44,11 @@ int tty_read(tty_t *t, char *buf, size_t count) {
     return (int)r;
 }
 
+unsigned tty_poll(tty_t *t, poll_head_t **head) {
+    *head = &t->poll;
+    return POLLOUT | (t->in_tail != t->in_head ? POLLIN : 0);
+}
+
 int tty_write(tty_t *t, const char *buf, size_t count) {
     (void)t; // currently single display; just print to kprint
     for (size_t i=0;i<count;i++) kputc(buf[i]);
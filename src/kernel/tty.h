@@ -1,6 +1,7 @@
 #pragma once
 #include <stddef.h>
 #include <stdint.h>
+#include "poll.h"
 
 #define TTY_MAX 4
 #define TTY_BUF 1024
@@ -12,6 +13,7 @@ typedef struct tty
     volatile uint16_t in_head; // write position (producer: IRQ)
     volatile uint16_t in_tail; // read position (consumer: sys_read)
     int foreground;            // 1 if active tty for keyboard input
+    poll_head_t poll;          // poll/epoll watchers of the input queue
 } tty_t;
 
 void tty_init(void);
@@ -22,4 +24,5 @@ void tty_set_active(int idx);
 void tty_kbd_putc(char c);
 int tty_read(tty_t *t, char *buf, size_t count);
 int tty_write(tty_t *t, const char *buf, size_t count);
+unsigned tty_poll(tty_t *t, poll_head_t **head);
 void tty_register_fs(void);
@@ -3,9 +3,21 @@
 #include "../drivers/keyboard.h"
 #include "video.h"
 #include "mouse.h"
+#include "timer.h"
+#include "sched.h"
+#include "irq.h"
 #include <stdint.h>
 
-extern volatile uint64_t ticks; /* from irq_timer.c */
+/* Clock refresh is driven by a periodic timer instead of polling ticks. */
+static ktimer_t clock_timer;
+static volatile int clock_due = 1;
+
+static void clock_timer_fn(void *arg)
+{
+    (void)arg;
+    clock_due = 1;
+    timer_add(&clock_timer, clock_timer.expires + HZ);
+}
 
 static void draw_frame(void)
 {
@@ -15,7 +27,7 @@ static void draw_frame(void)
 static void update_clock(void)
 {
     uint64_t t = ticks;
-    uint64_t seconds = t / 100; // assume 100Hz PIT; adjust later
+    uint64_t seconds = t / HZ;
     uint64_t mins = seconds / 60;
     uint64_t hrs = mins / 60;
     seconds %= 60;
@@ -149,7 +161,9 @@ void ui_run(void)
     {
         draw_frame();
     }
-    uint64_t last_tick = 0;
+    timer_setup(&clock_timer, clock_timer_fn, 0);
+    timer_add(&clock_timer, ticks + HZ);
+    clock_due = 1;
 
     int sel_x = 0, sel_y = 0;
     const int icon_w = 64, icon_h = 48;
@@ -186,11 +200,12 @@ void ui_run(void)
                         video_putpixel(cx + b, cy + r, 0xFFFFFF);
             }
         }
-        if (ticks - last_tick >= 100)
+        if (clock_due)
         { // update once per second
+            clock_due = 0;
             if (m && m->available)
             {
-                uint64_t t = ticks / 100;
+                uint64_t t = ticks / HZ;
                 uint64_t s = t % 60;
                 uint64_t mnt = (t / 60) % 60;
                 uint64_t h = (t / 3600);
@@ -204,7 +219,6 @@ void ui_run(void)
             {
                 update_clock();
             }
-            last_tick = ticks - ((ticks - last_tick) % 100);
         }
         int v = kbd_getc_nonblock();
         if (v >= 0)
@@ -215,6 +229,7 @@ void ui_run(void)
                     kprintf("\n[ui] exit (fb)\n");
                 else
                     kprintf("\n[ui] exit\n");
+                timer_del(&clock_timer);
                 return;
             }
             if (v == 'm')
@@ -296,5 +311,9 @@ void ui_run(void)
                 }
             }
         }
+        /* idle until the next key, mouse packet or clock refresh */
+        uint64_t flags = irq_save();
+        sched_idle();
+        irq_restore(flags);
     }
 }
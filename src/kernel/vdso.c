@@ -0,0 +1,58 @@
+#include "vdso.h"
+#include "pmm.h"
+#include "vm.h"
+#include "kprint.h"
+#include "string.h"
+#include <stdint.h>
+
+/* build/vdso.so embedded by the Makefile (objcopy -I binary) */
+extern char __attribute__((weak)) _binary_build_vdso_so_start[];
+extern char __attribute__((weak)) _binary_build_vdso_so_end[];
+
+/* Shared by every process; identity mapped, so its address is its phys. */
+static union {
+    struct vdso_data d;
+    uint8_t page[PAGE_SIZE];
+} vdso_vvar __attribute__((aligned(PAGE_SIZE)));
+
+static void *vdso_pages[VDSO_MAX_PAGES];
+static int vdso_npages = 0;
+
+struct vdso_data *vdso_data(void) { return &vdso_vvar.d; }
+
+void vdso_init(void)
+{
+    if (vdso_npages || !_binary_build_vdso_so_start)
+        return;
+    size_t size = _binary_build_vdso_so_end - _binary_build_vdso_so_start;
+    int pages = (int)((size + PAGE_SIZE - 1) / PAGE_SIZE);
+    if (pages > VDSO_MAX_PAGES)
+    {
+        kprintf("[vdso] image too large (%u bytes)\n", (unsigned)size);
+        return;
+    }
+    for (int i = 0; i < pages; i++)
+    {
+        void *p = pmm_alloc_page();
+        if (!p)
+            return;
+        size_t off = (size_t)i * PAGE_SIZE;
+        size_t n = size - off < PAGE_SIZE ? size - off : PAGE_SIZE;
+        kmemcpy(p, _binary_build_vdso_so_start + off, n);
+        vdso_pages[i] = p;
+    }
+    vdso_npages = pages;
+    kprintf("[vdso] image %u bytes at %x\n", (unsigned)size, (unsigned)VDSO_TEXT_VADDR);
+}
+
+/* Map the data page and image read-only; the pages are shared, so they are
+ * deliberately not added to the process allocation list. */
+uint64_t vdso_map(uint64_t pml4_phys)
+{
+    if (!vdso_npages)
+        return 0;
+    vm_map_page_pml4(pml4_phys, VDSO_DATA_VADDR, (uint64_t)(uintptr_t)&vdso_vvar, PTE_PRESENT | PTE_USER);
+    for (int i = 0; i < vdso_npages; i++)
+        vm_map_page_pml4(pml4_phys, VDSO_TEXT_VADDR + (uint64_t)i * PAGE_SIZE, (uint64_t)(uintptr_t)vdso_pages[i], PTE_PRESENT | PTE_USER);
+    return VDSO_TEXT_VADDR;
+}
@@ -0,0 +1,284 @@
+// pthread-style shim for user programs; empty in the kernel build
+#ifdef __NEWLIB_USER__
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <syscall.h>
+#include <futex.h>
+#include <snow_pthread.h>
+
+/* Thread control block. FS base points at it, and %fs:0 holds its own
+ * address as the x86-64 TLS ABI expects. */
+struct snow_pthread
+{
+    struct snow_pthread *self;
+    volatile int tid; /* cleared by the kernel when the thread exits */
+    void *(*fn)(void *);
+    void *arg;
+    void *ret;
+    void *stack;
+};
+
+static struct snow_pthread main_thread;
+static int threads_ready = 0;
+
+static inline long tsys(long n, long a1, long a2, long a3, long a4, long a5, long a6)
+{
+    register long rax __asm__("rax") = n;
+    register long rdi __asm__("rdi") = a1;
+    register long rsi __asm__("rsi") = a2;
+    register long rdx __asm__("rdx") = a3;
+    register long r10 __asm__("r10") = a4;
+    register long r8 __asm__("r8") = a5;
+    register long r9 __asm__("r9") = a6;
+    __asm__ volatile("syscall" : "+r"(rax) : "r"(rdi), "r"(rsi), "r"(rdx), "r"(r10), "r"(r8), "r"(r9) : "rcx", "r11", "memory");
+    return rax;
+}
+
+static void ufutex_wait(volatile int *addr, int val)
+{
+    tsys(SYS_futex, (long)addr, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, val, 0, 0, 0);
+}
+
+static void ufutex_wake(volatile int *addr, int n)
+{
+    tsys(SYS_futex, (long)addr, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, n, 0, 0, 0);
+}
+
+static void threads_init(void)
+{
+    if (threads_ready)
+        return;
+    main_thread.self = &main_thread;
+    main_thread.tid = (int)tsys(SYS_gettid, 0, 0, 0, 0, 0, 0);
+    tsys(SYS_arch_prctl, ARCH_SET_FS, (long)&main_thread, 0, 0, 0, 0);
+    threads_ready = 1;
+}
+
+/* long __snow_clone(flags, child_sp, ptid, ctid, tls): the child pops its
+ * control block off the new stack and enters __snow_thread_start. */
+void __snow_thread_start(struct snow_pthread *t) __attribute__((noreturn, used));
+__asm__(".text\n"
+        ".global __snow_clone\n"
+        "__snow_clone:\n"
+        "    mov %rcx, %r10\n"
+        "    mov $56, %eax\n"
+        "    syscall\n"
+        "    test %rax, %rax\n"
+        "    jnz 1f\n"
+        "    pop %rdi\n"
+        "    and $-16, %rsp\n"
+        "    call __snow_thread_start\n"
+        "    hlt\n"
+        "1:  ret\n");
+long __snow_clone(unsigned long flags, void *child_sp, volatile int *ptid, volatile int *ctid, void *tls);
+
+void __snow_thread_start(struct snow_pthread *t)
+{
+    pthread_exit(t->fn(t->arg));
+}
+
+int pthread_attr_init(pthread_attr_t *attr)
+{
+    attr->stacksize = PTHREAD_STACK_DEFAULT;
+    return 0;
+}
+
+int pthread_attr_setstacksize(pthread_attr_t *attr, size_t size)
+{
+    if (size < 4096)
+        return EINVAL;
+    attr->stacksize = size;
+    return 0;
+}
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*fn)(void *), void *arg)
+{
+    threads_init();
+    size_t size = attr ? attr->stacksize : PTHREAD_STACK_DEFAULT;
+    struct snow_pthread *t = malloc(sizeof(*t));
+    void *stack = malloc(size);
+    if (!t || !stack)
+    {
+        free(t);
+        free(stack);
+        return EAGAIN;
+    }
+    t->self = t;
+    t->tid = 0;
+    t->fn = fn;
+    t->arg = arg;
+    t->ret = 0;
+    t->stack = stack;
+    uint64_t *sp = (uint64_t *)(((uintptr_t)stack + size) & ~(uintptr_t)15);
+    *--sp = (uint64_t)(uintptr_t)t;
+    unsigned long flags = CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD | CLONE_SYSVSEM |
+                          CLONE_SETTLS | CLONE_PARENT_SETTID | CLONE_CHILD_CLEARTID;
+    long tid = __snow_clone(flags, sp, &t->tid, &t->tid, t);
+    if (tid < 0)
+    {
+        free(stack);
+        free(t);
+        return EAGAIN;
+    }
+    *thread = t;
+    return 0;
+}
+
+int pthread_join(pthread_t t, void **retval)
+{
+    if (!t || t == pthread_self())
+        return EINVAL;
+    int tid;
+    while ((tid = t->tid) != 0)
+        ufutex_wait(&t->tid, tid);
+    if (retval)
+        *retval = t->ret;
+    free(t->stack);
+    free(t);
+    return 0;
+}
+
+void pthread_exit(void *retval)
+{
+    struct snow_pthread *self = pthread_self();
+    self->ret = retval;
+    /* SYS_exit ends only this thread for clone children (whole process for main) */
+    tsys(SYS_exit, 0, 0, 0, 0, 0, 0);
+    for (;;)
+        ;
+}
+
+pthread_t pthread_self(void)
+{
+    if (!threads_ready)
+        return &main_thread;
+    struct snow_pthread *self;
+    __asm__ volatile("mov %%fs:0, %0" : "=r"(self));
+    return self;
+}
+
+int pthread_equal(pthread_t a, pthread_t b) { return a == b; }
+
+int pthread_yield(void)
+{
+    tsys(SYS_sched_yield, 0, 0, 0, 0, 0, 0);
+    return 0;
+}
+
+/* Futex mutex (Drepper, "Futexes Are Tricky", mutex #2). */
+int pthread_mutex_init(pthread_mutex_t *m, const void *attr)
+{
+    (void)attr;
+    m->state = 0;
+    return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *m)
+{
+    return m->state ? EBUSY : 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *m)
+{
+    int expected = 0;
+    return __atomic_compare_exchange_n(&m->state, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) ? 0 : EBUSY;
+}
+
+int pthread_mutex_lock(pthread_mutex_t *m)
+{
+    int c = 0;
+    if (__atomic_compare_exchange_n(&m->state, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return 0;
+    if (c != 2)
+        c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+    while (c != 0)
+    {
+        ufutex_wait(&m->state, 2);
+        c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+    }
+    return 0;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *m)
+{
+    if (__atomic_fetch_sub(&m->state, 1, __ATOMIC_RELEASE) != 1)
+    {
+        __atomic_store_n(&m->state, 0, __ATOMIC_RELEASE);
+        ufutex_wake(&m->state, 1);
+    }
+    return 0;
+}
+
+/* Sequence-count condition variable: waiters sleep on the value they saw. */
+int pthread_cond_init(pthread_cond_t *c, const void *attr)
+{
+    (void)attr;
+    c->seq = 0;
+    return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *c)
+{
+    (void)c;
+    return 0;
+}
+
+int pthread_cond_wait(pthread_cond_t *c, pthread_mutex_t *m)
+{
+    int seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(m);
+    ufutex_wait(&c->seq, seq);
+    pthread_mutex_lock(m);
+    return 0;
+}
+
+int pthread_cond_signal(pthread_cond_t *c)
+{
+    __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+    ufutex_wake(&c->seq, 1);
+    return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *c)
+{
+    __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+    ufutex_wake(&c->seq, 0x7fffffff);
+    return 0;
+}
+
+/* newlib's malloc is not reentrant: serialise it with a recursive lock. */
+struct _reent;
+static pthread_mutex_t malloc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct snow_pthread *volatile malloc_owner = 0;
+static int malloc_depth = 0;
+
+void __malloc_lock(struct _reent *r)
+{
+    (void)r;
+    if (!threads_ready)
+        return;
+    struct snow_pthread *me = pthread_self();
+    if (malloc_owner == me)
+    {
+        malloc_depth++;
+        return;
+    }
+    pthread_mutex_lock(&malloc_mutex);
+    malloc_owner = me;
+    malloc_depth = 1;
+}
+
+void __malloc_unlock(struct _reent *r)
+{
+    (void)r;
+    if (!threads_ready || malloc_owner != pthread_self())
+        return;
+    if (--malloc_depth == 0)
+    {
+        malloc_owner = 0;
+        pthread_mutex_unlock(&malloc_mutex);
+    }
+}
+#endif
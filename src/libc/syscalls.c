@@ -2,6 +2,10 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <syscall.h>
+#include <elf.h>
+#include <ktime.h>
+#include <io_uring.h>
+#include <poll.h>
 #include "../kernel/kprint.h"
 #include "../fs/fs.h"
 
@@ -16,10 +20,96 @@ static inline long ksys(long n, long a1, long a2, long a3, long a4, long a5, lon
     register long r10 __asm__("r10") = a4;
     register long r8 __asm__("r8") = a5;
     register long r9 __asm__("r9") = a6;
-    __asm__ volatile("int $0x80" : "+r"(rax) : "r"(rdi), "r"(rsi), "r"(rdx), "r"(r10), "r"(r8), "r"(r9) : "rcx", "r11", "memory");
+    __asm__ volatile("syscall" : "+r"(rax) : "r"(rdi), "r"(rsi), "r"(rdx), "r"(r10), "r"(r8), "r"(r9) : "rcx", "r11", "memory");
     return rax;
 }
 
+/* vDSO entry points resolved from AT_SYSINFO_EHDR by crt0 */
+static int (*vdso_clock_gettime)(int, struct kernel_timespec *);
+static int (*vdso_gettimeofday)(struct kernel_timeval *, void *);
+
+static int name_eq(const char *a, const char *b)
+{
+    while (*a && *a == *b)
+    {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static void *vdso_sym(const unsigned char *base, const char *name)
+{
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)base;
+    const Elf64_Phdr *ph = (const Elf64_Phdr *)(base + eh->e_phoff);
+    const Elf64_Dyn *dyn = 0;
+    uintptr_t bias = 0;
+    for (int i = 0; i < eh->e_phnum; i++)
+    {
+        if (ph[i].p_type == PT_LOAD)
+            bias = (uintptr_t)base + ph[i].p_offset - ph[i].p_vaddr;
+        else if (ph[i].p_type == PT_DYNAMIC)
+            dyn = (const Elf64_Dyn *)(base + ph[i].p_offset);
+    }
+    if (!dyn)
+        return 0;
+    const uint32_t *hash = 0;
+    const Elf64_Sym *syms = 0;
+    const char *strs = 0;
+    for (; dyn->d_tag != DT_NULL; dyn++)
+    {
+        if (dyn->d_tag == DT_HASH)
+            hash = (const uint32_t *)(bias + dyn->d_val);
+        else if (dyn->d_tag == DT_SYMTAB)
+            syms = (const Elf64_Sym *)(bias + dyn->d_val);
+        else if (dyn->d_tag == DT_STRTAB)
+            strs = (const char *)(bias + dyn->d_val);
+    }
+    if (!hash || !syms || !strs)
+        return 0;
+    for (uint32_t i = 0; i < hash[1]; i++)
+    {
+        if (syms[i].st_shndx != 0 && name_eq(strs + syms[i].st_name, name))
+            return (void *)(bias + syms[i].st_value);
+    }
+    return 0;
+}
+
+/* Called from crt0 before main: skip envp to reach the auxiliary vector. */
+void __snow_libc_init(char **envp)
+{
+    while (*envp)
+        envp++;
+    for (uint64_t *aux = (uint64_t *)(envp + 1); aux[0] != AT_NULL; aux += 2)
+    {
+        if (aux[0] == AT_SYSINFO_EHDR && aux[1])
+        {
+            const unsigned char *base = (const unsigned char *)aux[1];
+            vdso_clock_gettime = vdso_sym(base, "__vdso_clock_gettime");
+            vdso_gettimeofday = vdso_sym(base, "__vdso_gettimeofday");
+        }
+    }
+}
+
+int clock_gettime(int clk, struct kernel_timespec *ts)
+{
+    if (vdso_clock_gettime)
+        return vdso_clock_gettime(clk, ts);
+    return (ksys(SYS_clock_gettime, clk, (long)ts, 0, 0, 0, 0) < 0 ? -1 : 0);
+}
+
+int _gettimeofday(struct kernel_timeval *tv, void *tz)
+{
+    if (vdso_gettimeofday)
+        return vdso_gettimeofday(tv, tz);
+    return (ksys(SYS_gettimeofday, (long)tv, (long)tz, 0, 0, 0, 0) < 0 ? -1 : 0);
+}
+
+int nanosleep(const struct kernel_timespec *req, struct kernel_timespec *rem)
+{
+    return (ksys(SYS_nanosleep, (long)req, (long)rem, 0, 0, 0, 0) < 0 ? -1 : 0);
+}
+
 void *_sbrk(ptrdiff_t incr)
 {
     long cur = ksys(SYS_brk, 0, 0, 0, 0, 0, 0);
@@ -32,6 +122,63 @@ void *_sbrk(ptrdiff_t incr)
     return (void *)cur;
 }
 
+/* newlib's O_* values differ from the kernel's (include/kfcntl.h) */
+static int open_flags(int f)
+{
+    int k = f & 3; /* O_RDONLY/O_WRONLY/O_RDWR agree */
+    if (f & 0x0008)
+        k |= 02000; /* O_APPEND */
+    if (f & 0x0200)
+        k |= 0100; /* O_CREAT */
+    if (f & 0x0400)
+        k |= 01000; /* O_TRUNC */
+    if (f & 0x0800)
+        k |= 0200; /* O_EXCL */
+    if (f & 0x4000)
+        k |= 04000; /* O_NONBLOCK */
+    if (f & 0x40000)
+        k |= 02000000; /* O_CLOEXEC */
+    return k;
+}
+
+int _open(const char *path, int flags, int mode)
+{
+    long r = ksys(SYS_open, (long)path, open_flags(flags), mode, 0, 0, 0);
+    return (r < 0 ? -1 : (int)r);
+}
+
+/* newlib's AT_FDCWD and AT_* flags differ from the kernel's as well */
+static long at_dirfd(int dirfd)
+{
+    return dirfd == -2 ? -100 : dirfd; /* AT_FDCWD */
+}
+
+static int at_flags(int f)
+{
+    int k = f & 0x6000; /* AT_STATX_SYNC_TYPE: newlib has none, Linux values */
+    if (f & 0x0002)
+        k |= 0x100; /* AT_SYMLINK_NOFOLLOW */
+    if (f & 0x0010)
+        k |= 0x1000; /* AT_EMPTY_PATH */
+    return k;
+}
+
+int openat(int dirfd, const char *path, int flags, int mode)
+{
+    long r = ksys(SYS_openat, at_dirfd(dirfd), (long)path, open_flags(flags), mode, 0, 0);
+    return (r < 0 ? -1 : (int)r);
+}
+
+int fstatat(int dirfd, const char *path, void *st, int flags)
+{
+    return (ksys(SYS_newfstatat, at_dirfd(dirfd), (long)path, (long)st, at_flags(flags), 0, 0) < 0 ? -1 : 0);
+}
+
+int statx(int dirfd, const char *path, int flags, unsigned mask, void *stx)
+{
+    return (ksys(SYS_statx, at_dirfd(dirfd), (long)path, at_flags(flags), mask, (long)stx, 0) < 0 ? -1 : 0);
+}
+
 int _close(int fd)
 {
     long r = ksys(SYS_close, fd, 0, 0, 0, 0, 0);
@@ -80,6 +227,81 @@ int _write(int fd, const void *buf, size_t cnt)
     long r = ksys(SYS_write, fd, (long)buf, cnt, 0, 0, 0);
     return (int)r;
 }
+long pread(int fd, void *buf, size_t cnt, long off)
+{
+    return ksys(SYS_pread64, fd, (long)buf, cnt, off, 0, 0);
+}
+long pwrite(int fd, const void *buf, size_t cnt, long off)
+{
+    return ksys(SYS_pwrite64, fd, (long)buf, cnt, off, 0, 0);
+}
+long readv(int fd, const struct kernel_iovec *iov, int iovcnt)
+{
+    return ksys(SYS_readv, fd, (long)iov, iovcnt, 0, 0, 0);
+}
+long writev(int fd, const struct kernel_iovec *iov, int iovcnt)
+{
+    return ksys(SYS_writev, fd, (long)iov, iovcnt, 0, 0, 0);
+}
+long copy_file_range(int fd_in, long *off_in, int fd_out, long *off_out, size_t len, unsigned flags)
+{
+    return ksys(SYS_copy_file_range, fd_in, (long)off_in, fd_out, (long)off_out, len, flags);
+}
+long sendfile(int out_fd, int in_fd, long *offset, size_t count)
+{
+    return ksys(SYS_sendfile, out_fd, in_fd, (long)offset, count, 0, 0);
+}
+long getdents64(int fd, void *dirp, size_t count)
+{
+    return ksys(SYS_getdents64, fd, (long)dirp, count, 0, 0, 0);
+}
+int poll(struct pollfd *fds, unsigned long nfds, int timeout)
+{
+    long r = ksys(SYS_poll, (long)fds, nfds, timeout, 0, 0, 0);
+    return (r < 0 ? -1 : (int)r);
+}
+int epoll_create1(int flags)
+{
+    long r = ksys(SYS_epoll_create1, flags, 0, 0, 0, 0, 0);
+    return (r < 0 ? -1 : (int)r);
+}
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *ev)
+{
+    return (ksys(SYS_epoll_ctl, epfd, op, fd, (long)ev, 0, 0) < 0 ? -1 : 0);
+}
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+    long r = ksys(SYS_epoll_wait, epfd, (long)events, maxevents, timeout, 0, 0);
+    return (r < 0 ? -1 : (int)r);
+}
+int pipe(int fd[2])
+{
+    return (ksys(SYS_pipe, (long)fd, 0, 0, 0, 0, 0) < 0 ? -1 : 0);
+}
+int pipe2(int fd[2], int flags)
+{
+    return (ksys(SYS_pipe2, (long)fd, open_flags(flags), 0, 0, 0, 0) < 0 ? -1 : 0);
+}
+long splice(int fd_in, long *off_in, int fd_out, long *off_out, size_t len, unsigned flags)
+{
+    return ksys(SYS_splice, fd_in, (long)off_in, fd_out, (long)off_out, len, flags);
+}
+long tee(int fd_in, int fd_out, size_t len, unsigned flags)
+{
+    return ksys(SYS_tee, fd_in, fd_out, len, flags, 0, 0);
+}
+int fsync(int fd)
+{
+    return (ksys(SYS_fsync, fd, 0, 0, 0, 0, 0) < 0 ? -1 : 0);
+}
+int fdatasync(int fd)
+{
+    return (ksys(SYS_fdatasync, fd, 0, 0, 0, 0, 0) < 0 ? -1 : 0);
+}
+void sync(void)
+{
+    ksys(SYS_sync, 0, 0, 0, 0, 0, 0);
+}
 void _exit(int code)
 {
     ksys(SYS_exit, code, 0, 0, 0, 0, 0);
@@ -94,11 +316,29 @@ int _kill(int pid, int sig)
     errno = 0;
     return -1;
 }
-int _getpid(void) { return 1; }
+int _getpid(void) { return (int)ksys(SYS_getpid, 0, 0, 0, 0, 0, 0); }
+
+int io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)ksys(SYS_io_uring_setup, entries, (long)p, 0, 0, 0, 0);
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)ksys(SYS_io_uring_enter, fd, to_submit, min_complete, flags, 0, 0);
+}
+
+int waitpid(int pid, int *status, int options)
+{
+    long r = ksys(SYS_wait4, pid, (long)status, options, 0, 0, 0);
+    return (int)r;
+}
+int _wait(int *status) { return waitpid(-1, status, 0); }
 
 #ifdef __GNUC__
 int write(int fd, const void *buf, size_t cnt) __attribute__((weak, alias("_write")));
 int read(int fd, void *buf, size_t cnt) __attribute__((weak, alias("_read")));
+int open(const char *path, int flags, int mode) __attribute__((weak, alias("_open")));
 int close(int fd) __attribute__((weak, alias("_close")));
 int fstat(int fd, void *st) __attribute__((weak, alias("_fstat")));
 int isatty(int fd) __attribute__((weak, alias("_isatty")));
@@ -106,9 +346,12 @@ long lseek(int fd, long off, int whence) __attribute__((weak, alias("_lseek")));
 void *sbrk(ptrdiff_t inc) __attribute__((weak, alias("_sbrk")));
 int kill(int pid, int sig) __attribute__((weak, alias("_kill")));
 int getpid(void) __attribute__((weak, alias("_getpid")));
+int wait(int *status) __attribute__((weak, alias("_wait")));
+int gettimeofday(struct kernel_timeval *tv, void *tz) __attribute__((weak, alias("_gettimeofday")));
 #else
 int write(int fd, const void *buf, size_t cnt) { return _write(fd, buf, cnt); }
 int read(int fd, void *buf, size_t cnt) { return _read(fd, buf, cnt); }
+int open(const char *path, int flags, int mode) { return _open(path, flags, mode); }
 int close(int fd) { return _close(fd); }
 int fstat(int fd, void *st) { return _fstat(fd, st); }
 int isatty(int fd) { return _isatty(fd); }
@@ -116,4 +359,6 @@ long lseek(int fd, long off, int whence) { return _lseek(fd, off, whence); }
 void *sbrk(ptrdiff_t inc) { return _sbrk(inc); }
 int kill(int pid, int sig) { return _kill(pid, sig); }
 int getpid(void) { return _getpid(); }
+int wait(int *status) { return _wait(status); }
+int gettimeofday(struct kernel_timeval *tv, void *tz) { return _gettimeofday(tv, tz); }
 #endif
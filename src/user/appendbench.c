@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ktime.h>
+
+/* Small appends: write one byte at a time to an O_APPEND file, then
+ * truncate it and do it again to show the freed blocks being reused.
+ * Reports the cost per append for each round. Usage: appendbench [count]
+ * (default 100000) */
+#define OUTPUT "/home/ab_out"
+#define ROUNDS 2
+
+/* src/libc/syscalls.c; newlib's <unistd.h>/<fcntl.h> types clash with include/stdint.h */
+int clock_gettime(int clk, struct kernel_timespec *ts);
+int open(const char *path, int flags, int mode);
+int write(int fd, const void *buf, size_t cnt);
+int close(int fd);
+long lseek(int fd, long off, int whence);
+#define O_WRONLY 1
+#define O_APPEND 0x0008 /* newlib values; _open translates them */
+#define O_CREAT 0x0200
+#define O_TRUNC 0x0400
+#define SEEK_END 2
+
+static unsigned long long now_ns(void)
+{
+    struct kernel_timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    long count = argc > 1 ? atoi(argv[1]) : 100000;
+    if (count < 1)
+        count = 1;
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        int fd = open(OUTPUT, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (fd < 0)
+        {
+            printf("appendbench: cannot open %s\n", OUTPUT);
+            return 1;
+        }
+        unsigned long long t0 = now_ns();
+        for (long i = 0; i < count; i++)
+        {
+            char c = 'a' + i % 26;
+            if (write(fd, &c, 1) != 1)
+            {
+                printf("appendbench: write %ld failed\n", i);
+                close(fd);
+                return 1;
+            }
+        }
+        unsigned long long ns = now_ns() - t0;
+        long size = lseek(fd, 0, SEEK_END);
+        close(fd);
+        printf("round %d: appends=%ld size=%ld time=%lluus %lluns/append\n", round, count, size, ns / 1000,
+               ns / (unsigned long long)count);
+        if (size != count)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ktime.h>
+#include <stat.h>
+
+/* Name lookup in a large directory: create count files in /home, then time
+ * stat() on names that exist, names that do not, and a PATH-style search
+ * that misses in every directory before it hits. Reports the cost per
+ * lookup for each. Usage: lookupbench [count] (default 10000) */
+#define DIR "/home/"
+#define PASSES 4
+
+/* src/libc/syscalls.c; newlib's <unistd.h>/<fcntl.h> types clash with include/stdint.h */
+int clock_gettime(int clk, struct kernel_timespec *ts);
+int open(const char *path, int flags, int mode);
+int close(int fd);
+int fstatat(int dirfd, const char *path, void *st, int flags);
+#define O_WRONLY 1
+#define O_CREAT 0x0200 /* newlib value; _open translates it */
+#define AT_FDCWD -2 /* newlib value; fstatat translates it */
+
+static const char *const path_dirs[] = {"/usr/local/bin/", "/usr/bin/", "/sbin/", "/bin/"};
+#define NPATH (int)(sizeof(path_dirs) / sizeof(path_dirs[0]))
+
+static unsigned long long now_ns(void)
+{
+    struct kernel_timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static void name(char *out, const char *prefix, long i)
+{
+    snprintf(out, 64, DIR "%s%05ld", prefix, i);
+}
+
+/* stat count names made by name(prefix, i); returns how many exist */
+static long stat_all(const char *prefix, long count)
+{
+    char path[64];
+    struct stat st;
+    long found = 0;
+    for (long i = 0; i < count; i++)
+    {
+        name(path, prefix, i);
+        if (fstatat(AT_FDCWD, path, &st, 0) == 0)
+            found++;
+    }
+    return found;
+}
+
+static void report(const char *what, unsigned long long t0, long lookups, long found)
+{
+    unsigned long long ns = now_ns() - t0;
+    printf("%-8s lookups=%-6ld found=%-6ld time=%lluus %lluns/lookup\n", what, lookups, found, ns / 1000,
+           ns / (unsigned long long)lookups);
+}
+
+int main(int argc, char **argv)
+{
+    long count = argc > 1 ? atoi(argv[1]) : 10000;
+    if (count < 1)
+        count = 1;
+    char path[64];
+    unsigned long long t0 = now_ns();
+    for (long i = 0; i < count; i++)
+    {
+        name(path, "lb", i);
+        int fd = open(path, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            printf("lookupbench: cannot create %s\n", path);
+            return 1;
+        }
+        close(fd);
+    }
+    report("create", t0, count, count);
+
+    long found = 0;
+    t0 = now_ns();
+    for (int p = 0; p < PASSES; p++)
+        found += stat_all("lb", count);
+    report("hit", t0, PASSES * count, found);
+
+    t0 = now_ns();
+    found = 0;
+    for (int p = 0; p < PASSES; p++)
+        found += stat_all("nx", count);
+    report("miss", t0, PASSES * count, found);
+
+    /* the shell looking up the same command over and over */
+    struct stat st;
+    t0 = now_ns();
+    found = 0;
+    for (long i = 0; i < count; i++)
+    {
+        for (int d = 0; d < NPATH; d++)
+        {
+            snprintf(path, sizeof(path), "%s%s", path_dirs[d], "hello");
+            if (fstatat(AT_FDCWD, path, &st, 0) == 0)
+            {
+                found++;
+                break;
+            }
+        }
+    }
+    report("path", t0, count, found);
+    return found == count ? 0 : 1;
+}
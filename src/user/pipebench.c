@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ktime.h>
+#include <snow_pthread.h>
+
+/* Pipe throughput: a reader thread drains the pipe while the main thread
+ * pushes the total through it, once per write size. Usage:
+ * pipebench [MiB] (default 1024) */
+#define MAX_CHUNK 65536
+
+/* src/libc/syscalls.c; newlib's <unistd.h> types clash with include/stdint.h */
+int clock_gettime(int clk, struct kernel_timespec *ts);
+int pipe(int fd[2]);
+int read(int fd, void *buf, size_t cnt);
+int write(int fd, const void *buf, size_t cnt);
+int close(int fd);
+
+static unsigned long long now_ns(void)
+{
+    struct kernel_timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static char wbuf[MAX_CHUNK], rbuf[MAX_CHUNK];
+static int rfd;
+static unsigned long long received;
+
+static void *reader(void *arg)
+{
+    (void)arg;
+    int n;
+    while ((n = read(rfd, rbuf, MAX_CHUNK)) > 0)
+        received += (unsigned long long)n;
+    return 0;
+}
+
+static int run(unsigned long long total, int chunk)
+{
+    int fd[2];
+    if (pipe(fd) < 0)
+    {
+        printf("pipebench: pipe failed\n");
+        return -1;
+    }
+    rfd = fd[0];
+    received = 0;
+    pthread_t t;
+    unsigned long long t0 = now_ns();
+    if (pthread_create(&t, 0, reader, 0) != 0)
+    {
+        printf("pipebench: pthread_create failed\n");
+        return -1;
+    }
+    for (unsigned long long sent = 0; sent < total;)
+    {
+        int n = write(fd[1], wbuf, chunk);
+        if (n <= 0)
+            break;
+        sent += (unsigned long long)n;
+    }
+    close(fd[1]); /* reader sees EOF once the ring drains */
+    pthread_join(t, 0);
+    close(fd[0]);
+    unsigned long long ns = now_ns() - t0;
+    unsigned long long mbps = ns ? received * 1000000000ULL / (1024 * 1024) / ns : 0;
+    printf("chunk=%d bytes=%llu time=%llums %lluMB/s\n", chunk, received, ns / 1000000, mbps);
+    return received == total ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    long mib = argc > 1 ? atoi(argv[1]) : 1024;
+    if (mib < 1)
+        mib = 1;
+    unsigned long long total = (unsigned long long)mib * 1024 * 1024;
+    static const int chunks[] = {512, 4096, MAX_CHUNK};
+    for (int i = 0; i < MAX_CHUNK; i++)
+        wbuf[i] = (char)i;
+    for (unsigned i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+        if (run(total, chunks[i]) < 0)
+            return 1;
+    return 0;
+}
@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ktime.h>
+#include <io_uring.h>
+
+/* Plain read/write loops against the submission rings for a cat-style copy
+ * and a wc-style scan of the same file. Reports kernel entries and time for
+ * each. Usage: uringbench [passes] */
+#define INPUT "/home/ub_in"
+#define INPUT_SIZE 4096
+#define CHUNK 256
+#define QDEPTH 16
+
+/* src/libc/syscalls.c; newlib's <unistd.h>/<fcntl.h> types clash with include/stdint.h */
+int clock_gettime(int clk, struct kernel_timespec *ts);
+int open(const char *path, int flags, int mode);
+int read(int fd, void *buf, size_t cnt);
+int write(int fd, const void *buf, size_t cnt);
+int close(int fd);
+long lseek(int fd, long off, int whence);
+#define O_RDONLY 0
+#define O_WRONLY 1
+#define O_CREAT 0x200 /* newlib value; _open translates it */
+#define SEEK_SET 0
+
+static unsigned long long now_ns(void)
+{
+    struct kernel_timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static unsigned long nsys; /* kernel entries made by the mode being measured */
+static char bufs[QDEPTH][CHUNK];
+
+struct ring
+{
+    int fd;
+    struct io_uring_ctl *ctl;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+};
+
+static struct io_uring_sqe *ring_sqe(struct ring *r, int op, int fd, void *addr, unsigned len, long off)
+{
+    unsigned tail = r->ctl->sq_tail;
+    struct io_uring_sqe *sqe = &r->sqes[tail & r->ctl->sq_mask];
+    sqe->opcode = op;
+    sqe->flags = 0;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)addr;
+    sqe->len = len;
+    sqe->off = (uint64_t)off;
+    sqe->op_flags = 0;
+    sqe->user_data = tail;
+    __atomic_store_n(&r->ctl->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+/* Submit everything queued; results land in res[] in submission order. */
+static int ring_submit(struct ring *r, int n, int *res)
+{
+    nsys++;
+    if (io_uring_enter(r->fd, n, n, 0) != n)
+        return -1;
+    unsigned head = r->ctl->cq_head;
+    for (int i = 0; i < n; i++, head++)
+        res[i] = r->cqes[head & r->ctl->cq_mask].res;
+    __atomic_store_n(&r->ctl->cq_head, head, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void count_words(const char *b, int n, unsigned long *lines, unsigned long *words, int *inword)
+{
+    for (int i = 0; i < n; i++)
+    {
+        char c = b[i];
+        if (c == '\n')
+            (*lines)++;
+        if (c == ' ' || c == '\n' || c == '\t')
+            *inword = 0;
+        else if (!*inword)
+        {
+            *inword = 1;
+            (*words)++;
+        }
+    }
+}
+
+static unsigned long wc_plain(int passes, unsigned long *words)
+{
+    unsigned long lines = 0;
+    *words = 0;
+    int fd = open(INPUT, O_RDONLY, 0);
+    nsys++;
+    for (int p = 0; p < passes; p++)
+    {
+        int inword = 0, n;
+        lseek(fd, 0, SEEK_SET);
+        nsys++;
+        while ((n = read(fd, bufs[0], CHUNK)) > 0)
+        {
+            nsys++;
+            count_words(bufs[0], n, &lines, words, &inword);
+        }
+        nsys++;
+    }
+    close(fd);
+    nsys++;
+    return lines;
+}
+
+static unsigned long wc_ring(struct ring *r, int passes, unsigned long *words)
+{
+    unsigned long lines = 0;
+    int res[QDEPTH];
+    *words = 0;
+    int fd = open(INPUT, O_RDONLY, 0);
+    nsys++;
+    for (int p = 0; p < passes; p++)
+    {
+        int inword = 0, eof = 0;
+        for (long off = 0; !eof; off += QDEPTH * CHUNK)
+        {
+            for (int i = 0; i < QDEPTH; i++)
+                ring_sqe(r, IORING_OP_READ, fd, bufs[i], CHUNK, off + (long)i * CHUNK);
+            if (ring_submit(r, QDEPTH, res) < 0)
+                return 0;
+            for (int i = 0; i < QDEPTH && !eof; i++)
+            {
+                if (res[i] > 0)
+                    count_words(bufs[i], res[i], &lines, words, &inword);
+                if (res[i] < CHUNK)
+                    eof = 1;
+            }
+        }
+    }
+    close(fd);
+    nsys++;
+    return lines;
+}
+
+static long cat_plain(const char *out)
+{
+    long total = 0;
+    int in = open(INPUT, O_RDONLY, 0);
+    int o = open(out, O_WRONLY | O_CREAT, 0644);
+    nsys += 2;
+    int n;
+    while ((n = read(in, bufs[0], CHUNK)) > 0)
+    {
+        write(o, bufs[0], n);
+        nsys += 2;
+        total += n;
+    }
+    nsys++;
+    close(in);
+    close(o);
+    nsys += 2;
+    return total;
+}
+
+/* Reads, then the matching writes, QDEPTH chunks per round trip. */
+static long cat_ring(struct ring *r, const char *out)
+{
+    long total = 0;
+    int res[QDEPTH], wres[QDEPTH];
+    int in = open(INPUT, O_RDONLY, 0);
+    int o = open(out, O_WRONLY | O_CREAT, 0644);
+    nsys += 2;
+    for (long off = 0;; off += QDEPTH * CHUNK)
+    {
+        for (int i = 0; i < QDEPTH; i++)
+            ring_sqe(r, IORING_OP_READ, in, bufs[i], CHUNK, off + (long)i * CHUNK);
+        if (ring_submit(r, QDEPTH, res) < 0)
+            return -1;
+        int nw = 0;
+        for (int i = 0; i < QDEPTH && res[i] > 0; i++, nw++)
+            ring_sqe(r, IORING_OP_WRITE, o, bufs[i], res[i], -1);
+        if (nw && ring_submit(r, nw, wres) < 0)
+            return -1;
+        for (int i = 0; i < nw; i++)
+            total += wres[i];
+        if (nw < QDEPTH || res[QDEPTH - 1] < CHUNK)
+            break;
+    }
+    close(in);
+    close(o);
+    nsys += 2;
+    return total;
+}
+
+static void report(const char *name, unsigned long long t0, long bytes)
+{
+    unsigned long long ns = now_ns() - t0;
+    unsigned long long kbps = ns ? (unsigned long long)bytes * 1000000000ULL / 1024 / ns : 0;
+    printf("%-10s syscalls=%-6lu time=%lluus %lluKB/s\n", name, nsys, ns / 1000, kbps);
+}
+
+int main(int argc, char **argv)
+{
+    int passes = argc > 1 ? atoi(argv[1]) : 16;
+    if (passes < 1)
+        passes = 1;
+
+    /* text input: short words and lines */
+    static char text[INPUT_SIZE];
+    for (int i = 0; i < INPUT_SIZE; i++)
+        text[i] = (i % 64 == 63) ? '\n' : (i % 8 == 7) ? ' ' : 'a' + i % 26;
+    int fd = open(INPUT, O_WRONLY | O_CREAT, 0644);
+    if (fd < 0 || write(fd, text, INPUT_SIZE) != INPUT_SIZE)
+    {
+        printf("uringbench: cannot create %s\n", INPUT);
+        return 1;
+    }
+    close(fd);
+
+    struct io_uring_params params = {0};
+    struct ring r;
+    r.fd = io_uring_setup(QDEPTH, &params);
+    if (r.fd < 0)
+    {
+        printf("uringbench: io_uring_setup failed (%d)\n", r.fd);
+        return 1;
+    }
+    r.ctl = (struct io_uring_ctl *)(uintptr_t)params.ctl;
+    r.sqes = (struct io_uring_sqe *)(uintptr_t)params.sqes;
+    r.cqes = (struct io_uring_cqe *)(uintptr_t)params.cqes;
+
+    unsigned long lines, words;
+    unsigned long long t0;
+
+    nsys = 0;
+    t0 = now_ns();
+    lines = wc_plain(passes, &words);
+    report("wc read", t0, (long)passes * INPUT_SIZE);
+    printf("           lines=%lu words=%lu\n", lines, words);
+
+    nsys = 0;
+    t0 = now_ns();
+    lines = wc_ring(&r, passes, &words);
+    report("wc ring", t0, (long)passes * INPUT_SIZE);
+    printf("           lines=%lu words=%lu\n", lines, words);
+
+    long n;
+    nsys = 0;
+    t0 = now_ns();
+    n = cat_plain("/home/ub_cat1");
+    report("cat read", t0, n);
+
+    nsys = 0;
+    t0 = now_ns();
+    n = cat_ring(&r, "/home/ub_cat2");
+    report("cat ring", t0, n);
+    return 0;
+}
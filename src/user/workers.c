@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ktime.h>
+#include <snow_pthread.h>
+
+/* Parallel worker demo: split a sum over several threads, combine the
+ * partial results under a mutex, and report the wall time. */
+#define MAX_WORKERS 8
+#define DEFAULT_N 4000000ULL
+
+struct job
+{
+    unsigned long long lo, hi;
+};
+
+static pthread_mutex_t total_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long long total = 0;
+
+static void *worker(void *arg)
+{
+    struct job *j = (struct job *)arg;
+    unsigned long long sum = 0;
+    for (unsigned long long i = j->lo; i < j->hi; i++)
+        sum += i % 7;
+    pthread_mutex_lock(&total_lock);
+    total += sum;
+    pthread_mutex_unlock(&total_lock);
+    return 0;
+}
+
+int clock_gettime(int clk, struct kernel_timespec *ts); /* src/libc/syscalls.c */
+
+static unsigned long long now_ns(void)
+{
+    struct kernel_timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    int nworkers = argc > 1 ? atoi(argv[1]) : 4;
+    if (nworkers < 1)
+        nworkers = 1;
+    if (nworkers > MAX_WORKERS)
+        nworkers = MAX_WORKERS;
+    pthread_t tids[MAX_WORKERS];
+    struct job jobs[MAX_WORKERS];
+    unsigned long long n = DEFAULT_N, chunk = n / nworkers;
+    unsigned long long t0 = now_ns();
+    for (int i = 0; i < nworkers; i++)
+    {
+        jobs[i].lo = i * chunk;
+        jobs[i].hi = (i == nworkers - 1) ? n : (i + 1) * chunk;
+        if (pthread_create(&tids[i], 0, worker, &jobs[i]) != 0)
+        {
+            printf("workers: pthread_create failed\n");
+            return 1;
+        }
+    }
+    for (int i = 0; i < nworkers; i++)
+        pthread_join(tids[i], 0);
+    unsigned long long t1 = now_ns();
+    printf("workers: %d threads sum=%llu time=%llu us\n", nworkers, total, (t1 - t0) / 1000);
+    return 0;
+}
@@ -0,0 +1,48 @@
+// vDSO: mapped read-only into every process so time queries skip kernel entry.
+// Built position-independent; see linker_vdso.ld for the image layout.
+#include <stdint.h>
+#include "vdso.h"
+#include "syscall.h"
+
+extern const volatile struct vdso_data __vdso_data __attribute__((visibility("hidden")));
+
+static long vdso_fallback(long num, long a1, long a2)
+{
+    register long rax __asm__("rax") = num;
+    register long rdi __asm__("rdi") = a1;
+    register long rsi __asm__("rsi") = a2;
+    __asm__ volatile("syscall" : "+r"(rax) : "r"(rdi), "r"(rsi) : "rcx", "r11", "memory");
+    return rax;
+}
+
+int __vdso_clock_gettime(int clk, struct kernel_timespec *ts)
+{
+    if (ts && vdso_read_clock(&__vdso_data, clk, ts) == 0)
+        return 0;
+    return (int)vdso_fallback(SYS_clock_gettime, clk, (long)ts);
+}
+
+int __vdso_gettimeofday(struct kernel_timeval *tv, void *tz)
+{
+    (void)tz;
+    struct kernel_timespec ts;
+    if (!tv)
+        return 0;
+    vdso_read_clock(&__vdso_data, CLOCK_REALTIME, &ts);
+    tv->tv_sec = ts.tv_sec;
+    tv->tv_usec = ts.tv_nsec / 1000;
+    return 0;
+}
+
+int64_t __vdso_time(int64_t *t)
+{
+    struct kernel_timespec ts;
+    vdso_read_clock(&__vdso_data, CLOCK_REALTIME_COARSE, &ts);
+    if (t)
+        *t = ts.tv_sec;
+    return ts.tv_sec;
+}
+
+int clock_gettime(int clk, struct kernel_timespec *ts) __attribute__((weak, alias("__vdso_clock_gettime")));
+int gettimeofday(struct kernel_timeval *tv, void *tz) __attribute__((weak, alias("__vdso_gettimeofday")));
+int64_t time(int64_t *t) __attribute__((weak, alias("__vdso_time")));
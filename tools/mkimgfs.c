@@ -0,0 +1,416 @@
+/* mkimgfs: pack a directory tree into an imgfs image (src/fs/imgfs.h).
+ *
+ *     mkimgfs [-b block_size] out.img dir
+ *
+ * Runs on the build host. Directories are numbered breadth first, so each
+ * one's entries sit together in the entry table, sorted by name. Every
+ * block is checked by decompressing it again before it is written. */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "../src/fs/imgfs.h"
+#include "../src/fs/lz4.h"
+
+typedef struct ent
+{
+    char *name;
+    char *path;
+    int dir;
+    struct ent **kids;
+    size_t nkids;
+    uint32_t ino;
+} ent_t;
+
+typedef struct
+{
+    uint8_t *p;
+    size_t len, cap;
+} buf_t;
+
+static uint32_t block_size = 32768;
+static buf_t inodes, dirents, blks, frags, names, data;
+static uint8_t *frag_buf; /* tails waiting for a fragment */
+static uint32_t frag_len;
+static size_t raw_total;
+
+static void *xmalloc(size_t n)
+{
+    void *p = malloc(n ? n : 1);
+    if (!p)
+    {
+        fprintf(stderr, "mkimgfs: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void put(buf_t *b, const void *src, size_t n)
+{
+    if (b->len + n > b->cap)
+    {
+        b->cap = (b->len + n) * 2;
+        b->p = realloc(b->p, b->cap);
+        if (!b->p)
+        {
+            fprintf(stderr, "mkimgfs: out of memory\n");
+            exit(1);
+        }
+    }
+    memcpy(b->p + b->len, src, n);
+    b->len += n;
+}
+
+static void align4(buf_t *b)
+{
+    static const uint8_t zero[4];
+    put(b, zero, (4 - b->len % 4) % 4);
+}
+
+/* ---- LZ4 block compression: greedy, one hash probe per position ---- */
+
+#define HASH_BITS 16
+#define MIN_MATCH 4
+#define LAST_LITERALS 5 /* the format ends every block with literals */
+#define MF_LIMIT 12     /* no match may start this close to the end */
+
+static uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint8_t *put_len(uint8_t *op, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static uint8_t *put_seq(uint8_t *op, const uint8_t *lit, size_t nlit, size_t off, size_t ml)
+{
+    uint8_t *token = op++;
+    *token = (uint8_t)((nlit < 15 ? nlit : 15) << 4);
+    if (nlit >= 15)
+        op = put_len(op, nlit - 15);
+    memcpy(op, lit, nlit);
+    op += nlit;
+    if (!ml)
+        return op;
+    *op++ = (uint8_t)off;
+    *op++ = (uint8_t)(off >> 8);
+    ml -= MIN_MATCH;
+    *token |= (uint8_t)(ml < 15 ? ml : 15);
+    if (ml >= 15)
+        op = put_len(op, ml - 15);
+    return op;
+}
+
+/* dst must hold n + n / 255 + 16 bytes. */
+static size_t lz4_compress(const uint8_t *src, size_t n, uint8_t *dst)
+{
+    static uint32_t table[1 << HASH_BITS]; /* position + 1 */
+    memset(table, 0, sizeof(table));
+    uint8_t *op = dst;
+    size_t ip = 0, anchor = 0;
+    if (n > MF_LIMIT)
+    {
+        while (ip < n - MF_LIMIT)
+        {
+            uint32_t seq = read32(src + ip);
+            uint32_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+            size_t ref = table[h];
+            table[h] = (uint32_t)ip + 1;
+            if (!ref || ip - (ref - 1) > 65535 || read32(src + ref - 1) != seq)
+            {
+                ip++;
+                continue;
+            }
+            ref--;
+            size_t ml = MIN_MATCH;
+            while (ip + ml < n - LAST_LITERALS && src[ref + ml] == src[ip + ml])
+                ml++;
+            op = put_seq(op, src + anchor, ip - anchor, ip - ref, ml);
+            ip += ml;
+            anchor = ip;
+        }
+    }
+    op = put_seq(op, src + anchor, n - anchor, 0, 0);
+    return (size_t)(op - dst);
+}
+
+/* Append one block to the data area: LZ4 when that is smaller, else raw.
+ * Returns its offset in the data area; *csize gets the stored size. */
+static uint32_t put_block(const uint8_t *src, uint32_t n, uint32_t *csize)
+{
+    static uint8_t cbuf[IMGFS_BLOCK_MAX + IMGFS_BLOCK_MAX / 255 + 16];
+    static uint8_t check[IMGFS_BLOCK_MAX];
+    size_t c = lz4_compress(src, n, cbuf);
+    align4(&data);
+    uint32_t off = (uint32_t)data.len;
+    if (c < n)
+    {
+        if (lz4_decompress(cbuf, c, check, n) != (int)n || memcmp(check, src, n))
+        {
+            fprintf(stderr, "mkimgfs: compressor self-check failed\n");
+            exit(1);
+        }
+        put(&data, cbuf, c);
+        *csize = (uint32_t)c;
+    }
+    else
+    {
+        put(&data, src, n);
+        *csize = IMGFS_RAW | n;
+    }
+    return off;
+}
+
+static void frag_flush(void)
+{
+    if (!frag_len)
+        return;
+    imgfs_frag_t f;
+    f.usize = frag_len;
+    f.off = put_block(frag_buf, frag_len, &f.csize);
+    put(&frags, &f, sizeof(f));
+    frag_len = 0;
+}
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *p = xmalloc((size_t)n);
+    if (n < 0 || fread(p, 1, (size_t)n, f) != (size_t)n)
+    {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+    *len = (size_t)n;
+    return p;
+}
+
+static void put_file(const ent_t *e, imgfs_inode_t *in)
+{
+    size_t len;
+    uint8_t *p = read_file(e->path, &len);
+    if (len > 0xFFFFFFFFu)
+    {
+        fprintf(stderr, "mkimgfs: %s: too big\n", e->path);
+        exit(1);
+    }
+    raw_total += len;
+    in->type = IMGFS_FILE;
+    in->size = (uint32_t)len;
+    in->first = (uint32_t)(blks.len / sizeof(imgfs_blk_t));
+    in->frag = IMGFS_NOFRAG;
+    in->frag_off = 0;
+    size_t full = len / block_size;
+    for (size_t i = 0; i < full; i++)
+    {
+        imgfs_blk_t b;
+        b.off = put_block(p + i * block_size, block_size, &b.csize);
+        put(&blks, &b, sizeof(b));
+    }
+    uint32_t tail = (uint32_t)(len % block_size);
+    if (tail)
+    {
+        if (frag_len + tail > block_size)
+            frag_flush();
+        in->frag = (uint32_t)(frags.len / sizeof(imgfs_frag_t));
+        in->frag_off = frag_len;
+        memcpy(frag_buf + frag_len, p + full * block_size, tail);
+        frag_len += tail;
+    }
+    free(p);
+}
+
+static int by_name(const void *a, const void *b)
+{
+    return strcmp((*(ent_t *const *)a)->name, (*(ent_t *const *)b)->name);
+}
+
+static ent_t *scan(const char *path, const char *name)
+{
+    struct stat st;
+    if (stat(path, &st) < 0)
+    {
+        perror(path);
+        exit(1);
+    }
+    ent_t *e = xmalloc(sizeof(*e));
+    memset(e, 0, sizeof(*e));
+    e->name = strdup(name);
+    e->path = strdup(path);
+    if (S_ISREG(st.st_mode))
+        return e;
+    if (!S_ISDIR(st.st_mode))
+    {
+        free(e);
+        return 0; /* imgfs holds files and directories only */
+    }
+    e->dir = 1;
+    DIR *d = opendir(path);
+    if (!d)
+    {
+        perror(path);
+        exit(1);
+    }
+    size_t cap = 0;
+    struct dirent *de;
+    while ((de = readdir(d)))
+    {
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+            continue;
+        char *sub = xmalloc(strlen(path) + strlen(de->d_name) + 2);
+        sprintf(sub, "%s/%s", path, de->d_name);
+        ent_t *k = scan(sub, de->d_name);
+        free(sub);
+        if (!k)
+            continue;
+        if (e->nkids == cap)
+        {
+            cap = cap ? cap * 2 : 16;
+            e->kids = realloc(e->kids, cap * sizeof(*e->kids));
+        }
+        e->kids[e->nkids++] = k;
+    }
+    closedir(d);
+    qsort(e->kids, e->nkids, sizeof(*e->kids), by_name);
+    return e;
+}
+
+int main(int argc, char **argv)
+{
+    int a = 1;
+    if (a + 1 < argc && !strcmp(argv[a], "-b"))
+    {
+        block_size = (uint32_t)strtoul(argv[a + 1], 0, 0);
+        a += 2;
+    }
+    if (argc - a != 2 || block_size < IMGFS_BLOCK_MIN || block_size > IMGFS_BLOCK_MAX ||
+        (block_size & (block_size - 1)))
+    {
+        fprintf(stderr, "usage: mkimgfs [-b block_size] out.img dir\n"
+                        "block_size is a power of two from %u to %u\n",
+                IMGFS_BLOCK_MIN, IMGFS_BLOCK_MAX);
+        return 2;
+    }
+    ent_t *root = scan(argv[a + 1], "");
+    if (!root || !root->dir)
+    {
+        fprintf(stderr, "mkimgfs: %s: not a directory\n", argv[a + 1]);
+        return 1;
+    }
+    frag_buf = xmalloc(block_size);
+
+    /* Number breadth first: a directory's children get consecutive inodes
+     * and entries. */
+    size_t nq = 1, qcap = 64;
+    ent_t **q = xmalloc(qcap * sizeof(*q));
+    q[0] = root;
+    root->ino = IMGFS_ROOT;
+    for (size_t i = 0; i < nq; i++)
+    {
+        ent_t *e = q[i];
+        for (size_t k = 0; k < e->nkids; k++)
+        {
+            if (nq == qcap)
+                q = realloc(q, (qcap *= 2) * sizeof(*q));
+            e->kids[k]->ino = (uint32_t)nq;
+            q[nq++] = e->kids[k];
+        }
+    }
+    for (size_t i = 0; i < nq; i++)
+    {
+        ent_t *e = q[i];
+        imgfs_inode_t in;
+        memset(&in, 0, sizeof(in));
+        if (e->dir)
+        {
+            in.type = IMGFS_DIR;
+            in.size = (uint32_t)e->nkids;
+            in.first = (uint32_t)(dirents.len / sizeof(imgfs_dirent_t));
+            for (size_t k = 0; k < e->nkids; k++)
+            {
+                imgfs_dirent_t d;
+                d.ino = e->kids[k]->ino;
+                d.name = (uint32_t)names.len;
+                d.len = (uint32_t)strlen(e->kids[k]->name);
+                put(&names, e->kids[k]->name, d.len);
+                put(&dirents, &d, sizeof(d));
+            }
+        }
+        else
+            put_file(e, &in);
+        put(&inodes, &in, sizeof(in));
+    }
+    frag_flush();
+
+    imgfs_super_t s;
+    memset(&s, 0, sizeof(s));
+    memcpy(s.magic, IMGFS_MAGIC, 8);
+    s.block_size = block_size;
+    uint32_t off = sizeof(s);
+    s.ninodes = (uint32_t)nq;
+    s.inode_off = off;
+    off += (uint32_t)inodes.len;
+    s.ndirents = (uint32_t)(dirents.len / sizeof(imgfs_dirent_t));
+    s.dirent_off = off;
+    off += (uint32_t)dirents.len;
+    s.nblocks = (uint32_t)(blks.len / sizeof(imgfs_blk_t));
+    s.block_off = off;
+    off += (uint32_t)blks.len;
+    s.nfrags = (uint32_t)(frags.len / sizeof(imgfs_frag_t));
+    s.frag_off = off;
+    off += (uint32_t)frags.len;
+    s.names_off = off;
+    s.names_len = (uint32_t)names.len;
+    off = (off + s.names_len + 3) & ~3u;
+    uint32_t data_off = off;
+    s.size = data_off + (uint32_t)data.len;
+    s.data_size = (uint32_t)raw_total;
+
+    /* the tables hold offsets in the data area until now */
+    for (size_t i = 0; i < s.nblocks; i++)
+        ((imgfs_blk_t *)blks.p)[i].off += data_off;
+    for (size_t i = 0; i < s.nfrags; i++)
+        ((imgfs_frag_t *)frags.p)[i].off += data_off;
+
+    FILE *f = fopen(argv[a], "wb");
+    if (!f)
+    {
+        perror(argv[a]);
+        return 1;
+    }
+    static const uint8_t zero[4];
+    fwrite(&s, sizeof(s), 1, f);
+    fwrite(inodes.p, 1, inodes.len, f);
+    fwrite(dirents.p, 1, dirents.len, f);
+    fwrite(blks.p, 1, blks.len, f);
+    fwrite(frags.p, 1, frags.len, f);
+    fwrite(names.p, 1, names.len, f);
+    fwrite(zero, 1, data_off - (s.names_off + s.names_len), f);
+    fwrite(data.p, 1, data.len, f);
+    if (fclose(f) != 0)
+    {
+        perror(argv[a]);
+        return 1;
+    }
+    printf("mkimgfs: %s: %u inodes, %zu bytes packed into %u\n", argv[a], s.ninodes, raw_total, s.size);
+    return 0;
+}